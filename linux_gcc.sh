@@ -1,20 +1,30 @@
 #!/bin/bash
 
 RELEASE=false
+BENCHMARK=true
 
 # Preprocessor
 WARNINGS="-Wno-unused-but-set-variable -Wno-sign-compare -Wno-missing-field-initializers -Wno-switch"
 
-FILES=""preprocessor/main.cpp" "preprocessor/utils.cpp" "preprocessor/lexer.cpp" "preprocessor/platform.cpp" "preprocessor/write_file.cpp""
+FILES=""preprocessor/main.cpp" "preprocessor/utils.cpp" "preprocessor/lexer.cpp" "preprocessor/platform.cpp" "preprocessor/write_file.cpp" "preprocessor/thread_pool.cpp""
 
 echo "Building preprocessor"
 if [ "$RELEASE" = "true" ]; then
-    g++ -Wall -Wextra $FILES -std=c++11 -fno-exceptions -fno-rtti -o preprocessor_exe -DERROR_LOGGING=0 -DRUN_TESTS=0 -DINTERNAL=0 -DMEM_CHECK=0 -DWIN32=0 -DLINUX=1 $WARNINGS -g -ldl
+    g++ -Wall -Wextra $FILES -std=c++11 -fno-exceptions -fno-rtti -o preprocessor_exe -DERROR_LOGGING=0 -DRUN_TESTS=0 -DINTERNAL=0 -DMEM_CHECK=0 -DWIN32=0 -DLINUX=1 $WARNINGS -g -ldl -pthread
 else
     g++ -Wall -Wextra $FILES "preprocessor/test.cpp" "preprocessor/google_test/gtest-all.cc" -fno-exceptions -fno-rtti -o preprocessor_exe -DERROR_LOGGING=1 -DRUN_TESTS=1 -DINTERNAL=1 -DMEM_CHECK=1 -DWIN32=0 -DLINUX=1 $WARNINGS -g -ldl -pthread
 fi
 mv "./preprocessor_exe" "build/preprocessor"
 
+# Benchmark. Everything but main.cpp, always optimized.
+BENCHMARK_FILES=""preprocessor/utils.cpp" "preprocessor/lexer.cpp" "preprocessor/platform.cpp" "preprocessor/write_file.cpp" "preprocessor/thread_pool.cpp" "preprocessor/benchmark.cpp""
+
+if [ "$BENCHMARK" = "true" ]; then
+    echo "Building benchmark"
+    g++ -Wall -Wextra $BENCHMARK_FILES -std=c++11 -O2 -fno-exceptions -fno-rtti -o benchmark_exe -DERROR_LOGGING=0 -DRUN_TESTS=0 -DINTERNAL=0 -DMEM_CHECK=0 -DWIN32=0 -DLINUX=1 $WARNINGS -g -ldl -pthread
+    mv "./benchmark_exe" "build/benchmark"
+fi
+
 # Run test code after building.
 if [ "$GTEST" = "true" ]; then
     if [ "$RELEASE" = "true" ]; then
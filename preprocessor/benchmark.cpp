@@ -0,0 +1,402 @@
+/*===================================================================================================
+  File:                    benchmark.cpp
+  Author:                  Jonathan Livingstone
+  Email:                   seagull127@ymail.com
+  Licence:                 Public Domain
+                           No Warranty is offered or implied about the reliability,
+                           suitability, or usability
+                           The use of this code is at your own risk
+                           Anyone can use this code, modify it, sell it to terrorists, etc.
+  ===================================================================================================*/
+
+// Builds to its own executable (build/benchmark), with everything but main.cpp. Generates a set of synthetic
+// headers, times tokenize, parse_stream and write_data on each, and prints the results as JSON, so a build machine
+// can compare them against the last run.
+
+#include "platform.h"
+#include "lexer.h"
+#include "write_file.h"
+#include "stb_sprintf.h"
+#if SIMD_SSE2
+    // lexer.cpp includes these too, but they can't go inside the namespace.
+    #include <emmintrin.h>
+    #if SIMD_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+#define LEXER_INCLUDED_FOR_INTERNALS
+namespace {
+#include "lexer.cpp"
+}
+
+//
+// Synthetic headers.
+//
+// Everything comes from a seeded random number generator, so the same config always makes exactly the same file.
+struct CorpusConfig {
+    Char const *name;
+
+    Int struct_count;
+    Int members_per_struct; // On average. Each struct gets between half and one and a half times this.
+    Int enum_count;
+    Int macro_count; // #defines, which are then used as member types and array sizes.
+    Int comment_percent; // The chance of each struct and member getting a comment.
+    Int if_depth; // How deep the #if blocks around each struct's members nest.
+};
+
+internal CorpusConfig corpus_configs[] = {
+//   name             structs members enums macros comments #if depth
+    {"baseline",         2000,      8,   50,     0,      10,        0},
+    {"many_structs",    20000,      4,  100,     0,       0,        0},
+    {"wide_structs",      200,    128,    0,     0,       0,        0},
+    {"enum_heavy",        200,      8, 2000,     0,       0,        0},
+    {"macro_heavy",      2000,      8,   50,  2000,       0,        0},
+    {"comment_heavy",    2000,      8,   50,     0,      90,        0},
+    {"nested_if",        2000,      8,   50,     0,       0,        4},
+};
+
+struct Random {
+    Uint64 state;
+};
+
+// xorshift64*.
+internal Uint32 random_next(Random *r) {
+    r->state ^= r->state >> 12;
+    r->state ^= r->state << 25;
+    r->state ^= r->state >> 27;
+    Uint32 res = cast(Uint32)((r->state * 0x2545F4914F6CDD1DULL) >> 32);
+
+    return(res);
+}
+
+internal Int random_between(Random *r, Int min, Int max) {
+    Int res = min + cast(Int)(random_next(r) % cast(Uint32)(max - min + 1));
+
+    return(res);
+}
+
+internal Bool random_chance(Random *r, Int percent) {
+    Bool res = (cast(Int)(random_next(r) % 100) < percent);
+
+    return(res);
+}
+
+struct CorpusBuffer {
+    Char *e;
+    Int len;
+    Int size;
+};
+
+internal Void corpus_write(CorpusBuffer *buf, Char const *format, ...) {
+    // Nothing written in one go is anywhere near this big.
+    if(buf->len + 1024 > buf->size) {
+        Int new_size = (buf->size) ? buf->size * 2 : 1024 * 1024;
+        Char *e = cast(Char *)system_realloc(buf->e, new_size);
+        if(e) {
+            buf->e = e;
+            buf->size = new_size;
+        }
+    }
+
+    if(buf->len + 1024 <= buf->size) {
+        va_list args;
+        va_start(args, format);
+        buf->len += stbsp_vsnprintf(buf->e + buf->len, buf->size - buf->len, format, args);
+        va_end(args);
+    }
+}
+
+internal Char const *primitive_member_types[] = {"int", "float", "double", "char", "short", "bool", "unsigned", "long"};
+
+internal Void write_corpus_comment(CorpusBuffer *buf, Random *r, Char const *indent) {
+    if(random_chance(r, 50)) {
+        corpus_write(buf, "%s// A line comment, describing whatever comes next in a bit of detail. %u\n", indent, random_next(r));
+    } else {
+        corpus_write(buf,
+                     "%s/* A block comment, which goes on for a couple of lines,\n"
+                     "%s   like the ones at the top of a function. %u */\n",
+                     indent, indent, random_next(r));
+    }
+}
+
+internal CorpusBuffer generate_corpus(CorpusConfig *config, Uint64 seed) {
+    CorpusBuffer res = {};
+    Random r = { seed ^ hash_bytes(config->name, string_length(config->name)) };
+    if(!r.state) {
+        r.state = 1;
+    }
+
+    corpus_write(&res, "// Generated by the preprocessor benchmark (%s).\n\n", config->name);
+
+    for(Int i = 0; (i < config->macro_count); ++i) {
+        if(i & 1) { corpus_write(&res, "#define BENCH_SIZE_%d %d\n", i, random_between(&r, 1, 64));                                  }
+        else      { corpus_write(&res, "#define BENCH_TYPE_%d %s\n", i, primitive_member_types[i % array_count(primitive_member_types)]); }
+    }
+    corpus_write(&res, "\n");
+
+    for(Int i = 0; (i < config->enum_count); ++i) {
+        Int value_count = random_between(&r, 2, 16);
+        Bool is_enum_class = random_chance(&r, 25);
+
+        if(is_enum_class) { corpus_write(&res, "enum class BenchEnum%d : int {\n", i); }
+        else              { corpus_write(&res, "enum BenchEnum%d {\n", i);             }
+
+        for(Int j = 0; (j < value_count); ++j) {
+            if(random_chance(&r, 20)) { corpus_write(&res, "    BenchEnum%d_value%d = %d,\n", i, j, j * 4); }
+            else                      { corpus_write(&res, "    BenchEnum%d_value%d,\n", i, j);             }
+        }
+        corpus_write(&res, "};\n\n");
+    }
+
+    for(Int i = 0; (i < config->struct_count); ++i) {
+        if(random_chance(&r, config->comment_percent)) {
+            write_corpus_comment(&res, &r, "");
+        }
+
+        // Only inherit from, or point to, earlier structs so it would actually compile.
+        if((i) && (random_chance(&r, 15))) {
+            corpus_write(&res, "struct BenchStruct%d : public BenchStruct%d {\n", i, random_between(&r, 0, i - 1));
+        } else {
+            corpus_write(&res, "struct BenchStruct%d {\n", i);
+        }
+
+        for(Int depth = 0; (depth < config->if_depth); ++depth) {
+            corpus_write(&res, "#if defined(BENCH_FEATURE_%d)\n", depth);
+        }
+
+        Int member_count = random_between(&r, (config->members_per_struct + 1) / 2, config->members_per_struct * 3 / 2);
+        for(Int j = 0; (j < member_count); ++j) {
+            if(random_chance(&r, config->comment_percent)) {
+                write_corpus_comment(&res, &r, "    ");
+            }
+
+            Char type_buf[64] = {};
+            Int kind = random_between(&r, 0, 9);
+            if((kind == 0) && (i)) {
+                stbsp_snprintf(type_buf, sizeof(type_buf), "BenchStruct%d *", random_between(&r, 0, i - 1));
+            } else if((kind == 1) && (config->enum_count)) {
+                stbsp_snprintf(type_buf, sizeof(type_buf), "BenchEnum%d ", random_between(&r, 0, config->enum_count - 1));
+            } else if((kind == 2) && (config->macro_count > 1)) {
+                stbsp_snprintf(type_buf, sizeof(type_buf), "BENCH_TYPE_%d ", random_between(&r, 0, (config->macro_count - 1) / 2) * 2);
+            } else {
+                Char const *type = primitive_member_types[random_next(&r) % array_count(primitive_member_types)];
+                stbsp_snprintf(type_buf, sizeof(type_buf), "%s%s", type, (random_chance(&r, 20)) ? " *" : " ");
+            }
+
+            Char array_buf[32] = {};
+            if(random_chance(&r, 15)) {
+                if(config->macro_count > 1) {
+                    stbsp_snprintf(array_buf, sizeof(array_buf), "[BENCH_SIZE_%d]", random_between(&r, 0, (config->macro_count - 2) / 2) * 2 + 1);
+                } else {
+                    stbsp_snprintf(array_buf, sizeof(array_buf), "[%d]", random_between(&r, 2, 64));
+                }
+            }
+
+            corpus_write(&res, "    %smember%d%s;\n", type_buf, j, array_buf);
+        }
+
+        for(Int depth = 0; (depth < config->if_depth); ++depth) {
+            corpus_write(&res, "#endif\n");
+        }
+
+        corpus_write(&res, "};\n\n");
+    }
+
+    return(res);
+}
+
+//
+// Timing.
+//
+// Each stage runs a few times, and the fastest one is kept, because anything slower was just interrupted.
+enum BenchStage {
+    BenchStage_tokenize,
+    BenchStage_parse_stream,
+    BenchStage_write_data,
+
+    BenchStage_count,
+};
+
+internal Char const *bench_stage_names[BenchStage_count] = {"tokenize", "parse_stream", "write_data"};
+
+struct BenchResult {
+    Uint64 best; // In performance counts.
+    PtrSize output_size;
+};
+
+internal Uint64 per_second(Uint64 cnt, Uint64 counts) {
+    Uint64 res = (counts) ? cast(Uint64)((cast(Float64)cnt * cast(Float64)system_get_performance_frequency()) / cast(Float64)counts) : 0;
+
+    return(res);
+}
+
+internal Uint64 counts_to_microseconds(Uint64 counts) {
+    Uint64 res = cast(Uint64)((cast(Float64)counts * 1000000.0) / cast(Float64)system_get_performance_frequency());
+
+    return(res);
+}
+
+internal BenchResult run_bench_stage(BenchStage stage, CorpusBuffer *corpus, Int repeat_count, MemoryArena *arena) {
+    BenchResult res = {};
+    res.best = cast(Uint64)-1;
+
+    // write_data always works on the same parse, so only it is timed.
+    TempMemory parse_memory = begin_temp_memory(arena);
+    ParseResult pr = {};
+    if(stage == BenchStage_write_data) {
+        pr = ::parse_stream(corpus->e, corpus->len, arena);
+    }
+
+    for(Int i = 0; (i < repeat_count); ++i) {
+        TempMemory run_memory = begin_temp_memory(arena);
+        Uint64 start = 0, end = 0;
+
+        switch(stage) {
+            case BenchStage_tokenize: {
+                start = system_get_performance_counter();
+                TokenArray tokens = tokenize(corpus->e, corpus->len);
+                end = system_get_performance_counter();
+
+                free_token_array(&tokens);
+            } break;
+
+            case BenchStage_parse_stream: {
+                start = system_get_performance_counter();
+                ::parse_stream(corpus->e, corpus->len, arena);
+                end = system_get_performance_counter();
+            } break;
+
+            case BenchStage_write_data: {
+                start = system_get_performance_counter();
+                OutputBuffer ob = write_data("benchmark.cpp", pr.struct_data, pr.struct_cnt, pr.enum_data, pr.enum_cnt,
+                                             pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, arena);
+                end = system_get_performance_counter();
+
+                res.output_size = ob.total_size;
+            } break;
+
+            default: { assert(0); } break;
+        }
+
+        if(end - start < res.best) {
+            res.best = end - start;
+        }
+
+        end_temp_memory(run_memory);
+    }
+
+    end_temp_memory(parse_memory);
+
+    return(res);
+}
+
+internal Void print_help(void) {
+    system_write_to_console("    Preprocessor benchmark. Prints the results as JSON.\n"
+                            "        -r<N> - Run each stage N times, and keep the fastest. 5 by default.\n"
+                            "        -s<N> - Seed for the synthetic headers.\n"
+                            "        -c<name> - Only run the corpus called name.\n"
+                            "        -d - Write each synthetic header to <name>.cpp, so it can be run through the preprocessor.\n"
+                            "        -h - Print this help.\n"
+                            "\n");
+}
+
+Int main(Int argc, Char **argv) {
+    Int res = 0;
+
+    Int repeat_count = 5;
+    Uint64 seed = 0x5EA6177;
+    Char const *only_corpus = 0;
+    Bool should_dump = false;
+
+    for(Int i = 1; (i < argc); ++i) {
+        Char const *arg = argv[i];
+        ResultInt r = {};
+
+        if((arg[0] == '-') && (arg[1] == 'r')) {
+            r = string_to_int(cast(Char *)arg + 2);
+            if((r.success) && (r.e > 0)) { repeat_count = r.e; }
+            else                         { res = 1;            }
+        } else if((arg[0] == '-') && (arg[1] == 's')) {
+            r = string_to_int(cast(Char *)arg + 2);
+            if(r.success) { seed = cast(Uint64)r.e; }
+            else          { res = 1;                }
+        } else if((arg[0] == '-') && (arg[1] == 'c')) {
+            only_corpus = arg + 2;
+        } else if((arg[0] == '-') && (arg[1] == 'd')) {
+            should_dump = true;
+        } else {
+            res = 1;
+        }
+
+        if(res) {
+            system_write_to_console("Unknown argument %s\n", arg);
+            print_help();
+            break; // for
+        }
+    }
+
+    if(!res) {
+        MemoryArena arena = {};
+
+        system_write_to_console("{\n"
+                                "    \"version\": \"" preprocessor_version "\",\n"
+                                "    \"seed\": %llu,\n"
+                                "    \"repeat\": %d,\n"
+                                "    \"simd\": %s,\n"
+                                "    \"simd_level\": \"%s\",\n"
+                                "    \"results\": [\n",
+                                cast(unsigned long long)seed, repeat_count, (get_simd_level() != SimdLevel_none) ? "true" : "false",
+                                simd_level_to_string(get_simd_level()));
+
+        Bool first = true;
+        for(Int i = 0; (i < array_count(corpus_configs)); ++i) {
+            CorpusConfig *config = corpus_configs + i;
+            if((only_corpus) && (!string_compare(only_corpus, config->name))) {
+                continue; // for
+            }
+
+            CorpusBuffer corpus = generate_corpus(config, seed);
+            if(!corpus.e) {
+                push_error(ErrorType_ran_out_of_memory);
+                break; // for
+            }
+
+            if(should_dump) {
+                Char fname[256] = {};
+                stbsp_snprintf(fname, sizeof(fname), "%s.cpp", config->name);
+                if(!system_write_to_file(fname, corpus.e, corpus.len)) {
+                    push_error(ErrorType_could_not_write_to_disk);
+                }
+            }
+
+            for(Int stage = 0; (stage < BenchStage_count); ++stage) {
+                BenchResult r = run_bench_stage(cast(BenchStage)stage, &corpus, repeat_count, &arena);
+
+                system_write_to_console("%s        {\"corpus\": \"%s\", \"stage\": \"%s\", \"input_bytes\": %d, \"output_bytes\": %llu, "
+                                        "\"structs\": %d, \"best_us\": %llu, \"bytes_per_second\": %llu, \"mb_per_second\": %llu, "
+                                        "\"structs_per_second\": %llu}",
+                                        (first) ? "" : ",\n", config->name, bench_stage_names[stage], corpus.len,
+                                        cast(unsigned long long)r.output_size, config->struct_count,
+                                        cast(unsigned long long)counts_to_microseconds(r.best),
+                                        cast(unsigned long long)per_second(corpus.len, r.best),
+                                        cast(unsigned long long)(per_second(corpus.len, r.best) / (1024 * 1024)),
+                                        cast(unsigned long long)per_second(config->struct_count, r.best));
+                first = false;
+            }
+
+            system_free(corpus.e);
+        }
+
+        system_write_to_console("\n    ]\n"
+                                "}\n");
+
+        free_arena(&arena);
+        free_scratch_memory();
+
+        if(print_errors()) {
+            res = 255;
+        }
+    }
+
+    return(res);
+}
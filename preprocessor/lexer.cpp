@@ -12,12 +12,28 @@
 #include "lexer.h"
 #include "platform.h"
 
+#if SIMD_SSE2
+    #include <emmintrin.h>
+    #if SIMD_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
 struct MacroData {
     String iden;
     String res;
+    Uint64 hash;
+    Bool undefined; // By an #undef. The slot's kept, so nothing after it gets lost when probing.
+};
+
+// Open addressing with linear probing. Empty slots have an iden.len of 0, and max is always a power of two.
+struct MacroTable {
+    MacroData *e;
+    Int cnt;
+    Int max;
 };
-internal MacroData *macro_data = 0;
-internal Int macro_count = 0;
+
+#define max_macro_expansion_depth 32 // Stops self-referential macros (#define a b, #define b a) looping forever.
 
 enum TokenType {
     TokenType_unknown,
@@ -68,286 +84,628 @@ struct Token {
     TokenType type;
 };
 
-struct Tokenizer {
+// Walks the raw text. The stream does not have to be null-terminated (or writable), so never read past end.
+struct Lexer {
     Char const *at;
+    Char const *end;
+    SimdLevel simd_level; // Read once, rather than on every scan.
+};
+
+internal Lexer create_lexer(Char const *stream, PtrSize size) {
+    Lexer res = { stream, stream + size, get_simd_level() };
+
+    return(res);
+}
+
+// Every token in a file, lexed (and macro-expanded) once, up front, by tokenize. Struct of arrays, so walking the
+// types doesn't drag the offsets and lengths through the cache as well.
+struct TokenArray {
+    Uint8 *type; // TokenType
+    Int *offset; // From base, or -(index + 1) into external.
+    Int *len;
+    Int cnt;
+    Int max;
+
+    Char const *base;
+    Char const *end;
+
+    // Tokens which don't point into the stream, like -D macros' values. They can be anywhere in memory, so too far
+    // from base for an Int offset.
+    Char const **external;
+    Int external_cnt;
+    Int external_max;
+
+    Int macro_expansion_count;
+
+    IncludeDirective *includes;
+    Int include_cnt;
+    Int include_max;
+};
+
+// The parser just walks the tokens by index, so looking ahead is free.
+struct Tokenizer {
+    TokenArray *tokens;
+    Int index;
 };
 
-internal Bool is_end_of_line(Char c) {
-    Bool res = ((c == '\n') || (c == '\r'));
+internal Tokenizer create_tokenizer(TokenArray *tokens) {
+    Tokenizer res = { tokens, 0 };
 
     return(res);
 }
 
-internal Bool is_whitespace(Char c) {
-    Bool res = ((c == ' ') || (c == '\t') || (c == '\v') || (c == '\f') || (is_end_of_line(c)));
+// Returns 0 when reading past the end of the stream.
+internal Char peek_char(Lexer *lexer, Int offset = 0) {
+    Char res = (lexer->at + offset < lexer->end) ? lexer->at[offset] : 0;
 
     return(res);
 }
 
-internal Void skip_to_end_of_line(Tokenizer *tokenizer) {
-    while(is_end_of_line(*tokenizer->at)) {
-        ++tokenizer->at;
+internal Bool lexer_starts_with(Lexer *lexer, Char const *str, Int len) {
+    Bool res = false;
+    if(lexer->end - lexer->at >= len) {
+        res = string_compare(lexer->at, str, len);
     }
+
+    return(res);
 }
 
-internal String token_to_string(Token token) {
-    String res = { token.e, token.len };
+//
+// Character scanning.
+//
+enum CharClass {
+    CharClass_whitespace  = 0x01,
+    CharClass_end_of_line = 0x02,
+    CharClass_alpha       = 0x04,
+    CharClass_digit       = 0x08,
+    CharClass_identifier  = 0x10, // Alpha, digit, or underscore.
+};
+
+#define W (CharClass_whitespace)
+#define E (CharClass_end_of_line)
+#define A (CharClass_alpha)
+#define D (CharClass_digit)
+#define I (CharClass_identifier)
+internal Uint8 const global_char_class[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   W, W|E,   W,   W, W|E,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      W,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    D|I, D|I, D|I, D|I, D|I, D|I, D|I, D|I, D|I, D|I,   0,   0,   0,   0,   0,   0,
+      0, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I,
+    A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I,   0,   0,   0,   0,   I,
+      0, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I,
+    A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I, A|I,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+};
+#undef W
+#undef E
+#undef A
+#undef D
+#undef I
+
+internal Bool is_char_class(Char c, Uint8 char_class) {
+    Bool res = ((global_char_class[cast(Uint8)c] & char_class) != 0);
 
     return(res);
 }
 
-internal Void token_to_string(Token token, Char *buf, Int size) {
-    assert(size > token.len);
-    for(Int i = 0; (i < token.len); ++i, ++buf) {
-        *buf = token.e[i];
+internal Bool is_end_of_line(Char c) { return(is_char_class(c, CharClass_end_of_line)); }
+internal Bool is_whitespace(Char c)  { return(is_char_class(c, CharClass_whitespace));  }
+internal Bool is_alphabetical(Char c) { return(is_char_class(c, CharClass_alpha));     }
+internal Bool is_num(Char c)          { return(is_char_class(c, CharClass_digit));     }
+
+// The scanners below all return a pointer to the first character which _doesn't_ belong to the run (or end). The SIMD
+// versions test 16 (or 32) bytes at a time and use the scalar ones for the tail, so they never read past end. Which one
+// runs is down to the level passed in, which is normally the lexer's simd_level.
+internal Char const *skip_char_class_scalar(Char const *at, Char const *end, Uint8 char_class) {
+    while((at < end) && (is_char_class(*at, char_class))) {
+        ++at;
     }
 
-    *buf = 0;
+    return(at);
 }
 
-internal ResultInt token_to_int(Token t) {
-    String str = token_to_string(t);
-    ResultInt res = string_to_int(str);
+// Stops at a null too, because that's what end of stream used to look like.
+internal Char const *find_end_of_line_scalar(Char const *at, Char const *end) {
+    while((at < end) && (*at) && (!is_end_of_line(*at))) {
+        ++at;
+    }
+
+    return(at);
+}
+
+internal Char const *find_char_scalar(Char const *at, Char const *end, Char c) {
+    while((at < end) && (*at != c)) {
+        ++at;
+    }
+
+    return(at);
+}
+
+// Returns a pointer to the "*/", or end if the comment is never closed.
+internal Char const *find_end_of_block_comment_scalar(Char const *at, Char const *end) {
+    while((at < end) && (*at)) {
+        if((at[0] == '*') && (at + 1 < end) && (at[1] == '/')) {
+            break; // while
+        }
+
+        ++at;
+    }
+
+    if((at < end) && (!*at)) {
+        at = end;
+    }
+
+    return(at);
+}
+
+#if SIMD_SSE2
+internal __m128i sse2_in_range(__m128i c, Char lo, Char hi) {
+    __m128i res = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
 
     return(res);
 }
 
-internal Bool token_equals(Token token, Char const *str) {
-    Bool res = false;
+// Bit n is set if byte n is whitespace.
+internal Uint32 sse2_whitespace_mask(__m128i c) {
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), sse2_in_range(c, '\t', '\r'));
+    Uint32 res = cast(Uint32)_mm_movemask_epi8(ws);
 
-    Int len = string_length(str);
-    if(len == token.len) {
-        res = string_compare(token.e, str, len);
+    return(res);
+}
+
+internal Uint32 sse2_identifier_mask(__m128i c) {
+    // Or'ing in 0x20 lower-cases letters, without moving anything else into a-z.
+    __m128i alpha = sse2_in_range(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i iden = _mm_or_si128(_mm_or_si128(alpha, sse2_in_range(c, '0', '9')), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+    Uint32 res = cast(Uint32)_mm_movemask_epi8(iden);
+
+    return(res);
+}
+
+internal Uint32 sse2_digit_mask(__m128i c) {
+    Uint32 res = cast(Uint32)_mm_movemask_epi8(sse2_in_range(c, '0', '9'));
+
+    return(res);
+}
+
+typedef Uint32 Sse2MaskProc(__m128i c);
+
+// mask_proc sets a bit for every byte which is in the run.
+internal Char const *skip_run_sse2(Char const *at, Char const *end, Sse2MaskProc *mask_proc, Uint8 char_class) {
+    Char const *res = 0;
+    while((!res) && (end - at >= 16)) {
+        Uint32 mask = mask_proc(_mm_loadu_si128(cast(__m128i const *)at)) ^ 0xFFFF;
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 16;                            }
+    }
+
+    if(!res) {
+        res = skip_char_class_scalar(at, end, char_class);
     }
 
     return(res);
 }
 
-internal Token get_token(Tokenizer *tokenizer); // Because C/C++...
-internal Token peak_token(Tokenizer *tokenizer) {
-    Tokenizer cpy = *tokenizer;
-    Token res = get_token(&cpy);
+internal Uint32 sse2_end_of_line_mask(__m128i c) {
+    __m128i eol = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\r')));
+    Uint32 res = cast(Uint32)_mm_movemask_epi8(_mm_or_si128(eol, _mm_cmpeq_epi8(c, _mm_setzero_si128())));
 
     return(res);
 }
 
-internal Void loop_until_token(Tokenizer *tokenizer, TokenType type) {
-    Token token = get_token(tokenizer);
-    while(token.type != type) {
-        token = get_token(tokenizer);
+internal Char const *find_end_of_line_sse2(Char const *at, Char const *end) {
+    Char const *res = 0;
+    while((!res) && (end - at >= 16)) {
+        Uint32 mask = sse2_end_of_line_mask(_mm_loadu_si128(cast(__m128i const *)at));
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 16;                            }
+    }
+
+    if(!res) {
+        res = find_end_of_line_scalar(at, end);
     }
+
+    return(res);
 }
 
-internal Variable parse_member(Tokenizer *tokenizer, Int var_to_parse) {
-    Variable res = {};
-    res.array_count = 1;
+internal Char const *find_char_sse2(Char const *at, Char const *end, Char c) {
+    __m128i target = _mm_set1_epi8(c);
 
-    Token type = get_token(tokenizer);
-    if(token_equals(type, "std")) {
-        type.len = 1;
-        Char const *at = type.e;
-        while(*at != '>') {
-            ++type.len; ++at;
-            if(type.len == string_length("std::string")) {
-                String a = token_to_string(type);
-                String b = create_string("std::string");
-                if(string_compare(a, b)) {
-                    break;
-                }
-            }
-        }
+    Char const *res = 0;
+    while((!res) && (end - at >= 16)) {
+        Uint32 mask = cast(Uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(cast(__m128i const *)at), target));
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 16;                            }
+    }
+
+    if(!res) {
+        res = find_char_scalar(at, end, c);
     }
 
-    res.type = token_to_string(type);
+    return(res);
+}
 
-    if(var_to_parse) {
-        int cur = 0;
-        while(cur < var_to_parse) {
-            Token temp = get_token(tokenizer);
-            if(temp.type == TokenType_comma) {
-                ++cur;
+// Looks for the '/' of every "*/", and checks the byte before it (which may be in the previous block). Nulls end the
+// search, like the scalar version. start is where the comment started, so the byte before at can't be read before it.
+internal Char const *find_end_of_block_comment_sse2(Char const *at, Char const *end, Char const *start) {
+    Char const *res = 0;
+    while((!res) && (end - at >= 16)) {
+        __m128i c = _mm_loadu_si128(cast(__m128i const *)at);
+        Uint32 nulls = cast(Uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_setzero_si128()));
+        Uint32 slashes = cast(Uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')));
+
+        Uint32 mask = nulls | slashes;
+        while(mask) {
+            Int index = find_first_set_bit(mask);
+            if(nulls & (1u << index)) {
+                res = end;
+                break; // while
+            } else if((at + index > start) && (at[index - 1] == '*')) {
+                res = at + index - 1;
+                break; // while
             }
+
+            mask &= mask - 1;
         }
+
+        at += 16;
     }
 
-    Bool parsing = true;
-    while(parsing) {
-        Token token = get_token(tokenizer);
-        switch(token.type) {
-            case TokenType_semi_colon: case TokenType_comma: case TokenType_end_of_stream: {
-                parsing = false;
-            } break;
+    // Back up one for the tail, in case the '*' was the last byte of the final block.
+    if(!res) {
+        if(at > start) { --at; }
+        res = find_end_of_block_comment_scalar(at, end);
+    }
 
-            case TokenType_asterisk: {
-                ++res.ptr;
-            } break;
+    return(res);
+}
+#endif
 
-            case TokenType_identifier: {
-                res.name = token_to_string(token);
-            } break;
+#if SIMD_AVX2
+// Same as the SSE2 versions, but 32 bytes at a time. Most runs end within 16 bytes though, where AVX2's only overhead,
+// so they check one SSE2 block before starting. Whatever's left at the end is less than a block, so that's handed to
+// the SSE2 versions too, after _mm256_zeroupper.
+AVX2_FUNCTION internal __m256i avx2_in_range(__m256i c, Char lo, Char hi) {
+    __m256i res = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(lo - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), c));
 
-            case TokenType_open_bracket: {
-                Token size_token = get_token(tokenizer);
-                if(size_token.type == TokenType_number) {
-                    Char *buffer = cast(Char *)push_scratch_memory();
+    return(res);
+}
 
-                    token_to_string(size_token, buffer, scratch_memory_size);
-                    ResultInt arr_count = string_to_int(buffer);
-                    if(arr_count.success) res.array_count = arr_count.e;
-                    else                  push_error(ErrorType_failed_to_find_size_of_array);
+AVX2_FUNCTION internal Uint32 avx2_whitespace_mask(__m256i c) {
+    __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), avx2_in_range(c, '\t', '\r'));
+    Uint32 res = cast(Uint32)_mm256_movemask_epi8(ws);
 
-                    clear_scratch_memory();
-                }
-            } break;
+    return(res);
+}
 
-            default:
-                break;
-        }
+AVX2_FUNCTION internal Uint32 avx2_identifier_mask(__m256i c) {
+    __m256i alpha = avx2_in_range(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i iden = _mm256_or_si256(_mm256_or_si256(alpha, avx2_in_range(c, '0', '9')),
+                                   _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+    Uint32 res = cast(Uint32)_mm256_movemask_epi8(iden);
+
+    return(res);
+}
+
+AVX2_FUNCTION internal Uint32 avx2_digit_mask(__m256i c) {
+    Uint32 res = cast(Uint32)_mm256_movemask_epi8(avx2_in_range(c, '0', '9'));
+
+    return(res);
+}
+
+typedef Uint32 Avx2MaskProc(__m256i c);
+
+// sse2_mask_proc has to match avx2_mask_proc, for the first block and the tail.
+AVX2_FUNCTION internal Char const *skip_run_avx2(Char const *at, Char const *end, Avx2MaskProc *avx2_mask_proc,
+                                                 Sse2MaskProc *sse2_mask_proc, Uint8 char_class) {
+    Char const *res = 0;
+    if(end - at >= 16) {
+        Uint32 mask = sse2_mask_proc(_mm_loadu_si128(cast(__m128i const *)at)) ^ 0xFFFF;
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 16;                            }
+    }
+
+    while((!res) && (end - at >= 32)) {
+        Uint32 mask = ~avx2_mask_proc(_mm256_loadu_si256(cast(__m256i const *)at));
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 32;                            }
+    }
+
+    _mm256_zeroupper();
+
+    if(!res) {
+        res = skip_run_sse2(at, end, sse2_mask_proc, char_class);
     }
 
     return(res);
 }
 
-internal Void eat_whitespace(Tokenizer *tokenizer) {
-    for(;;) {
-        if(!tokenizer->at[0]) { // Nul terminator.
-            break;
-        } else if(is_whitespace(tokenizer->at[0])) { // Whitespace
-            ++tokenizer->at;
-        } else if((tokenizer->at[0] == '/') && (tokenizer->at[1] == '/')) { // C++ comments.
-            tokenizer->at += 2;
-            while((tokenizer->at[0]) && (!is_end_of_line(tokenizer->at[0]))) ++tokenizer->at;
-        } else if((tokenizer->at[0] == '/') && (tokenizer->at[1] == '*')) { // C comments.
-            tokenizer->at += 2;
-            while((tokenizer->at[0]) && !((tokenizer->at[0] == '*') && (tokenizer->at[1] == '/'))) ++tokenizer->at;
-
-            if(tokenizer->at[0] == '*') { tokenizer->at += 2; }
-        } else if(tokenizer->at[0] == '#') { // #if 0 blocks.
-            Char const *hash_if_zero = "#if 0";
-            Int hash_if_zero_length = string_length(hash_if_zero);
-
-            Char const *hash_if_one = "#if 1";
-            Int hash_if_one_length = string_length(hash_if_one);
-
-            if(string_compare(tokenizer->at, hash_if_zero, hash_if_zero_length)) {
-                tokenizer->at += hash_if_zero_length;
-
-                Char const *hash_end_if = "#endif";
-                Int hash_end_if_length = string_length(hash_end_if);
-
-                Int level = 0;
-                while(++tokenizer->at) {
-                    if(tokenizer->at[0] == '#') {
-                        if((tokenizer->at[1] == 'i') && (tokenizer->at[2] == 'f')) {
-                            ++level;
-
-                        } else if(string_compare(tokenizer->at, hash_end_if, hash_end_if_length)) {
-                            if(level) {
-                                --level;
-                            } else {
-                                tokenizer->at += hash_end_if_length;
-                                eat_whitespace(tokenizer);
-
-                                break; // for
-                            }
-                        }
-                    }
-                }
-            } else if(string_compare(tokenizer->at, hash_if_one, hash_if_one_length)) { // #if 1 #else blocks.
-                tokenizer->at += hash_if_zero_length;
-
-                Char const *hash_else = "#else";
-                Int hash_else_length = string_length(hash_else);
-
-                Char const *hash_end_if = "#endif";
-                Int hash_end_if_length = string_length(hash_end_if);
-
-                Int level = 0;
-                while(++tokenizer->at) {
-                    if(tokenizer->at[0] == '#') {
-                        if((tokenizer->at[1] == 'i') && (tokenizer->at[2] == 'f')) {
-                            ++level;
-                        } else if(string_compare(tokenizer->at, hash_end_if, hash_end_if_length)) {
-                            if(level != 0) {
-                                --level;
-                            } else {
-                                tokenizer->at += hash_end_if_length;
-                                break; // for
-                            }
-                        } else if(string_compare(tokenizer->at, hash_else, hash_else_length)) {
-                            if(level == 0) {
-                                tokenizer->at += hash_else_length;
-                                Int Level2 = 0;
-
-                                while(++tokenizer->at) {
-                                    if(tokenizer->at[0] == '#') {
-                                        if((tokenizer->at[1] == 'i') && (tokenizer->at[2] == 'f')) {
-                                            ++Level2;
-
-                                        } else if(string_compare(tokenizer->at, hash_end_if, hash_end_if_length)) {
-                                            if(Level2 != 0) {
-                                                --Level2;
-                                            } else {
-                                                tokenizer->at += hash_end_if_length;
-                                                eat_whitespace(tokenizer);
-
-                                                break; // for
-                                            }
-                                        }
-                                    }
-
-                                    Char *at = (Char *)tokenizer->at;
-                                    *at = ' ';
-                                }
-
-                                break; // for
-                            }
-                        }
-                    }
-                }
+AVX2_FUNCTION internal Char const *find_end_of_line_avx2(Char const *at, Char const *end) {
+    Char const *res = 0;
+    if(end - at >= 16) {
+        Uint32 mask = sse2_end_of_line_mask(_mm_loadu_si128(cast(__m128i const *)at));
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 16;                            }
+    }
+
+    while((!res) && (end - at >= 32)) {
+        __m256i c = _mm256_loadu_si256(cast(__m256i const *)at);
+        __m256i eol = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')),
+                                      _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r')));
+        eol = _mm256_or_si256(eol, _mm256_cmpeq_epi8(c, _mm256_setzero_si256()));
+        Uint32 mask = cast(Uint32)_mm256_movemask_epi8(eol);
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 32;                            }
+    }
+
+    _mm256_zeroupper();
+
+    if(!res) {
+        res = find_end_of_line_sse2(at, end);
+    }
+
+    return(res);
+}
+
+AVX2_FUNCTION internal Char const *find_char_avx2(Char const *at, Char const *end, Char c) {
+    __m256i target = _mm256_set1_epi8(c);
+
+    Char const *res = 0;
+    while((!res) && (end - at >= 32)) {
+        __m256i block = _mm256_loadu_si256(cast(__m256i const *)at);
+        Uint32 mask = cast(Uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, target));
+        if(mask) { res = at + find_first_set_bit(mask); }
+        else     { at += 32;                            }
+    }
+
+    _mm256_zeroupper();
+
+    if(!res) {
+        res = find_char_sse2(at, end, c);
+    }
+
+    return(res);
+}
+
+AVX2_FUNCTION internal Char const *find_end_of_block_comment_avx2(Char const *at, Char const *end) {
+    Char const *start = at;
+
+    Char const *res = 0;
+    while((!res) && (end - at >= 32)) {
+        __m256i c = _mm256_loadu_si256(cast(__m256i const *)at);
+        Uint32 nulls = cast(Uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_setzero_si256()));
+        Uint32 slashes = cast(Uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/')));
+
+        Uint32 mask = nulls | slashes;
+        while(mask) {
+            Int index = find_first_set_bit(mask);
+            if(nulls & (1u << index)) {
+                res = end;
+                break; // while
+            } else if((at + index > start) && (at[index - 1] == '*')) {
+                res = at + index - 1;
+                break; // while
             }
 
-            break; // for
-        } else {
-            break; // for
+            mask &= mask - 1;
         }
+
+        at += 32;
+    }
+
+    _mm256_zeroupper();
+
+    if(!res) {
+        res = find_end_of_block_comment_sse2(at, end, start);
+    }
+
+    return(res);
+}
+#endif
+
+internal Char const *skip_whitespace(Char const *at, Char const *end, SimdLevel level) {
+    Char const *res = 0;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: {
+            res = skip_run_avx2(at, end, avx2_whitespace_mask, sse2_whitespace_mask, CharClass_whitespace);
+        } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: {
+            res = skip_run_sse2(at, end, sse2_whitespace_mask, CharClass_whitespace);
+        } break;
+#endif
+        default: {
+            res = skip_char_class_scalar(at, end, CharClass_whitespace);
+        } break;
+    }
+
+    return(res);
+}
+
+internal Char const *skip_identifier(Char const *at, Char const *end, SimdLevel level) {
+    Char const *res = 0;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: {
+            res = skip_run_avx2(at, end, avx2_identifier_mask, sse2_identifier_mask, CharClass_identifier);
+        } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: {
+            res = skip_run_sse2(at, end, sse2_identifier_mask, CharClass_identifier);
+        } break;
+#endif
+        default: {
+            res = skip_char_class_scalar(at, end, CharClass_identifier);
+        } break;
     }
+
+    return(res);
 }
 
-internal Bool is_alphabetical(Char c) {
-    Bool res = (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')));
+internal Char const *skip_digits(Char const *at, Char const *end, SimdLevel level) {
+    Char const *res = 0;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: {
+            res = skip_run_avx2(at, end, avx2_digit_mask, sse2_digit_mask, CharClass_digit);
+        } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: {
+            res = skip_run_sse2(at, end, sse2_digit_mask, CharClass_digit);
+        } break;
+#endif
+        default: {
+            res = skip_char_class_scalar(at, end, CharClass_digit);
+        } break;
+    }
 
     return(res);
 }
 
-internal Bool is_num(Char c) {
-    Bool res = ((c >= '0') && (c <= '9'));
+internal Char const *find_end_of_line(Char const *at, Char const *end, SimdLevel level) {
+    Char const *res = 0;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: { res = find_end_of_line_avx2(at, end);   } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: { res = find_end_of_line_sse2(at, end);   } break;
+#endif
+        default:             { res = find_end_of_line_scalar(at, end); } break;
+    }
 
     return(res);
 }
 
-#define eat_token(tokenizer) eat_tokens(tokenizer, 1)
-internal Void eat_tokens(Tokenizer *tokenizer, Int num_tokens_to_eat) {
-    for(Int i = 0; (i < num_tokens_to_eat); ++i) {
-        get_token(tokenizer);
+// Returns end if there isn't one.
+internal Char const *find_char(Char const *at, Char const *end, Char c, SimdLevel level) {
+    Char const *res = 0;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: { res = find_char_avx2(at, end, c);   } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: { res = find_char_sse2(at, end, c);   } break;
+#endif
+        default:             { res = find_char_scalar(at, end, c); } break;
     }
+
+    return(res);
 }
 
-internal Bool require_token(Tokenizer *tokenizer, TokenType desired_type) {
-    Token token = get_token(tokenizer);
-    Bool res = (token.type == desired_type);
+internal Char const *find_end_of_block_comment(Char const *at, Char const *end, SimdLevel level) {
+    Char const *res = 0;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: { res = find_end_of_block_comment_avx2(at, end);     } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: { res = find_end_of_block_comment_sse2(at, end, at); } break;
+#endif
+        default:             { res = find_end_of_block_comment_scalar(at, end);   } break;
+    }
+
+    return(res);
+}
+
+internal Void skip_to_end_of_line(Lexer *lexer) {
+    lexer->at = find_end_of_line(lexer->at, lexer->end, lexer->simd_level);
+}
+
+internal String token_to_string(Token token) {
+    String res = { token.e, token.len };
+
+    return(res);
+}
+
+internal ResultInt token_to_int(Token t) {
+    String str = token_to_string(t);
+    ResultInt res = string_to_int(str);
 
     return(res);
 }
 
-internal Bool peak_require_token(Tokenizer *tokenizer, Char const *str) {
+internal Bool token_equals(Token token, Char const *str) {
     Bool res = false;
-    Tokenizer cpy = *tokenizer;
-    Token token = get_token(&cpy);
 
-    if(string_compare(token.e, str, token.len)) {
-        res = true;
+    Int len = string_length(str);
+    if(len == token.len) {
+        res = string_compare(token.e, str, len);
+    }
+
+    return(res);
+}
+
+internal Token peak_token(Tokenizer *tokenizer, Int offset = 0) {
+    TokenArray *tokens = tokenizer->tokens;
+    Int index = tokenizer->index + offset;
+
+    Token res = {};
+    if(index < tokens->cnt) {
+        Int token_offset = tokens->offset[index];
+        res.e = (token_offset >= 0) ? tokens->base + token_offset : tokens->external[-token_offset - 1];
+        res.len = tokens->len[index];
+        res.type = cast(TokenType)tokens->type[index];
+    } else {
+        res.e = tokens->end;
+        res.type = TokenType_end_of_stream;
+    }
+
+    return(res);
+}
+
+internal Token get_token(Tokenizer *tokenizer) {
+    Token res = peak_token(tokenizer);
+    if(tokenizer->index < tokenizer->tokens->cnt) {
+        ++tokenizer->index;
+    }
+
+    return(res);
+}
+
+internal Void eat_whitespace(Lexer *lexer) {
+    for(;;) {
+        Char c = peek_char(lexer);
+        if(!c) { // End of stream.
+            break;
+        } else if(is_whitespace(c)) { // Whitespace
+            lexer->at = skip_whitespace(lexer->at, lexer->end, lexer->simd_level);
+        } else if((c == '/') && (peek_char(lexer, 1) == '/')) { // C++ comments.
+            lexer->at = find_end_of_line(lexer->at + 2, lexer->end, lexer->simd_level);
+        } else if((c == '/') && (peek_char(lexer, 1) == '*')) { // C comments.
+            lexer->at = find_end_of_block_comment(lexer->at + 2, lexer->end, lexer->simd_level);
+
+            if(peek_char(lexer) == '*') { lexer->at += 2; }
+        } else {
+            break; // for
+        }
+    }
+}
+
+#define eat_token(tokenizer) eat_tokens(tokenizer, 1)
+internal Void eat_tokens(Tokenizer *tokenizer, Int num_tokens_to_eat) {
+    tokenizer->index += num_tokens_to_eat;
+    if(tokenizer->index > tokenizer->tokens->cnt) {
+        tokenizer->index = tokenizer->tokens->cnt;
     }
+}
+
+internal Bool require_token(Tokenizer *tokenizer, TokenType desired_type) {
+    Token token = get_token(tokenizer);
+    Bool res = (token.type == desired_type);
 
     return(res);
 }
@@ -356,7 +714,7 @@ internal Bool is_cpp_access_keyword(Token t) {
     Bool res = false;
     Char const *keywords[] = { "private", "public", "protected" };
     for(Int i = 0, cnt = array_count(keywords); (i < cnt); ++i) {
-        if(string_compare(keywords[i], t.e, t.len)) {
+        if(token_equals(t, keywords[i])) {
             res = true;
             goto func_exit;
         }
@@ -384,6 +742,10 @@ internal Void skip_to_matching_bracket(Tokenizer *tokenizer) {
                     should_loop = false;
                 }
             } break;
+
+            case TokenType_end_of_stream: {
+                should_loop = false;
+            } break;
         }
     }
 }
@@ -406,28 +768,146 @@ internal Void parse_template(Tokenizer *tokenizer) {
                     should_loop = false;
                 }
             } break;
+
+            case TokenType_end_of_stream: {
+                should_loop = false;
+            } break;
         }
     }
 }
 
-struct ParseStructResult {
-    StructData sd;
-    Bool success;
-};
-struct MemberInfo {
-    Char const *pos;
-    Access access;
-    Bool is_inside_anonymous_struct;
-};
-internal ParseStructResult parse_struct(Tokenizer *tokenizer, StructType struct_type) {
-    ParseStructResult res = {};
+// Skips a function's declaration, or definition, from just after its opening paren.
+internal Void skip_function(Tokenizer *tokenizer) {
+    Int brace_count = 0;
+    for(;;) {
+        Token token = get_token(tokenizer);
+        if((token.type == TokenType_end_of_stream) || ((token.type == TokenType_semi_colon) && (!brace_count))) {
+            break; // for
+        } else if(token.type == TokenType_open_brace) {
+            ++brace_count;
+        } else if(token.type == TokenType_close_brace) {
+            --brace_count;
+            if(brace_count <= 0) {
+                break; // for
+            }
+        }
+    }
+}
 
-    Tokenizer start = *tokenizer;
+internal Void push_member(StructData *sd, Int *members_max, Variable var, MemoryArena *arena) {
+    if(sd->member_count >= *members_max) {
+        Int new_max = (*members_max) ? *members_max * 2 : 8;
+        Void *p = resize_arena_memory(arena, sd->members, sizeof(Variable) * *members_max, sizeof(Variable) * new_max);
+        if(p) {
+            sd->members = cast(Variable *)p;
+            *members_max = new_max;
+        }
+    }
 
-    Access current_access = ((struct_type == StructType_struct) || (struct_type == StructType_union)) ? Access_public : Access_private;
-    res.sd.struct_type = struct_type;
+    if(sd->member_count < *members_max) {
+        sd->members[sd->member_count++] = var;
+    }
+}
 
-    Bool have_name = false;
+// Parses a member declaration (int a, *b, c[4];), from just after the type, and adds a Variable for each declarator.
+// If it turns out to be a function it's skipped instead.
+internal Void parse_member_declaration(Tokenizer *tokenizer, Token type, StructData *sd, Int *members_max,
+                                       Access access, Int anonymous_depth, Int anonymous_opened, Uint8 anonymous_unions,
+                                       MemoryArena *arena) {
+    // std:: types are made up of lots of tokens, so use everything up to the closing > as the type.
+    if(token_equals(type, "std")) {
+        Token last = type;
+        while((peak_token(tokenizer).type == TokenType_colon) && (peak_token(tokenizer, 1).type == TokenType_colon) &&
+              (peak_token(tokenizer, 2).type == TokenType_identifier)) {
+            eat_tokens(tokenizer, 2);
+            last = get_token(tokenizer);
+        }
+
+        if(peak_token(tokenizer).type == TokenType_open_angle_bracket) {
+            Int angle_bracket_count = 0;
+            do {
+                last = get_token(tokenizer);
+                if(last.type == TokenType_open_angle_bracket)       { ++angle_bracket_count; }
+                else if(last.type == TokenType_close_angle_bracket) { --angle_bracket_count; }
+            } while((angle_bracket_count > 0) && (last.type != TokenType_end_of_stream));
+        }
+
+        if(last.type != TokenType_end_of_stream) {
+            type.len = safe_truncate_size_64((last.e + last.len) - type.e);
+        }
+    }
+
+    Variable var = {};
+    var.type = token_to_string(type);
+    var.access = access;
+    var.array_count = 1;
+    var.anonymous_depth = anonymous_depth;
+    var.anonymous_opened = anonymous_opened;
+    var.anonymous_unions = anonymous_unions;
+
+    Int first_member = sd->member_count;
+    Variable cur = var;
+    Int depth = 0; // Inside template arguments, or an initializer's brackets.
+    Bool inside_initializer = false;
+    for(;;) {
+        Token token = get_token(tokenizer);
+        if(token.type == TokenType_end_of_stream) {
+            break; // for
+        } else if(token.type == TokenType_semi_colon) {
+            push_member(sd, members_max, cur, arena);
+            break; // for
+        } else if((token.type == TokenType_comma) && (!depth)) {
+            push_member(sd, members_max, cur, arena);
+            var.anonymous_opened = 0; // Only the first one opens them.
+            cur = var;
+            inside_initializer = false;
+        } else if((token.type == TokenType_open_paren) && (!depth) && (!inside_initializer)) {
+            // A function, so throw away anything we added, and skip it.
+            sd->member_count = first_member;
+            skip_function(tokenizer);
+            break; // for
+        } else if((token.type == TokenType_close_brace) && (!depth)) {
+            // Missing semi colon. Leave the brace for parse_struct.
+            --tokenizer->index;
+            break; // for
+        } else if((token.type == TokenType_open_angle_bracket) || (token.type == TokenType_open_paren) ||
+                  (token.type == TokenType_open_brace)) {
+            ++depth;
+        } else if((token.type == TokenType_close_angle_bracket) || (token.type == TokenType_close_paren) ||
+                  (token.type == TokenType_close_brace)) {
+            if(depth) {
+                --depth;
+            }
+        } else if((!depth) && (!inside_initializer)) {
+            if(token.type == TokenType_assign) {
+                inside_initializer = true;
+            } else if(token.type == TokenType_asterisk) {
+                ++cur.ptr;
+            } else if(token.type == TokenType_identifier) {
+                cur.name = token_to_string(token);
+            } else if(token.type == TokenType_open_bracket) {
+                Token size_token = get_token(tokenizer);
+                if(size_token.type == TokenType_number) {
+                    ResultInt arr_count = token_to_int(size_token);
+                    if(arr_count.success) cur.array_count = arr_count.e;
+                    else                  push_error(ErrorType_failed_to_find_size_of_array);
+                }
+            }
+        }
+    }
+}
+
+struct ParseStructResult {
+    StructData sd;
+    Bool success;
+};
+internal ParseStructResult parse_struct(Tokenizer *tokenizer, StructType struct_type, MemoryArena *arena) {
+    ParseStructResult res = {};
+
+    Access current_access = ((struct_type == StructType_struct) || (struct_type == StructType_union)) ? Access_public : Access_private;
+    res.sd.struct_type = struct_type;
+
+    Bool have_name = false;
     Token name = peak_token(tokenizer);
     if(name.type == TokenType_identifier) {
         have_name = true;
@@ -437,14 +917,26 @@ internal ParseStructResult parse_struct(Tokenizer *tokenizer, StructType struct_
 
     Token peaked_token = peak_token(tokenizer);
     if(peaked_token.type == TokenType_colon) {
-        res.sd.inherited = system_alloc(String, 8);
+        Int inherited_max = 0;
 
         eat_token(tokenizer);
 
         Token next = get_token(tokenizer);
-        while(next.type != TokenType_open_brace) {
+        while((next.type != TokenType_open_brace) && (next.type != TokenType_end_of_stream)) {
             if(!(is_cpp_access_keyword(next)) && (next.type != TokenType_comma)) {
-                res.sd.inherited[res.sd.inherited_count++] = token_to_string(next);
+                if(res.sd.inherited_count >= inherited_max) {
+                    Int new_max = (inherited_max) ? inherited_max * 2 : 4;
+                    Void *p = resize_arena_memory(arena, res.sd.inherited, sizeof(String) * inherited_max,
+                                                  sizeof(String) * new_max);
+                    if(p) {
+                        res.sd.inherited = cast(String *)p;
+                        inherited_max = new_max;
+                    }
+                }
+
+                if(res.sd.inherited_count < inherited_max) {
+                    res.sd.inherited[res.sd.inherited_count++] = token_to_string(next);
+                }
             }
 
             next = peak_token(tokenizer);
@@ -455,149 +947,84 @@ internal ParseStructResult parse_struct(Tokenizer *tokenizer, StructType struct_
     if(require_token(tokenizer, TokenType_open_brace)) {
         res.success = true;
 
-        res.sd.member_count = 0;
-        Int member_cnt = 0;
-
-        PtrSize member_info_mem_cnt = 256;
-        MemberInfo *member_info = system_alloc(MemberInfo, member_info_mem_cnt);
-        if(member_info) {
-            Bool inside_anonymous_struct = false;
-            for(;;) {
-                Token token = get_token(tokenizer);
-                if(is_cpp_access_keyword(token)) {
-                    String access_as_string = token_to_string(token);
-                    if(string_compare(access_as_string, create_string("public"))) {
-                        current_access = Access_public;
-                    } else if(string_compare(access_as_string, create_string("private"))) {
-                        current_access = Access_private;
-                    } else if(string_compare(access_as_string, create_string("protected"))) {
-                        current_access = Access_protected;
+        Int members_max = 0;
+        // The anonymous structs and unions the next member's inside. See Variable.
+        Int anonymous_depth = 0;
+        Int anonymous_opened = 0;
+        Uint8 anonymous_unions = 0;
+        for(;;) {
+            Token token = get_token(tokenizer);
+            if(token.type == TokenType_end_of_stream) {
+                res.success = false;
+                break; // for
+            } else if(is_cpp_access_keyword(token)) {
+                if(token_equals(token, "public"))         { current_access = Access_public;    }
+                else if(token_equals(token, "private"))   { current_access = Access_private;   }
+                else if(token_equals(token, "protected")) { current_access = Access_protected; }
+            } else if((token.type == TokenType_colon) || (token.type == TokenType_tilde) || (token.type == TokenType_semi_colon)) {
+                // Skip.
+            } else if(token.type == TokenType_close_brace) {
+                if(anonymous_depth) {
+                    // One with nothing declared in it is dropped, so the next member doesn't open it.
+                    --anonymous_depth;
+                    if(anonymous_opened) { --anonymous_opened; }
+
+                    if(peak_token(tokenizer).type == TokenType_semi_colon) {
+                        eat_token(tokenizer);
                     }
                 } else {
-                    // This could be the end of an anonymous struct, so ignore it.
-                    if(token_equals(token, "struct")) {
-                        eat_token(tokenizer); // Eat the open brace.
-                        token = get_token(tokenizer);
-                        inside_anonymous_struct = true;
+                    if(!have_name) {
+                        name = get_token(tokenizer);
+                        if(name.type == TokenType_identifier) res.sd.name = token_to_string(name);
+                        else                                  push_error(ErrorType_could_not_detect_struct_name);
                     }
 
-                    if((token.type != TokenType_colon) && (token.type != TokenType_tilde)) {
-                        if(token.type == TokenType_close_brace) {
-                            if(inside_anonymous_struct) {
-                                inside_anonymous_struct = false;
-                                eat_token(tokenizer); // Eat semi colon.
-                                continue;
-                            } else if(!have_name) {
-                                name = get_token(tokenizer);
-                                if(name.type == TokenType_identifier) res.sd.name = token_to_string(name);
-                                else                                  push_error(ErrorType_could_not_detect_struct_name);
-                            }
-
-                            break; // for
-                        } else if(token.type == TokenType_hash) {
-                            // TODO(Jonny): Support macros with '/' to extend their lines?
-                            while(!is_end_of_line(tokenizer->at[0])) {
-                                ++tokenizer->at;
-                            }
-                        } else {
-                            Bool is_func = false;
-
-                            Tokenizer tokenizer_copy = *tokenizer;
-                            Token temp = get_token(&tokenizer_copy);
-                            while(temp.type != TokenType_semi_colon) {
-
-                                // C++11 assignment within struct.
-                                if(temp.type == TokenType_assign) {
-                                    loop_until_token(&tokenizer_copy, TokenType_semi_colon);
-
-                                    break;
-                                }
-
-                                // Is a function.
-                                if(temp.type == TokenType_open_paren) {
-                                    is_func = true;
-                                    break; // while
-                                }
-
-                                temp = get_token(&tokenizer_copy);
-                            }
-
-                            if(!is_func) {
-                                if(member_cnt >= member_info_mem_cnt) {
-                                    member_info_mem_cnt *= 2;
-                                    Void *p = system_realloc(member_info, sizeof(MemberInfo) * member_info_mem_cnt);
-                                    if(p) {
-                                        member_info = cast(MemberInfo *)p;
-                                    }
-                                }
-
-                                MemberInfo *mi = member_info + member_cnt++;
-
-                                mi->pos = token.e;
-                                mi->is_inside_anonymous_struct = inside_anonymous_struct;
-                                mi->access = current_access;
-                            } else {
-                                // Skip to the end of the function.
-                                Bool eating_func = true;
-                                Bool inside_body = false;
-                                while(eating_func) {
-                                    Token t = get_token(&tokenizer_copy);
-                                    if((t.type == TokenType_semi_colon) && (!inside_body)) {
-                                        break;
-                                    } else if(t.type == TokenType_open_brace) {
-                                        inside_body = true;
-                                    } else if((t.type == TokenType_close_brace) && (inside_body)) {
-                                        break;
-                                    }
-                                }
-                            }
-
-                            *tokenizer = tokenizer_copy;
-                        }
-                    }
+                    break; // for
+                }
+            } else if(((token_equals(token, "struct")) || (token_equals(token, "union"))) &&
+                      (peak_token(tokenizer).type == TokenType_open_brace)) {
+                eat_token(tokenizer);
+                if(anonymous_depth < max_anonymous_depth) {
+                    Uint8 bit = cast(Uint8)(1 << anonymous_depth);
+                    if(token_equals(token, "union")) { anonymous_unions |= bit;  }
+                    else                             { anonymous_unions &= ~bit; }
+
+                    ++anonymous_depth;
+                    ++anonymous_opened;
+                } else {
+                    // Too deep to record, so skip it like a nested struct.
+                    skip_to_matching_bracket(tokenizer);
+                }
+            } else if(((token_equals(token, "struct")) || (token_equals(token, "union"))) &&
+                      (peak_token(tokenizer, 1).type == TokenType_open_brace)) {
+                // A nested struct, which isn't supported yet. So skip it, and anything declared with it.
+                eat_tokens(tokenizer, 2);
+                skip_to_matching_bracket(tokenizer);
+                while((peak_token(tokenizer).type != TokenType_semi_colon) && (peak_token(tokenizer).type != TokenType_end_of_stream)) {
+                    eat_token(tokenizer);
+                }
+            } else {
+                // Something like "struct Foo *foo;" just uses Foo as the type.
+                if((token_equals(token, "struct")) || (token_equals(token, "union"))) {
+                    token = get_token(tokenizer);
                 }
-            }
-
-            // Actually parse the members now.
-            if(member_cnt > 0) {
-                res.sd.members = system_alloc(Variable, member_cnt * 2);
-                if(res.sd.members) {
-                    Int member_index = 0;
-                    for(Int i = 0; (i < member_cnt); ++i) {
-                        // Count the number of variables
-                        Int var_cnt = 1;
-                        Char const *at = member_info[i].pos;
-                        while(*at != ';') {
-                            if(*at == ',') {
-                                ++var_cnt;
-                            }
-
-                            ++at;
-                        }
-
-                        for(Int j = 0; (j < var_cnt); ++j) {
-                            Tokenizer fake_tokenizer = { member_info[i].pos };
-                            res.sd.members[member_index] = parse_member(&fake_tokenizer, j);
-                            res.sd.members[member_index].is_inside_anonymous_struct = member_info[i].is_inside_anonymous_struct;
-                            res.sd.members[member_index].access = member_info[i].access;
-                            ++member_index;
-                        }
-                    }
 
-                    res.sd.member_count = member_index;
+                Int member_count = res.sd.member_count;
+                parse_member_declaration(tokenizer, token, &res.sd, &members_max, current_access, anonymous_depth,
+                                         anonymous_opened, anonymous_unions, arena);
+                if(res.sd.member_count != member_count) {
+                    anonymous_opened = 0;
                 }
             }
+        }
 
-            system_free(member_info);
+        if(!res.success) {
+            // The memory's just left in the arena until it's cleared.
+            res.sd.members = 0;
+            res.sd.member_count = 0;
         }
     }
 
-    // Set the tokenizer to the end of the struct.
-    eat_tokens(&start, 2);
-    eat_tokens(&start, 3 * res.sd.inherited_count);
-    skip_to_matching_bracket(&start);
-    *tokenizer = start;
-
     return(res);
 }
 
@@ -605,7 +1032,7 @@ struct ParseEnumResult {
     EnumData ed;
     Bool success;
 };
-internal ParseEnumResult parse_enum(Tokenizer *tokenizer) {
+internal ParseEnumResult parse_enum(Tokenizer *tokenizer, MemoryArena *arena) {
     ParseEnumResult res = {};
 
     Token name = get_token(tokenizer);
@@ -642,7 +1069,7 @@ internal ParseEnumResult parse_enum(Tokenizer *tokenizer) {
             Tokenizer copy = *tokenizer;
             res.ed.no_of_values = 1;
             token = get_token(&copy);
-            while(token.type != TokenType_close_brace) {
+            while((token.type != TokenType_close_brace) && (token.type != TokenType_end_of_stream)) {
                 if(token.type == TokenType_comma) {
                     Token tmp = get_token(&copy);
                     if(tmp.type == TokenType_identifier)       { ++res.ed.no_of_values; }
@@ -652,13 +1079,15 @@ internal ParseEnumResult parse_enum(Tokenizer *tokenizer) {
                 token = get_token(&copy);
             }
 
-            res.ed.values = system_alloc(EnumValue, res.ed.no_of_values);
+            res.ed.values = push_arena(arena, EnumValue, res.ed.no_of_values);
             if(res.ed.values) {
                 for(Int i = 0, count = 0; (i < res.ed.no_of_values); ++i, ++count) {
                     EnumValue *ev = res.ed.values + i;
 
                     Token temp_token = {};
-                    while(temp_token.type != TokenType_identifier) { temp_token = get_token(tokenizer); }
+                    while((temp_token.type != TokenType_identifier) && (temp_token.type != TokenType_end_of_stream)) {
+                        temp_token = get_token(tokenizer);
+                    }
 
                     ev->name = token_to_string(temp_token);
                     if(peak_token(tokenizer).type == TokenType_assign) {
@@ -748,14 +1177,98 @@ internal Token string_to_token(String str) {
     return(res);
 }
 
-internal Token get_token(Tokenizer *tokenizer) {
-    eat_whitespace(tokenizer);
+//
+// Macros.
+//
+internal MacroData *find_macro_slot(MacroTable *macros, String iden, Uint64 hash) {
+    Int mask = macros->max - 1;
+    Int index = cast(Int)(hash & mask);
+
+    MacroData *res = macros->e + index;
+    while((res->iden.len) && ((res->hash != hash) || (!string_compare(res->iden, iden)))) {
+        index = (index + 1) & mask;
+        res = macros->e + index;
+    }
+
+    return(res);
+}
+
+internal MacroData *find_macro(MacroTable *macros, String iden) {
+    MacroData *res = 0;
+
+    if(macros->cnt) {
+        MacroData *slot = find_macro_slot(macros, iden, hash_bytes(iden.e, iden.len));
+        if((slot->iden.len) && (!slot->undefined)) {
+            res = slot;
+        }
+    }
+
+    return(res);
+}
+
+internal Bool grow_macro_table(MacroTable *macros) {
+    Bool res = false;
+
+    MacroTable new_table = {};
+    new_table.max = (macros->max) ? macros->max * 2 : 64;
+    new_table.e = system_alloc(MacroData, new_table.max);
+    if(new_table.e) {
+        for(Int i = 0; (i < macros->max); ++i) {
+            MacroData *md = macros->e + i;
+            if(md->iden.len) {
+                *find_macro_slot(&new_table, md->iden, md->hash) = *md;
+                ++new_table.cnt;
+            }
+        }
+
+        system_free(macros->e);
+        *macros = new_table;
+        res = true;
+    }
+
+    return(res);
+}
+
+// If the macro's already been defined, the new definition replaces it.
+internal Void add_macro(MacroTable *macros, String iden, String res) {
+    if(iden.len) {
+        Bool have_space = ((macros->cnt + 1) * 4 <= macros->max * 3); // Keep the load factor under 3/4.
+        if(!have_space) {
+            have_space = grow_macro_table(macros);
+        }
+
+        if(have_space) {
+            Uint64 hash = hash_bytes(iden.e, iden.len);
+            MacroData *md = find_macro_slot(macros, iden, hash);
+            if(!md->iden.len) {
+                ++macros->cnt;
+            }
+
+            md->iden = iden;
+            md->res = res;
+            md->hash = hash;
+            md->undefined = false;
+        }
+    }
+}
+
+internal Void remove_macro(MacroTable *macros, String iden) {
+    MacroData *md = find_macro(macros, iden);
+    if(md) {
+        md->undefined = true;
+    }
+}
+
+internal Token lex_token(Lexer *lexer) {
+    eat_whitespace(lexer);
 
     Token res = {};
     res.len = 1;
-    res.e = tokenizer->at;
-    Char c = tokenizer->at[0];
-    ++tokenizer->at;
+    res.e = lexer->at;
+    Char c = peek_char(lexer);
+    if(c) {
+        ++lexer->at;
+    }
 
     switch(c) {
         case 0:   { res.type = TokenType_end_of_stream; } break;
@@ -779,90 +1292,73 @@ internal Token get_token(Tokenizer *tokenizer) {
         case '|': { res.type = TokenType_inclusive_or;  } break;
 
         case '=': {
-            Token next = peak_token(tokenizer);
-            if(next.type == TokenType_assign) { res.type = TokenType_equal;  res.len = 2; }
-            else                              { res.type = TokenType_assign;              }
+            if(peek_char(lexer) == '=') { res.type = TokenType_equal;  res.len = 2; ++lexer->at; }
+            else                        { res.type = TokenType_assign;                           }
         } break;
 
         case '!': {
-            Token next = peak_token(tokenizer);
-            if(next.type == TokenType_assign) { res.type = TokenType_not_equal; res.len = 2; }
-            else                              { res.type = TokenType_not;                    }
+            if(peek_char(lexer) == '=') { res.type = TokenType_not_equal; res.len = 2; ++lexer->at; }
+            else                        { res.type = TokenType_not;                                 }
         } break;
 
         case '>': {
-            Token next = peak_token(tokenizer);
-            if(next.type == TokenType_assign) { res.type = TokenType_greater_than_or_equal; res.len = 2; }
-            else                              { res.type = TokenType_close_angle_bracket;                }
+            if(peek_char(lexer) == '=') { res.type = TokenType_greater_than_or_equal; res.len = 2; ++lexer->at; }
+            else                        { res.type = TokenType_close_angle_bracket;                             }
         } break;
 
         case '<': {
-            Token next = peak_token(tokenizer);
-            if(next.type == TokenType_assign) { res.type = TokenType_less_than_or_equal; res.len = 2; }
-            else                              { res.type = TokenType_open_angle_bracket;              }
+            if(peek_char(lexer) == '=') { res.type = TokenType_less_than_or_equal; res.len = 2; ++lexer->at; }
+            else                        { res.type = TokenType_open_angle_bracket;                           }
         } break;
 
         case '.':  {
-            Bool var_args = false;
-            Tokenizer tokenizer_copy = *tokenizer;
-            Token next = get_token(&tokenizer_copy);
-            if(next.type == TokenType_period) {
-                next = get_token(&tokenizer_copy);
-                if(next.type == TokenType_period) {
-                    var_args = true;
-
-                    res.type = TokenType_var_args;
-                    res.len = 3;
-
-                    eat_tokens(tokenizer, 2);
-                }
+            if((peek_char(lexer) == '.') && (peek_char(lexer, 1) == '.')) {
+                res.type = TokenType_var_args;
+                res.len = 3;
+                lexer->at += 2;
+            } else {
+                res.type = TokenType_period;
             }
-
-            if(!var_args) { res.type = TokenType_period; }
         } break;
 
         case '"': {
-            res.e = tokenizer->at;
-            while((tokenizer->at[0]) && (tokenizer->at[0] != '"')) {
-                if((tokenizer->at[0] == '\\') && (tokenizer->at[1])) {
-                    ++tokenizer->at;
+            res.e = lexer->at;
+            while((peek_char(lexer)) && (peek_char(lexer) != '"')) {
+                if((peek_char(lexer) == '\\') && (peek_char(lexer, 1))) {
+                    ++lexer->at;
                 }
-                ++tokenizer->at;
+                ++lexer->at;
             }
 
             res.type = TokenType_string;
-            res.len = safe_truncate_size_64(tokenizer->at - res.e);
-            if(tokenizer->at[0] == '"') { ++tokenizer->at; }
+            res.len = safe_truncate_size_64(lexer->at - res.e);
+            if(peek_char(lexer) == '"') { ++lexer->at; }
         } break;
 
         case '\'': {
-            res.e = tokenizer->at;
-            while((tokenizer->at[0]) && (tokenizer->at[0] != '\'')) {
-                if((tokenizer->at[0] == '\\') && (tokenizer->at[1])) {
-                    ++tokenizer->at;
+            res.e = lexer->at;
+            while((peek_char(lexer)) && (peek_char(lexer) != '\'')) {
+                if((peek_char(lexer) == '\\') && (peek_char(lexer, 1))) {
+                    ++lexer->at;
                 }
-                ++tokenizer->at;
+                ++lexer->at;
             }
 
             res.type = TokenType_string;
-            res.len = safe_truncate_size_64(tokenizer->at - res.e);
-            if(tokenizer->at[0] == '\'') { ++tokenizer->at; }
+            res.len = safe_truncate_size_64(lexer->at - res.e);
+            if(peek_char(lexer) == '\'') { ++lexer->at; }
         } break;
 
         default: {
             if((is_alphabetical(c)) || (c == '_')) {
-                while((is_alphabetical(tokenizer->at[0])) || (is_num(tokenizer->at[0])) || (tokenizer->at[0] == '_')) {
-                    ++tokenizer->at;
-                }
+                lexer->at = skip_identifier(lexer->at, lexer->end, lexer->simd_level);
 
-                res.len = safe_truncate_size_64(tokenizer->at - res.e);
+                res.len = safe_truncate_size_64(lexer->at - res.e);
                 res.type = TokenType_identifier;
             } else if(is_num(c)) {
-                while(is_num(tokenizer->at[0])) {
-                    ++tokenizer->at;
-                }
+                lexer->at = skip_digits(lexer->at, lexer->end, lexer->simd_level);
 
-                res.len = safe_truncate_size_64(tokenizer->at - res.e);
+                res.len = safe_truncate_size_64(lexer->at - res.e);
                 res.type = TokenType_number;
             } else {
                 res.type = TokenType_unknown;
@@ -870,44 +1366,759 @@ internal Token get_token(Tokenizer *tokenizer) {
         } break;
     }
 
-    if(res.type == TokenType_identifier) {
-        Bool changed = false;
-        do {
-            changed = false;
-            for(Int i = 0; (i < macro_count); ++i) {
-                MacroData *md = macro_data + i;
+    //if(res.type == TokenType_unknown) { push_error(ErrorType_unknown_token_found); }
+
+    return(res);
+}
+
+internal Void free_token_array(TokenArray *tokens) {
+    system_free(tokens->type);
+    system_free(tokens->offset);
+    system_free(tokens->len);
+    system_free(tokens->includes);
+    system_free(tokens->external);
+
+    zero(tokens, sizeof(*tokens));
+}
+
+internal Void push_token(TokenArray *tokens, Token token) {
+    if(tokens->cnt >= tokens->max) {
+        Int new_max = tokens->max * 2;
+
+        Void *type = system_realloc(tokens->type, sizeof(*tokens->type) * new_max);
+        if(type) { tokens->type = cast(Uint8 *)type; }
+
+        Void *offset = system_realloc(tokens->offset, sizeof(*tokens->offset) * new_max);
+        if(offset) { tokens->offset = cast(Int *)offset; }
+
+        Void *len = system_realloc(tokens->len, sizeof(*tokens->len) * new_max);
+        if(len) { tokens->len = cast(Int *)len; }
+
+        if((type) && (offset) && (len)) {
+            tokens->max = new_max;
+        }
+    }
+
+    Int offset = 0;
+    Bool has_offset = false;
+    if((token.e >= tokens->base) && (token.e <= tokens->end)) {
+        offset = cast(Int)(token.e - tokens->base);
+        has_offset = true;
+    } else {
+        if(tokens->external_cnt >= tokens->external_max) {
+            Int new_max = (tokens->external_max) ? tokens->external_max * 2 : 64;
+            Void *external = system_realloc(tokens->external, sizeof(*tokens->external) * new_max);
+            if(external) {
+                tokens->external = cast(Char const **)external;
+                tokens->external_max = new_max;
+            }
+        }
+
+        if(tokens->external_cnt < tokens->external_max) {
+            tokens->external[tokens->external_cnt++] = token.e;
+            offset = -tokens->external_cnt;
+            has_offset = true;
+        }
+    }
+
+    if((tokens->cnt < tokens->max) && (has_offset)) {
+        tokens->type[tokens->cnt] = cast(Uint8)token.type;
+        tokens->offset[tokens->cnt] = offset;
+        tokens->len[tokens->cnt] = token.len;
+        ++tokens->cnt;
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+}
+
+// Reads a #define, just after the "define", and adds it to the macro table.
+internal Void lex_define(Lexer *lexer, MacroTable *macros) {
+    String iden = token_to_string(lex_token(lexer));
+
+    // Only skip whitespace on this line, otherwise an empty macro would swallow the next one.
+    while((peek_char(lexer) == ' ') || (peek_char(lexer) == '\t')) {
+        ++lexer->at;
+    }
+
+    String macro_res = {lexer->at, 0};
+    skip_to_end_of_line(lexer);
+    macro_res.len = safe_truncate_size_64(lexer->at - macro_res.e);
+
+    add_macro(macros, iden, macro_res);
+}
+
+//
+// Conditional compilation.
+//
+// Macros from -D. Not copied, so they have to outlive every tokenize.
+internal Char const **global_predefined_macros = 0;
+internal Int global_predefined_macro_count = 0;
+
+// Only main.cpp calls this, merge_parse_results and the serializing, so they're left out when test.cpp and
+// benchmark.cpp include this file for its internal functions. Their copies would never be used.
+#if !defined(LEXER_INCLUDED_FOR_INTERNALS)
+Void set_predefined_macros(Char const **defines, Int cnt) {
+    global_predefined_macros = defines;
+    global_predefined_macro_count = cnt;
+}
+#endif
+
+internal Void add_predefined_macros(MacroTable *macros) {
+    for(Int i = 0; (i < global_predefined_macro_count); ++i) {
+        Char const *define = global_predefined_macros[i];
+
+        // -DNAME is the same as -DNAME=1.
+        String iden = { define, string_length(define) };
+        String res = { "1", 1 };
+        Int equals = string_contains_pos(define, "=");
+        if(equals != -1) {
+            iden.len = equals;
+            res.e = define + equals + 1;
+            res.len = string_length(res.e);
+        }
+
+        add_macro(macros, iden, res);
+    }
+}
+
+// Only skips spaces and tabs, so it never leaves the directive's line.
+internal String lex_directive_name(Lexer *lexer) {
+    while((peek_char(lexer) == ' ') || (peek_char(lexer) == '\t')) {
+        ++lexer->at;
+    }
+
+    String res = { lexer->at, 0 };
+    lexer->at = skip_identifier(lexer->at, lexer->end, lexer->simd_level);
+    res.len = safe_truncate_size_64(lexer->at - res.e);
+
+    return(res);
+}
+
+// A directive ends at the first newline which isn't escaped with a '\'.
+internal Char const *find_end_of_directive(Char const *at, Char const *end, SimdLevel level) {
+    Char const *res = find_end_of_line(at, end, level);
+    while((res < end) && (*res) && (res > at) && (res[-1] == '\\')) {
+        if((res[0] == '\r') && (res + 1 < end) && (res[1] == '\n')) { ++res; }
+
+        res = find_end_of_line(res + 1, end, level);
+    }
+
+    return(res);
+}
+
+// #if and #elif expressions. Precedence climbing, with the C operators (and precedences) which can appear in one.
+// Anything it doesn't understand evaluates to 0.
+enum ExpressionOp {
+    ExpressionOp_multiply,
+    ExpressionOp_divide,
+    ExpressionOp_modulo,
+    ExpressionOp_add,
+    ExpressionOp_subtract,
+    ExpressionOp_shift_left,
+    ExpressionOp_shift_right,
+    ExpressionOp_less_than,
+    ExpressionOp_less_than_or_equal,
+    ExpressionOp_greater_than,
+    ExpressionOp_greater_than_or_equal,
+    ExpressionOp_equal,
+    ExpressionOp_not_equal,
+    ExpressionOp_bitwise_and,
+    ExpressionOp_bitwise_xor,
+    ExpressionOp_bitwise_or,
+    ExpressionOp_logical_and,
+    ExpressionOp_logical_or,
+};
+
+struct ExpressionOpInfo {
+    Char const *str;
+    Int len;
+    Int precedence; // Higher binds tighter.
+    ExpressionOp op;
+};
+
+// Two character operators first, so "<<" isn't read as "<".
+internal ExpressionOpInfo const global_expression_ops[] = {
+    { "<<", 2,  8, ExpressionOp_shift_left            },
+    { ">>", 2,  8, ExpressionOp_shift_right           },
+    { "<=", 2,  7, ExpressionOp_less_than_or_equal    },
+    { ">=", 2,  7, ExpressionOp_greater_than_or_equal },
+    { "==", 2,  6, ExpressionOp_equal                 },
+    { "!=", 2,  6, ExpressionOp_not_equal             },
+    { "&&", 2,  2, ExpressionOp_logical_and           },
+    { "||", 2,  1, ExpressionOp_logical_or            },
+    { "*",  1, 10, ExpressionOp_multiply              },
+    { "/",  1, 10, ExpressionOp_divide                },
+    { "%",  1, 10, ExpressionOp_modulo                },
+    { "+",  1,  9, ExpressionOp_add                   },
+    { "-",  1,  9, ExpressionOp_subtract              },
+    { "<",  1,  7, ExpressionOp_less_than             },
+    { ">",  1,  7, ExpressionOp_greater_than          },
+    { "&",  1,  5, ExpressionOp_bitwise_and           },
+    { "^",  1,  4, ExpressionOp_bitwise_xor           },
+    { "|",  1,  3, ExpressionOp_bitwise_or            },
+};
+
+struct ExpressionParser {
+    Lexer lexer;
+    MacroTable *macros;
+    Int depth; // Of macro expansions, so self-referential macros can't recurse forever.
+};
+
+internal Void eat_expression_whitespace(ExpressionParser *parser) {
+    Lexer *lexer = &parser->lexer;
+    for(;;) {
+        Char c = peek_char(lexer);
+        if((c == ' ') || (c == '\t') || (c == '\\') || (is_end_of_line(c))) {
+            ++lexer->at;
+        } else if((c == '/') && (peek_char(lexer, 1) == '*')) {
+            lexer->at = find_end_of_block_comment(lexer->at + 2, lexer->end, lexer->simd_level);
+            if(peek_char(lexer) == '*') { lexer->at += 2; }
+        } else if((c == '/') && (peek_char(lexer, 1) == '/')) {
+            lexer->at = lexer->end;
+        } else {
+            break; // for
+        }
+    }
+}
+
+internal Bool eat_expression_char(ExpressionParser *parser, Char c) {
+    eat_expression_whitespace(parser);
+
+    Bool res = (peek_char(&parser->lexer) == c);
+    if(res) {
+        ++parser->lexer.at;
+    }
+
+    return(res);
+}
+
+internal String lex_expression_identifier(ExpressionParser *parser) {
+    eat_expression_whitespace(parser);
+
+    String res = { parser->lexer.at, 0 };
+    parser->lexer.at = skip_identifier(parser->lexer.at, parser->lexer.end, parser->lexer.simd_level);
+    res.len = safe_truncate_size_64(parser->lexer.at - res.e);
+
+    return(res);
+}
+
+// Decimal, hex (0x), or octal (leading 0), with any u/l suffix ignored. Or a simple character literal.
+internal Int64 lex_expression_number(ExpressionParser *parser) {
+    Lexer *lexer = &parser->lexer;
+    Int64 res = 0;
+
+    if(peek_char(lexer) == '\'') {
+        ++lexer->at;
+        if((peek_char(lexer) == '\\') && (peek_char(lexer, 1))) {
+            Char c = peek_char(lexer, 1);
+            res = (c == 'n') ? '\n' : (c == 't') ? '\t' : (c == 'r') ? '\r' : (c == '0') ? 0 : c;
+            lexer->at += 2;
+        } else {
+            res = peek_char(lexer);
+            ++lexer->at;
+        }
+
+        if(peek_char(lexer) == '\'') { ++lexer->at; }
+    } else {
+        Int base = 10;
+        if((peek_char(lexer) == '0') && ((peek_char(lexer, 1) == 'x') || (peek_char(lexer, 1) == 'X'))) {
+            base = 16;
+            lexer->at += 2;
+        } else if(peek_char(lexer) == '0') {
+            base = 8;
+        }
+
+        for(;;) {
+            Char c = peek_char(lexer);
+            Int digit = -1;
+            if((c >= '0') && (c <= '9'))                      { digit = c - '0';      }
+            else if((base == 16) && (c >= 'a') && (c <= 'f')) { digit = c - 'a' + 10; }
+            else if((base == 16) && (c >= 'A') && (c <= 'F')) { digit = c - 'A' + 10; }
+
+            if((digit == -1) || (digit >= base)) {
+                break; // for
+            }
+
+            res = (res * base) + digit;
+            ++lexer->at;
+        }
+
+        lexer->at = skip_identifier(lexer->at, lexer->end, lexer->simd_level); // Suffixes.
+    }
+
+    return(res);
+}
+
+internal Int64 evaluate_conditional_expression(ExpressionParser *parser);
+
+// Expands a macro by evaluating what it's defined as. That's the same as pasting it in, as long as the definition
+// is a complete expression, which is nearly always the case.
+internal Int64 evaluate_macro(ExpressionParser *parser, MacroData *md) {
+    Int64 res = 0;
+
+    // Function-like macros aren't expanded, so skip their arguments.
+    Bool is_function_like = ((md->res.e == md->iden.e + md->iden.len) && (md->res.len) && (md->res.e[0] == '('));
+    if(is_function_like) {
+        if(eat_expression_char(parser, '(')) {
+            Int level = 1;
+            while((level) && (peek_char(&parser->lexer))) {
+                Char c = peek_char(&parser->lexer);
+                if(c == '(')      { ++level; }
+                else if(c == ')') { --level; }
+
+                ++parser->lexer.at;
+            }
+        }
+    } else if(parser->depth < max_macro_expansion_depth) {
+        ExpressionParser sub_parser = {};
+        sub_parser.lexer = create_lexer(md->res.e, md->res.len);
+        sub_parser.macros = parser->macros;
+        sub_parser.depth = parser->depth + 1;
+
+        res = evaluate_conditional_expression(&sub_parser);
+    }
+
+    return(res);
+}
+
+internal Int64 evaluate_unary_expression(ExpressionParser *parser) {
+    Int64 res = 0;
+
+    eat_expression_whitespace(parser);
+    Char c = peek_char(&parser->lexer);
+    if(c == '(') {
+        ++parser->lexer.at;
+        res = evaluate_conditional_expression(parser);
+        eat_expression_char(parser, ')');
+    } else if(c == '!') {
+        ++parser->lexer.at;
+        res = !evaluate_unary_expression(parser);
+    } else if(c == '~') {
+        ++parser->lexer.at;
+        res = ~evaluate_unary_expression(parser);
+    } else if(c == '-') {
+        ++parser->lexer.at;
+        res = -evaluate_unary_expression(parser);
+    } else if(c == '+') {
+        ++parser->lexer.at;
+        res = evaluate_unary_expression(parser);
+    } else if((is_num(c)) || (c == '\'')) {
+        res = lex_expression_number(parser);
+    } else if((is_alphabetical(c)) || (c == '_')) {
+        String iden = lex_expression_identifier(parser);
+        if(string_compare(iden, create_string("defined"))) {
+            Bool has_paren = eat_expression_char(parser, '(');
+            res = (find_macro(parser->macros, lex_expression_identifier(parser)) != 0);
+            if(has_paren) {
+                eat_expression_char(parser, ')');
+            }
+        } else if(string_compare(iden, create_string("true"))) {
+            res = 1;
+        } else {
+            // Anything that isn't a macro (including false) is 0.
+            MacroData *md = find_macro(parser->macros, iden);
+            if(md) {
+                res = evaluate_macro(parser, md);
+            }
+        }
+    }
+
+    return(res);
+}
+
+internal ExpressionOpInfo const *peek_expression_op(ExpressionParser *parser) {
+    ExpressionOpInfo const *res = 0;
+
+    eat_expression_whitespace(parser);
+    for(Int i = 0; (i < array_count(global_expression_ops)); ++i) {
+        ExpressionOpInfo const *info = global_expression_ops + i;
+        if(lexer_starts_with(&parser->lexer, info->str, info->len)) {
+            res = info;
+            break; // for
+        }
+    }
+
+    return(res);
+}
+
+internal Int64 apply_expression_op(ExpressionOp op, Int64 a, Int64 b) {
+    Int64 res = 0;
+    switch(op) {
+        case ExpressionOp_multiply:              { res = a * b;            } break;
+        case ExpressionOp_divide:                { res = (b) ? a / b : 0;  } break;
+        case ExpressionOp_modulo:                { res = (b) ? a % b : 0;  } break;
+        case ExpressionOp_add:                   { res = a + b;            } break;
+        case ExpressionOp_subtract:              { res = a - b;            } break;
+        case ExpressionOp_shift_left:            { res = ((b >= 0) && (b < 64)) ? cast(Int64)(cast(Uint64)a << b) : 0; } break;
+        case ExpressionOp_shift_right:           { res = ((b >= 0) && (b < 64)) ? (a >> b) : 0;                        } break;
+        case ExpressionOp_less_than:             { res = (a < b);          } break;
+        case ExpressionOp_less_than_or_equal:    { res = (a <= b);         } break;
+        case ExpressionOp_greater_than:          { res = (a > b);          } break;
+        case ExpressionOp_greater_than_or_equal: { res = (a >= b);         } break;
+        case ExpressionOp_equal:                 { res = (a == b);         } break;
+        case ExpressionOp_not_equal:             { res = (a != b);         } break;
+        case ExpressionOp_bitwise_and:           { res = a & b;            } break;
+        case ExpressionOp_bitwise_xor:           { res = a ^ b;            } break;
+        case ExpressionOp_bitwise_or:            { res = a | b;            } break;
+        case ExpressionOp_logical_and:           { res = ((a) && (b));     } break;
+        case ExpressionOp_logical_or:            { res = ((a) || (b));     } break;
+    }
+
+    return(res);
+}
+
+internal Int64 evaluate_binary_expression(ExpressionParser *parser, Int min_precedence) {
+    Int64 res = evaluate_unary_expression(parser);
+
+    for(;;) {
+        ExpressionOpInfo const *info = peek_expression_op(parser);
+        if((!info) || (info->precedence < min_precedence)) {
+            break; // for
+        }
+
+        parser->lexer.at += info->len;
+        Int64 rhs = evaluate_binary_expression(parser, info->precedence + 1);
+        res = apply_expression_op(info->op, res, rhs);
+    }
+
+    return(res);
+}
+
+internal Int64 evaluate_conditional_expression(ExpressionParser *parser) {
+    Int64 res = evaluate_binary_expression(parser, 1);
+
+    if(eat_expression_char(parser, '?')) {
+        Int64 a = evaluate_conditional_expression(parser);
+        eat_expression_char(parser, ':');
+        Int64 b = evaluate_conditional_expression(parser);
+
+        res = (res) ? a : b;
+    }
+
+    return(res);
+}
+
+internal Bool evaluate_directive_expression(Char const *at, Char const *end, MacroTable *macros) {
+    ExpressionParser parser = {};
+    parser.lexer = create_lexer(at, end - at);
+    parser.macros = macros;
+
+    Bool res = (evaluate_conditional_expression(&parser) != 0);
+
+    return(res);
+}
+
+// One per #if the lexer's inside. Ones inside a skipped group are never pushed, because skip_inactive_group jumps
+// straight over them.
+struct ConditionalStack {
+    Bool taken[64]; // A group's already been compiled, so every #elif or #else after it is skipped.
+    Int cnt; // Can be bigger than array_count(taken) if they're nested really deep. Those share the last slot.
+};
+
+internal Bool *get_top_conditional(ConditionalStack *stack) {
+    Bool *res = 0;
+    if(stack->cnt) {
+        Int index = (stack->cnt <= array_count(stack->taken)) ? stack->cnt - 1 : array_count(stack->taken) - 1;
+        res = stack->taken + index;
+    }
+
+    return(res);
+}
 
-                String token_as_string = token_to_string(res);
-                if(string_compare(token_as_string, md->iden)) {
-                    res = string_to_token(md->res);
-                    changed = true;
+// Jumps over a group that isn't being compiled, to the '#' of the #elif, #else or #endif that ends it (or the end of
+// the stream). Only '#'s at the start of a line can be directives, so it just searches for '#'s, and most of a
+// skipped group's only looked at 16 bytes at a time.
+internal Void skip_inactive_group(Lexer *lexer) {
+    Char const *start = lexer->at;
+    Char const *at = lexer->at;
+
+    Int level = 0;
+    for(;;) {
+        Char const *hash = find_char(at, lexer->end, '#', lexer->simd_level);
+        if(hash == lexer->end) {
+            at = lexer->end;
+            break; // for
+        }
+
+        Char const *line_start = hash;
+        while((line_start > start) && ((line_start[-1] == ' ') || (line_start[-1] == '\t'))) {
+            --line_start;
+        }
+
+        Lexer directive = { hash + 1, lexer->end, lexer->simd_level };
+        if((line_start == start) || (is_end_of_line(line_start[-1]))) {
+            String name = lex_directive_name(&directive);
+            if((string_compare(name, create_string("if"))) || (string_compare(name, create_string("ifdef"))) ||
+               (string_compare(name, create_string("ifndef")))) {
+                ++level;
+            } else if(string_compare(name, create_string("endif"))) {
+                if(!level) {
+                    at = hash;
+                    break; // for
                 }
+
+                --level;
+            } else if((!level) && ((string_compare(name, create_string("else"))) ||
+                                   (string_compare(name, create_string("elif"))))) {
+                at = hash;
+                break; // for
             }
-        } while(changed);
+        }
+
+        at = directive.at;
     }
 
-    //if(res.type == TokenType_unknown) { push_error(ErrorType_unknown_token_found); }
+    lexer->at = at;
+}
+
+// at is just after the "include". Only records "name" and <name>, anything else is ignored.
+internal Void push_include(TokenArray *tokens, Char const *at, Char const *line_end, SimdLevel level) {
+    while((at < line_end) && ((*at == ' ') || (*at == '\t'))) {
+        ++at;
+    }
+
+    if((at < line_end) && ((*at == '"') || (*at == '<'))) {
+        IncludeDirective include = {};
+        include.is_system = (*at == '<');
+
+        Char const *name_end = find_char(at + 1, line_end, (include.is_system) ? '>' : '"', level);
+        if(name_end < line_end) {
+            include.name.e = at + 1;
+            include.name.len = safe_truncate_size_64(name_end - include.name.e);
+
+            if(tokens->include_cnt >= tokens->include_max) {
+                Int new_max = (tokens->include_max) ? tokens->include_max * 2 : 16;
+                Void *p = system_realloc(tokens->includes, sizeof(IncludeDirective) * new_max);
+                if(p) {
+                    tokens->includes = cast(IncludeDirective *)p;
+                    tokens->include_max = new_max;
+                }
+            }
+
+            if(tokens->include_cnt < tokens->include_max) {
+                tokens->includes[tokens->include_cnt++] = include;
+            } else {
+                push_error(ErrorType_ran_out_of_memory);
+            }
+        }
+    }
+}
+
+// Called just after the '#'. Conditionals which turn out false skip their group here, so everything after is being
+// compiled.
+internal Void lex_directive(Lexer *lexer, TokenArray *tokens, MacroTable *macros, ConditionalStack *conditionals) {
+    String name = lex_directive_name(lexer);
+    Char const *line_end = find_end_of_directive(lexer->at, lexer->end, lexer->simd_level);
+
+    if(string_compare(name, create_string("define"))) {
+        lex_define(lexer, macros);
+    } else {
+        Bool skip_group = false;
+        Bool *top = get_top_conditional(conditionals);
+
+        if(string_compare(name, create_string("include"))) {
+            push_include(tokens, lexer->at, line_end, lexer->simd_level);
+        } else if(string_compare(name, create_string("undef"))) {
+            remove_macro(macros, lex_directive_name(lexer));
+        } else if(string_compare(name, create_string("if"))) {
+            skip_group = !evaluate_directive_expression(lexer->at, line_end, macros);
+            ++conditionals->cnt;
+            *get_top_conditional(conditionals) = !skip_group;
+        } else if((string_compare(name, create_string("ifdef"))) || (string_compare(name, create_string("ifndef")))) {
+            Bool is_defined = (find_macro(macros, lex_directive_name(lexer)) != 0);
+            skip_group = (name.len == 5) ? !is_defined : is_defined;
+            ++conditionals->cnt;
+            *get_top_conditional(conditionals) = !skip_group;
+        } else if(string_compare(name, create_string("elif"))) {
+            // Only evaluated if nothing's been compiled yet, so an earlier group being true stops it. Ones without an #if
+            // are ignored.
+            if(top) {
+                skip_group = ((*top) || (!evaluate_directive_expression(lexer->at, line_end, macros)));
+                *top = (*top) || (!skip_group);
+            }
+        } else if(string_compare(name, create_string("else"))) {
+            if(top) {
+                skip_group = *top;
+                *top = true;
+            }
+        } else if(string_compare(name, create_string("endif"))) {
+            if(conditionals->cnt) {
+                --conditionals->cnt;
+            }
+        }
+
+        // Everything else (#pragma, #error, etc) is ignored.
+        lexer->at = line_end;
+        if(skip_group) {
+            skip_inactive_group(lexer);
+        }
+    }
+}
+
+// Lexes a whole file, so the parser never has to lex anything twice. Preprocessor directives are dealt with here too.
+// #defines go into the macro table, and are expanded as the tokens are lexed. Groups which #if, #ifdef, etc, leave out
+// are skipped without being lexed. Everything else is dropped, so the parser never sees a hash.
+internal TokenArray tokenize(Char const *stream, PtrSize size) {
+    TokenArray res = {};
+    res.base = stream;
+    res.end = stream + size;
+    res.max = cast(Int)(size / 4) + 64; // Rough guess, it'll grow if it needs to.
+    res.type = system_alloc(Uint8, res.max);
+    res.offset = system_alloc(Int, res.max);
+    res.len = system_alloc(Int, res.max);
+
+    MacroTable macros = {};
+    ConditionalStack conditionals = {};
+    if((res.type) && (res.offset) && (res.len) && (grow_macro_table(&macros))) {
+        Lexer lexer = create_lexer(stream, size);
+        add_predefined_macros(&macros);
+
+        for(;;) {
+            Token token = lex_token(&lexer);
+            if(token.type == TokenType_end_of_stream) {
+                break; // for
+            }
+
+            if(token.type == TokenType_hash) {
+                lex_directive(&lexer, &res, &macros, &conditionals);
+            } else {
+                Bool empty_macro = false;
+                for(Int depth = 0; (token.type == TokenType_identifier) && (depth < max_macro_expansion_depth); ++depth) {
+                    MacroData *md = find_macro(&macros, token_to_string(token));
+                    if(!md) {
+                        break; // for
+                    }
+
+                    ++res.macro_expansion_count;
+
+                    // Empty macros expand to nothing.
+                    if(md->res.len) { token = string_to_token(md->res);  }
+                    else            { empty_macro = true; break; /*for*/ }
+                }
+
+                if(!empty_macro) {
+                    push_token(&res, token);
+                }
+            }
+        }
+    }
+
+    system_free(macros.e);
+
+    return(res);
+}
+
+internal Bool grow_member_table(MemberTable *members, MemoryArena *arena) {
+    Bool res = false;
+
+    Int old_max = members->max;
+    Int new_max = (old_max) ? old_max * 2 : 256;
+
+    Int *type_id = cast(Int *)resize_arena_memory(arena, members->type_id, sizeof(Int) * old_max, sizeof(Int) * new_max);
+    Int *name_id = cast(Int *)resize_arena_memory(arena, members->name_id, sizeof(Int) * old_max, sizeof(Int) * new_max);
+    Int *array_count = cast(Int *)resize_arena_memory(arena, members->array_count, sizeof(Int) * old_max,
+                                                      sizeof(Int) * new_max);
+    Uint8 *ptr = cast(Uint8 *)resize_arena_memory(arena, members->ptr, old_max, new_max);
+    Uint8 *flags = cast(Uint8 *)resize_arena_memory(arena, members->flags, old_max, new_max);
+    Uint8 *anonymous_unions = cast(Uint8 *)resize_arena_memory(arena, members->anonymous_unions, old_max, new_max);
+    if((type_id) && (name_id) && (array_count) && (ptr) && (flags) && (anonymous_unions)) {
+        members->type_id = type_id;
+        members->name_id = name_id;
+        members->array_count = array_count;
+        members->ptr = ptr;
+        members->flags = flags;
+        members->anonymous_unions = anonymous_unions;
+        members->max = new_max;
+
+        res = true;
+    }
 
     return(res);
 }
 
-ParseResult parse_stream(Char const *stream) {
+// sd's members and base classes were parsed into scratch memory, so they're moved into the member table (and the
+// base classes copied into arena) before it's thrown away. Every name write_data needs to look up or dedupe is
+// interned on the way, so it can compare IDs instead of strings.
+internal Void push_struct(ParseResult *res, Int *struct_max, StructData sd, MemoryArena *arena) {
+    if(res->struct_cnt + 1 >= *struct_max) {
+        Void *p = resize_arena_memory(arena, res->struct_data, sizeof(StructData) * *struct_max,
+                                      sizeof(StructData) * *struct_max * 2);
+        if(p) {
+            res->struct_data = cast(StructData *)p;
+            *struct_max *= 2;
+        }
+    }
+
+    if(res->struct_cnt < *struct_max) {
+        SymbolTable *symbols = &res->symbols;
+        MemberTable *members = &res->members;
+
+        sd.name_id = intern_string(symbols, sd.name);
+
+        sd.first_member = members->cnt;
+        for(Int i = 0; (i < sd.member_count); ++i) {
+            if((members->cnt >= members->max) && (!grow_member_table(members, arena))) {
+                sd.member_count = i;
+                break; // for
+            }
+
+            Variable *md = sd.members + i;
+            Int row = members->cnt++;
+            members->type_id[row] = intern_string(symbols, md->type);
+            members->name_id[row] = intern_string(symbols, md->name);
+            members->array_count[row] = md->array_count;
+            members->ptr[row] = cast(Uint8)((md->ptr < 0xFF) ? md->ptr : 0xFF);
+            members->flags[row] = cast(Uint8)((md->access & MemberFlag_access_mask) |
+                                              (md->anonymous_depth << MemberFlag_anonymous_depth_shift) |
+                                              (md->anonymous_opened << MemberFlag_anonymous_opened_shift));
+            members->anonymous_unions[row] = md->anonymous_unions;
+        }
+        sd.members = 0;
+
+        String *inherited = 0;
+        if(sd.inherited_count) {
+            inherited = push_arena(arena, String, sd.inherited_count);
+            sd.inherited_ids = push_arena(arena, Int, sd.inherited_count);
+            if((inherited) && (sd.inherited_ids)) {
+                for(Int i = 0; (i < sd.inherited_count); ++i) {
+                    inherited[i] = sd.inherited[i];
+                    sd.inherited_ids[i] = intern_string(symbols, inherited[i]);
+                }
+            } else {
+                inherited = 0;
+                sd.inherited_ids = 0;
+                sd.inherited_count = 0;
+            }
+        }
+        sd.inherited = inherited;
+
+        res->struct_data[res->struct_cnt++] = sd;
+    }
+}
+
+ParseResult parse_stream(Char const *stream, PtrSize size, MemoryArena *arena) {
     ParseResult res = {};
+    res.symbols.arena = arena;
+
+    // Structs are parsed into here, and it's cleared after each one, so the Variables never touch arena.
+    MemoryArena *scratch = get_thread_scratch_arena();
 
     Int enum_max = 8;
-    res.enum_data = system_alloc(EnumData, enum_max);
+    res.enum_data = push_arena(arena, EnumData, enum_max);
 
     Int struct_max = 32;
-    res.struct_data = system_alloc(StructData, struct_max);
-
-    Int macro_max = 32;
-    macro_data = system_alloc(MacroData, macro_max);
+    res.struct_data = push_arena(arena, StructData, struct_max);
 
     Int func_max = 128;
-    res.func_data = system_alloc(FunctionData, func_max);
+    res.func_data = push_arena(arena, FunctionData, func_max);
+
+    trace_begin("lex");
+    TokenArray tokens = tokenize(stream, size);
+    trace_end();
 
-    if((res.enum_data)  && (res.struct_data) && (macro_data)) {
-        Tokenizer tokenizer = { stream };
+    trace_begin("parse");
+    if((res.enum_data)  && (res.struct_data) && (tokens.type)) {
+        Tokenizer tokenizer = create_tokenizer(&tokens);
 
         Bool parsing = true;
         while(parsing) {
@@ -915,25 +2126,6 @@ ParseResult parse_stream(Char const *stream) {
             switch(token.type) {
                 case TokenType_end_of_stream: { parsing = false; } break;
 
-                case TokenType_hash: {
-                    if(peak_require_token(&tokenizer, "define")) {
-                        eat_token(&tokenizer);
-
-                        MacroData *md = macro_data + macro_count++;
-                        zero(md, sizeof(*md));
-
-                        md->iden = token_to_string(get_token(&tokenizer));
-                        eat_whitespace(&tokenizer);
-                        md->res.e = tokenizer.at;
-                        while(!is_end_of_line(*tokenizer.at)) {
-                            ++md->res.len;
-                            ++tokenizer.at;
-                        }
-                    } else {
-                        skip_to_end_of_line(&tokenizer);
-                    }
-                } break;
-
                 case TokenType_identifier: {
                     if(token_equals(token, "template")) {
                         eat_token(&tokenizer);
@@ -945,52 +2137,527 @@ ParseResult parse_stream(Char const *stream) {
                         else if(token_equals(token, "class")) struct_type = StructType_class;
                         else if(token_equals(token, "union")) struct_type = StructType_union;
 
-                        if(res.struct_cnt + 1 >= struct_max) {
-                            struct_max *= 2;
-                            Void *p = system_realloc(res.struct_data, struct_max);
-                            if(p) {
-                                res.struct_data = cast(StructData *)p;
-                            }
-                        }
-
-                        ParseStructResult r = parse_struct(&tokenizer, struct_type);
-
+                        TempMemory struct_memory = begin_temp_memory(scratch);
+                        ParseStructResult r = parse_struct(&tokenizer, struct_type, scratch);
                         if(r.success) {
-                            res.struct_data[res.struct_cnt++] = r.sd;
+                            push_struct(&res, &struct_max, r.sd, arena);
                         }
+                        end_temp_memory(struct_memory);
                     } else if(token_equals(token, "enum")) {
                         if(res.enum_cnt + 1 >= enum_max) {
-                            enum_max *= 2;
-                            Void *p = system_realloc(res.enum_data, enum_max);
+                            Void *p = resize_arena_memory(arena, res.enum_data, sizeof(EnumData) * enum_max,
+                                                          sizeof(EnumData) * enum_max * 2);
                             if(p) {
                                 res.enum_data = cast(EnumData *)p;
+                                enum_max *= 2;
                             }
                         }
 
-                        ParseEnumResult r = parse_enum(&tokenizer);
+                        ParseEnumResult r = parse_enum(&tokenizer, arena);
                         if(r.success) { res.enum_data[res.enum_cnt++] = r.ed; }
                     } else if(token_equals(token, "union")) {
                         StructType struct_or_class = token_equals(token, "struct") ? StructType_struct : StructType_class;
-                        if(res.struct_cnt + 1 >= struct_max) {
-                            struct_max *= 2;
-                            Void *p = system_realloc(res.struct_data, struct_max);
-                            if(p) {
-                                res.struct_data = cast(StructData *)p;
-                            }
+                        TempMemory struct_memory = begin_temp_memory(scratch);
+                        ParseStructResult r = parse_struct(&tokenizer, struct_or_class, scratch);
+                        if(r.success) {
+                            push_struct(&res, &struct_max, r.sd, arena);
                         }
+                        end_temp_memory(struct_memory);
+                    }
+                } break;
+            }
+        }
 
-                        ParseStructResult r = parse_struct(&tokenizer, struct_or_class);
+    }
 
-                        if(r.success) {
-                            res.struct_data[res.struct_cnt++] = r.sd;
+    res.token_count = tokens.cnt;
+    res.macro_expansion_count = tokens.macro_expansion_count;
+
+    if(tokens.include_cnt) {
+        res.includes = push_arena(arena, IncludeDirective, tokens.include_cnt);
+        if(res.includes) {
+            copy(res.includes, tokens.includes, sizeof(IncludeDirective) * tokens.include_cnt);
+            res.include_cnt = tokens.include_cnt;
+        }
+    }
+
+    free_token_array(&tokens);
+
+    for(Int i = 0; (i < res.enum_cnt); ++i) {
+        EnumData *ed = res.enum_data + i;
+        ed->name_id = intern_string(&res.symbols, ed->name);
+    }
+    trace_end();
+
+    return(res);
+}
+
+#if !defined(LEXER_INCLUDED_FOR_INTERNALS)
+// Each file has its own SymbolTable, so every ID is mapped into the merged one on the way through.
+ParseResult merge_parse_results(ParseResult *results, Int cnt, MemoryArena *arena) {
+    ParseResult res = {};
+    res.symbols.arena = arena;
+
+    Int struct_max = 0, enum_max = 0, func_max = 0, symbol_max = 1;
+    for(Int i = 0; (i < cnt); ++i) {
+        res.token_count += results[i].token_count;
+        res.macro_expansion_count += results[i].macro_expansion_count;
+
+        struct_max += results[i].struct_cnt;
+        enum_max += results[i].enum_cnt;
+        func_max += results[i].func_cnt;
+        symbol_max += results[i].symbols.cnt;
+    }
+
+    res.struct_data = push_arena(arena, StructData, struct_max + 1);
+    res.enum_data = push_arena(arena, EnumData, enum_max + 1);
+    res.func_data = push_arena(arena, FunctionData, func_max + 1);
+
+    // The merged table can't have more symbols than all the others put together.
+    Bool *is_struct = push_arena(arena, Bool, symbol_max);
+    Bool *is_enum = push_arena(arena, Bool, symbol_max);
+
+    if((res.struct_data) && (res.enum_data) && (res.func_data) && (is_struct) && (is_enum)) {
+        for(Int i = 0; (i < cnt); ++i) {
+            ParseResult *pr = results + i;
+
+            Int *remap = push_arena(arena, Int, pr->symbols.cnt + 1);
+            if(!remap) {
+                push_error(ErrorType_ran_out_of_memory);
+                break; // for
+            }
+
+            for(Int j = 1; (j < pr->symbols.cnt); ++j) {
+                remap[j] = intern_string(&res.symbols, pr->symbols.symbols[j].str);
+            }
+
+            for(Int j = 0; (j < pr->struct_cnt); ++j) {
+                StructData sd = pr->struct_data[j];
+                sd.name_id = remap[sd.name_id];
+
+                if((sd.name_id) && (is_struct[sd.name_id])) {
+                    continue; // for
+                }
+                is_struct[sd.name_id] = true;
+
+                Int first_member = sd.first_member;
+                sd.first_member = res.members.cnt;
+                for(Int k = 0; (k < sd.member_count); ++k) {
+                    if((res.members.cnt >= res.members.max) && (!grow_member_table(&res.members, arena))) {
+                        sd.member_count = k;
+                        break; // for
+                    }
+
+                    Int src = first_member + k;
+                    Int row = res.members.cnt++;
+                    res.members.type_id[row] = remap[pr->members.type_id[src]];
+                    res.members.name_id[row] = remap[pr->members.name_id[src]];
+                    res.members.array_count[row] = pr->members.array_count[src];
+                    res.members.ptr[row] = pr->members.ptr[src];
+                    res.members.flags[row] = pr->members.flags[src];
+                    res.members.anonymous_unions[row] = pr->members.anonymous_unions[src];
+                }
+
+                if(sd.inherited_count) {
+                    Int *inherited_ids = push_arena(arena, Int, sd.inherited_count);
+                    if(inherited_ids) {
+                        for(Int k = 0; (k < sd.inherited_count); ++k) {
+                            inherited_ids[k] = remap[sd.inherited_ids[k]];
                         }
+                    } else {
+                        sd.inherited_count = 0;
                     }
-                } break;
+
+                    sd.inherited_ids = inherited_ids;
+                }
+
+                res.struct_data[res.struct_cnt++] = sd;
+            }
+
+            for(Int j = 0; (j < pr->enum_cnt); ++j) {
+                EnumData ed = pr->enum_data[j];
+                ed.name_id = remap[ed.name_id];
+
+                if((ed.name_id) && (is_enum[ed.name_id])) {
+                    continue; // for
+                }
+                is_enum[ed.name_id] = true;
+
+                res.enum_data[res.enum_cnt++] = ed;
             }
+
+            // Declaring the same function twice is fine, so these are all kept.
+            for(Int j = 0; (j < pr->func_cnt); ++j) {
+                res.func_data[res.func_cnt++] = pr->func_data[j];
+            }
+        }
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    return(res);
+}
+
+//
+// Serializing.
+//
+// Everything's written as it is in memory, so the cache is only valid on the machine (and build) which wrote it.
+// Strings are a length followed by the characters, and arrays are a count followed by the elements.
+struct Serializer {
+    Byte *e;
+    PtrSize size;
+    PtrSize max;
+    Bool failed;
+};
+
+internal Void serialize_bytes(Serializer *serializer, Void const *data, PtrSize size) {
+    if((!serializer->failed) && (serializer->size + size > serializer->max)) {
+        PtrSize new_max = (serializer->max) ? serializer->max * 2 : 4096;
+        while(new_max < serializer->size + size) {
+            new_max *= 2;
+        }
+
+        Void *p = system_realloc(serializer->e, new_max);
+        if(p) {
+            serializer->e = cast(Byte *)p;
+            serializer->max = new_max;
+        } else {
+            serializer->failed = true;
         }
+    }
+
+    if(!serializer->failed) {
+        copy(serializer->e + serializer->size, cast(Void *)data, size);
+        serializer->size += size;
+    }
+}
+
+#define serialize_value(serializer, v) serialize_bytes(serializer, &(v), sizeof(v))
+
+internal Void serialize_string(Serializer *serializer, String str) {
+    serialize_value(serializer, str.len);
+    serialize_bytes(serializer, str.e, str.len);
+}
+
+struct Deserializer {
+    Byte const *at;
+    Byte const *end;
+    MemoryArena *arena;
+    Bool failed;
+};
+
+internal Void deserialize_bytes(Deserializer *deserializer, Void *dst, PtrSize size) {
+    if((deserializer->failed) || (deserializer->end - deserializer->at < size)) {
+        deserializer->failed = true;
+        zero(dst, size);
+    } else {
+        copy(dst, cast(Void *)deserializer->at, size);
+        deserializer->at += size;
+    }
+}
+
+#define deserialize_value(deserializer, v) deserialize_bytes(deserializer, &(v), sizeof(v))
+
+// Returns 0 for an empty array. Every element takes at least a byte, so a count bigger than what's left can't be
+// right. It fails then, rather than trying to allocate it.
+internal Void *allocate_array(Deserializer *deserializer, PtrSize element_size, Int cnt) {
+    Void *res = 0;
+    if((cnt < 0) || (deserializer->end - deserializer->at < cnt)) {
+        deserializer->failed = true;
+    } else if((cnt) && (!deserializer->failed)) {
+        res = push_arena_size(deserializer->arena, element_size, cnt);
+        if(!res) {
+            deserializer->failed = true;
+        }
+    }
+
+    return(res);
+}
+
+// For arrays which were written straight out of memory.
+internal Void *deserialize_array(Deserializer *deserializer, PtrSize element_size, Int cnt) {
+    Void *res = allocate_array(deserializer, element_size, cnt);
+    if(res) {
+        deserialize_bytes(deserializer, res, element_size * cnt);
+    }
+
+    return(res);
+}
+
+// Null-terminated, though nothing relies on it.
+internal String deserialize_string(Deserializer *deserializer) {
+    String res = {};
+    deserialize_value(deserializer, res.len);
+
+    Char *e = 0;
+    if((res.len >= 0) && (deserializer->end - deserializer->at >= res.len) && (!deserializer->failed)) {
+        e = push_arena(deserializer->arena, Char, res.len + 1);
+    }
+
+    if(e) {
+        deserialize_bytes(deserializer, e, res.len);
+        res.e = e;
+    } else {
+        deserializer->failed = true;
+        res.len = 0;
+    }
+
+    return(res);
+}
+
+internal Void serialize_variable(Serializer *serializer, Variable *var) {
+    serialize_string(serializer, var->type);
+    serialize_string(serializer, var->name);
+    serialize_value(serializer, var->access);
+    serialize_value(serializer, var->ptr);
+    serialize_value(serializer, var->array_count);
+    serialize_value(serializer, var->anonymous_depth);
+    serialize_value(serializer, var->anonymous_opened);
+    serialize_value(serializer, var->anonymous_unions);
+    serialize_value(serializer, var->type_id);
+}
+
+internal Void deserialize_variable(Deserializer *deserializer, Variable *var) {
+    var->type = deserialize_string(deserializer);
+    var->name = deserialize_string(deserializer);
+    deserialize_value(deserializer, var->access);
+    deserialize_value(deserializer, var->ptr);
+    deserialize_value(deserializer, var->array_count);
+    deserialize_value(deserializer, var->anonymous_depth);
+    deserialize_value(deserializer, var->anonymous_opened);
+    deserialize_value(deserializer, var->anonymous_unions);
+    deserialize_value(deserializer, var->type_id);
+}
+
+// Bumped whenever the layout changes.
+#define parse_result_format_version 3
+
+Byte *serialize_parse_result(ParseResult *parse_res, PtrSize *size) {
+    Serializer serializer = {};
+    Serializer *s = &serializer;
+
+    Int version = parse_result_format_version;
+    serialize_value(s, version);
+
+    serialize_value(s, parse_res->struct_cnt);
+    for(Int i = 0; (i < parse_res->struct_cnt); ++i) {
+        StructData *sd = parse_res->struct_data + i;
+        serialize_string(s, sd->name);
+        serialize_value(s, sd->struct_type);
+        serialize_value(s, sd->member_count);
+        serialize_value(s, sd->first_member);
+        serialize_value(s, sd->name_id);
+        serialize_value(s, sd->inherited_count);
+        for(Int j = 0; (j < sd->inherited_count); ++j) {
+            serialize_string(s, sd->inherited[j]);
+            serialize_value(s, sd->inherited_ids[j]);
+        }
+    }
+
+    serialize_value(s, parse_res->enum_cnt);
+    for(Int i = 0; (i < parse_res->enum_cnt); ++i) {
+        EnumData *ed = parse_res->enum_data + i;
+        serialize_string(s, ed->name);
+        serialize_string(s, ed->type);
+        serialize_value(s, ed->is_struct);
+        serialize_value(s, ed->name_id);
+        serialize_value(s, ed->no_of_values);
+        for(Int j = 0; (j < ed->no_of_values); ++j) {
+            serialize_string(s, ed->values[j].name);
+            serialize_value(s, ed->values[j].value);
+        }
+    }
+
+    serialize_value(s, parse_res->func_cnt);
+    for(Int i = 0; (i < parse_res->func_cnt); ++i) {
+        FunctionData *fd = parse_res->func_data + i;
+        serialize_string(s, fd->linkage);
+        serialize_string(s, fd->return_type);
+        serialize_value(s, fd->return_type_ptr);
+        serialize_string(s, fd->name);
+        serialize_value(s, fd->param_cnt);
+        for(Int j = 0; (j < fd->param_cnt); ++j) {
+            serialize_variable(s, fd->params + j);
+        }
+    }
+
+    MemberTable *members = &parse_res->members;
+    serialize_value(s, members->cnt);
+    serialize_bytes(s, members->type_id, sizeof(*members->type_id) * members->cnt);
+    serialize_bytes(s, members->name_id, sizeof(*members->name_id) * members->cnt);
+    serialize_bytes(s, members->array_count, sizeof(*members->array_count) * members->cnt);
+    serialize_bytes(s, members->ptr, sizeof(*members->ptr) * members->cnt);
+    serialize_bytes(s, members->flags, sizeof(*members->flags) * members->cnt);
+    serialize_bytes(s, members->anonymous_unions, sizeof(*members->anonymous_unions) * members->cnt);
+
+    // Symbol 0 is unused, but written anyway so the IDs don't move.
+    SymbolTable *symbols = &parse_res->symbols;
+    serialize_value(s, symbols->cnt);
+    for(Int i = 0; (i < symbols->cnt); ++i) {
+        serialize_string(s, symbols->symbols[i].str);
+        serialize_value(s, symbols->symbols[i].hash);
+    }
+    serialize_value(s, symbols->slot_cnt);
+    serialize_bytes(s, symbols->slots, sizeof(*symbols->slots) * symbols->slot_cnt);
+
+    serialize_value(s, parse_res->include_cnt);
+    for(Int i = 0; (i < parse_res->include_cnt); ++i) {
+        serialize_string(s, parse_res->includes[i].name);
+        serialize_value(s, parse_res->includes[i].is_system);
+    }
+
+    serialize_value(s, parse_res->token_count);
+    serialize_value(s, parse_res->macro_expansion_count);
+
+    if(serializer.failed) {
+        system_free(serializer.e);
+        serializer.e = 0;
+        serializer.size = 0;
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    *size = serializer.size;
+
+    return(serializer.e);
+}
+
+internal Bool is_valid_symbol(SymbolTable *symbols, Int id) {
+    Bool res = ((id >= 0) && (id < symbols->cnt));
+
+    return(res);
+}
+
+Bool deserialize_parse_result(Byte const *data, PtrSize size, ParseResult *parse_res, MemoryArena *arena) {
+    Deserializer deserializer = { data, data + size, arena, false };
+    Deserializer *d = &deserializer;
+    zero(parse_res, sizeof(*parse_res));
+
+    Int version = 0;
+    deserialize_value(d, version);
+    if(version != parse_result_format_version) {
+        d->failed = true;
+    }
+
+    deserialize_value(d, parse_res->struct_cnt);
+    parse_res->struct_data = cast(StructData *)allocate_array(d, sizeof(StructData), parse_res->struct_cnt);
+    for(Int i = 0; (!d->failed) && (i < parse_res->struct_cnt); ++i) {
+        StructData *sd = parse_res->struct_data + i;
+        sd->name = deserialize_string(d);
+        deserialize_value(d, sd->struct_type);
+        deserialize_value(d, sd->member_count);
+        deserialize_value(d, sd->first_member);
+        deserialize_value(d, sd->name_id);
+        deserialize_value(d, sd->inherited_count);
+        sd->inherited = cast(String *)allocate_array(d, sizeof(String), sd->inherited_count);
+        sd->inherited_ids = cast(Int *)allocate_array(d, sizeof(Int), sd->inherited_count);
+        for(Int j = 0; (!d->failed) && (j < sd->inherited_count); ++j) {
+            sd->inherited[j] = deserialize_string(d);
+            deserialize_value(d, sd->inherited_ids[j]);
+        }
+    }
+
+    deserialize_value(d, parse_res->enum_cnt);
+    parse_res->enum_data = cast(EnumData *)allocate_array(d, sizeof(EnumData), parse_res->enum_cnt);
+    for(Int i = 0; (!d->failed) && (i < parse_res->enum_cnt); ++i) {
+        EnumData *ed = parse_res->enum_data + i;
+        ed->name = deserialize_string(d);
+        ed->type = deserialize_string(d);
+        deserialize_value(d, ed->is_struct);
+        deserialize_value(d, ed->name_id);
+        deserialize_value(d, ed->no_of_values);
+        ed->values = cast(EnumValue *)allocate_array(d, sizeof(EnumValue), ed->no_of_values);
+        for(Int j = 0; (!d->failed) && (j < ed->no_of_values); ++j) {
+            ed->values[j].name = deserialize_string(d);
+            deserialize_value(d, ed->values[j].value);
+        }
+    }
+
+    deserialize_value(d, parse_res->func_cnt);
+    parse_res->func_data = cast(FunctionData *)allocate_array(d, sizeof(FunctionData), parse_res->func_cnt);
+    for(Int i = 0; (!d->failed) && (i < parse_res->func_cnt); ++i) {
+        FunctionData *fd = parse_res->func_data + i;
+        fd->linkage = deserialize_string(d);
+        fd->return_type = deserialize_string(d);
+        deserialize_value(d, fd->return_type_ptr);
+        fd->name = deserialize_string(d);
+        deserialize_value(d, fd->param_cnt);
+        fd->params = cast(Variable *)allocate_array(d, sizeof(Variable), fd->param_cnt);
+        for(Int j = 0; (!d->failed) && (j < fd->param_cnt); ++j) {
+            deserialize_variable(d, fd->params + j);
+        }
+    }
+
+    MemberTable *members = &parse_res->members;
+    deserialize_value(d, members->cnt);
+    members->max = members->cnt;
+    members->type_id = cast(Int *)deserialize_array(d, sizeof(*members->type_id), members->cnt);
+    members->name_id = cast(Int *)deserialize_array(d, sizeof(*members->name_id), members->cnt);
+    members->array_count = cast(Int *)deserialize_array(d, sizeof(*members->array_count), members->cnt);
+    members->ptr = cast(Uint8 *)deserialize_array(d, sizeof(*members->ptr), members->cnt);
+    members->flags = cast(Uint8 *)deserialize_array(d, sizeof(*members->flags), members->cnt);
+    members->anonymous_unions = cast(Uint8 *)deserialize_array(d, sizeof(*members->anonymous_unions), members->cnt);
+
+    SymbolTable *symbols = &parse_res->symbols;
+    symbols->arena = arena;
+    deserialize_value(d, symbols->cnt);
+    symbols->max = symbols->cnt;
+    symbols->symbols = cast(Symbol *)allocate_array(d, sizeof(Symbol), symbols->cnt);
+    for(Int i = 0; (!d->failed) && (i < symbols->cnt); ++i) {
+        symbols->symbols[i].str = deserialize_string(d);
+        deserialize_value(d, symbols->symbols[i].hash);
+    }
+    deserialize_value(d, symbols->slot_cnt);
+    symbols->slots = cast(Int *)deserialize_array(d, sizeof(*symbols->slots), symbols->slot_cnt);
+
+    deserialize_value(d, parse_res->include_cnt);
+    parse_res->includes = cast(IncludeDirective *)allocate_array(d, sizeof(IncludeDirective), parse_res->include_cnt);
+    for(Int i = 0; (!d->failed) && (i < parse_res->include_cnt); ++i) {
+        parse_res->includes[i].name = deserialize_string(d);
+        deserialize_value(d, parse_res->includes[i].is_system);
+    }
+
+    deserialize_value(d, parse_res->token_count);
+    deserialize_value(d, parse_res->macro_expansion_count);
+
+    // Anything which refers to a member or symbol that isn't there means it's corrupt.
+    if((symbols->slot_cnt < 0) || (symbols->slot_cnt & (symbols->slot_cnt - 1))) {
+        d->failed = true;
+    }
+    for(Int i = 0; (!d->failed) && (i < symbols->slot_cnt); ++i) {
+        if(!is_valid_symbol(symbols, symbols->slots[i])) { d->failed = true; }
+    }
+    for(Int i = 0; (!d->failed) && (i < members->cnt); ++i) {
+        if((!is_valid_symbol(symbols, members->type_id[i])) || (!is_valid_symbol(symbols, members->name_id[i]))) {
+            d->failed = true;
+        }
+
+        // Can't open more anonymous structs than it's inside.
+        Int anonymous_depth = (members->flags[i] & MemberFlag_anonymous_depth_mask) >> MemberFlag_anonymous_depth_shift;
+        Int anonymous_opened = (members->flags[i] & MemberFlag_anonymous_opened_mask) >> MemberFlag_anonymous_opened_shift;
+        if(anonymous_opened > anonymous_depth) {
+            d->failed = true;
+        }
+    }
+    for(Int i = 0; (!d->failed) && (i < parse_res->struct_cnt); ++i) {
+        StructData *sd = parse_res->struct_data + i;
+        if((sd->first_member < 0) || (sd->member_count < 0) || (sd->first_member + sd->member_count > members->cnt) ||
+           (!is_valid_symbol(symbols, sd->name_id))) {
+            d->failed = true;
+        }
+
+        for(Int j = 0; (!d->failed) && (j < sd->inherited_count); ++j) {
+            if(!is_valid_symbol(symbols, sd->inherited_ids[j])) { d->failed = true; }
+        }
+    }
+    for(Int i = 0; (!d->failed) && (i < parse_res->enum_cnt); ++i) {
+        if(!is_valid_symbol(symbols, parse_res->enum_data[i].name_id)) { d->failed = true; }
+    }
 
-        system_free(macro_data);
+    Bool res = ((!d->failed) && (d->at == d->end));
+    if(!res) {
+        zero(parse_res, sizeof(*parse_res));
     }
 
     return(res);
 }
+#endif // !defined(LEXER_INCLUDED_FOR_INTERNALS)
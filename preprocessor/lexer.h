@@ -26,12 +26,17 @@ enum StructType {
 struct StructData {
     String name;
     Int member_count;
-    Variable *members;
+    Variable *members; // Only from parse_struct. parse_stream puts them in ParseResult::members instead.
+    Int first_member;
 
     Int inherited_count;
     String *inherited;
 
     StructType struct_type;
+
+    // From the file's SymbolTable.
+    Int name_id;
+    Int *inherited_ids;
 };
 
 struct EnumValue {
@@ -46,6 +51,8 @@ struct EnumData {
 
     EnumValue *values;
     Int no_of_values;
+
+    Int name_id;
 };
 
 struct FunctionData {
@@ -58,6 +65,36 @@ struct FunctionData {
     Int param_cnt;
 };
 
+// Every struct's members, one after the other, as columns. So a pass only pulls in the bits it needs, and the
+// members of one struct are right next to the ones of the next. A struct's members are the rows from first_member
+// to first_member + member_count.
+enum MemberFlag {
+    MemberFlag_access_mask = 0x3, // The Access.
+    MemberFlag_anonymous_depth_mask = 0x1C, // How many anonymous structs and unions it's inside.
+    MemberFlag_anonymous_depth_shift = 2,
+    MemberFlag_anonymous_opened_mask = 0xE0, // How many of those start at it, so two side by side stay apart.
+    MemberFlag_anonymous_opened_shift = 5,
+};
+
+const Int max_anonymous_depth = 7; // What fits in MemberFlag_anonymous_depth_mask.
+
+struct MemberTable {
+    Int cnt;
+    Int max;
+
+    Int *type_id; // IDs are from the file's SymbolTable.
+    Int *name_id;
+    Int *array_count;
+    Uint8 *ptr;
+    Uint8 *flags;
+    Uint8 *anonymous_unions; // Bit n is set if the anonymous aggregate n deep is a union, rather than a struct.
+};
+
+struct IncludeDirective {
+    String name; // Between the quotes or angle brackets.
+    Bool is_system; // <name> rather than "name".
+};
+
 struct ParseResult {
     Int enum_cnt;
     EnumData *enum_data;
@@ -67,9 +104,38 @@ struct ParseResult {
 
     Int func_cnt;
     FunctionData *func_data;
+
+    MemberTable members;
+
+    // Every struct name, member type and name, base class and enum name.
+    SymbolTable symbols;
+
+    // Every #include in a group that was compiled, in order. #include MACRO isn't supported.
+    IncludeDirective *includes;
+    Int include_cnt;
+
+    // For -p.
+    Int token_count;
+    Int macro_expansion_count;
 };
 
-ParseResult parse_stream(Char const *stream);
+// Macros (from -D) which every file starts with, for #if and friends. Each is "NAME" or "NAME=value". They aren't
+// copied, so have to stay around until the last file's parsed.
+Void set_predefined_macros(Char const **defines, Int cnt);
+
+// Everything in the result is allocated from arena, and points into stream.
+ParseResult parse_stream(Char const *stream, PtrSize size, MemoryArena *arena);
+
+// For caching results between runs. serialize_parse_result copies everything (including the strings) into one
+// buffer, which has to be freed with system_free. The deserialized result is allocated from arena, and doesn't point
+// into the buffer or the original stream. Returns false if data isn't a valid result.
+Byte *serialize_parse_result(ParseResult *parse_res, PtrSize *size);
+Bool deserialize_parse_result(Byte const *data, PtrSize size, ParseResult *res, MemoryArena *arena);
+
+// Combines several files' results into one, as if they'd been one file. Structs and enums with the same name are
+// only kept once (the first one wins). Everything in the result is allocated from arena, but still points into the
+// other results as well as the streams.
+ParseResult merge_parse_results(ParseResult *results, Int cnt, MemoryArena *arena);
 
 #define _LEXER_H
 #endif
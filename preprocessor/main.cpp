@@ -13,7 +13,9 @@
 #include "lexer.h"
 #include "platform.h"
 #include "write_file.h"
+#include "thread_pool.h"
 #include "test.h"
+#include "stb_sprintf.h"
 
 enum SwitchType {
     SwitchType_unknown,
@@ -25,21 +27,70 @@ enum SwitchType {
     SwitchType_version,
     SwitchType_source_file,
     SwitchType_set_dir,
+    SwitchType_thread_count,
+    SwitchType_force,
+    SwitchType_write_changed_only,
+    SwitchType_server,
+    SwitchType_client,
+    SwitchType_stop_server,
+    SwitchType_watch,
+    SwitchType_depfile,
+    SwitchType_depfile_name,
+    SwitchType_amalgamate,
+    SwitchType_profile,
+    SwitchType_trace,
+    SwitchType_define,
+    SwitchType_include_dir,
+    SwitchType_follow_includes,
 
     SwitchType_count,
 };
 
+// Matches --name, or --name=value.
+internal Bool is_long_switch(Char const *str, Char const *name) {
+    Int len = string_length(name);
+    Bool res = (string_compare(str + 2, name, len)) && ((str[len + 2] == 0) || (str[len + 2] == '='));
+
+    return(res);
+}
+
+// The value in --name=value, or null if there isn't one.
+internal Char const *get_long_switch_value(Char const *str) {
+    Int pos = string_contains_pos(str, "=");
+    Char const *res = (pos != -1) ? str + pos + 1 : 0;
+
+    return(res);
+}
+
 internal SwitchType get_switch_type(Char const *str) {
     SwitchType res = SwitchType_unknown;
 
     Int len = string_length(str);
     if(len >= 2) {
-        if(str[0] == '-') {
+        if((str[0] == '-') && (str[1] == '-')) {
+            if(is_long_switch(str, "server"))               { res = SwitchType_server;          }
+            else if(is_long_switch(str, "client"))          { res = SwitchType_client;          }
+            else if(is_long_switch(str, "stop-server"))     { res = SwitchType_stop_server;     }
+            else if(is_long_switch(str, "watch"))           { res = SwitchType_watch;           }
+            else if(is_long_switch(str, "amalgamate"))      { res = SwitchType_amalgamate;      }
+            else if(is_long_switch(str, "trace"))           { res = SwitchType_trace;           }
+            else if(is_long_switch(str, "follow-includes")) { res = SwitchType_follow_includes; }
+        } else if(str[0] == '-') {
             switch(str[1]) {
                 case 'e': { res = SwitchType_log_errors;         } break;
                 case 'h': { res = SwitchType_print_help;         } break;
                 case 'd': { res = SwitchType_set_dir;            } break;
                 case 'v': { res = SwitchType_version;            } break;
+                case 'j': { res = SwitchType_thread_count;       } break;
+                case 'f': { res = SwitchType_force;              } break;
+                case 'u': { res = SwitchType_write_changed_only; } break;
+                case 'p': { res = SwitchType_profile;            } break;
+                case 'D': { res = SwitchType_define;             } break;
+                case 'I': { res = SwitchType_include_dir;        } break;
+                case 'M': {
+                    if(str[2] == 'D')      { res = SwitchType_depfile;      }
+                    else if(str[2] == 'F') { res = SwitchType_depfile_name; }
+                } break;
 #if INTERNAL
                 case 's': { res = SwitchType_silent;    } break;
                 case 't': { res = SwitchType_run_tests; } break;
@@ -58,6 +109,26 @@ internal SwitchType get_switch_type(Char const *str) {
     return(res);
 }
 
+internal Bool should_only_write_changed_files = false;
+internal Int volatile global_unchanged_file_count = 0;
+internal Bool global_resident_mode = false; // --server or --watch, so the same process runs lots of command lines.
+
+internal Bool write_generated_file(Char const *fname, FileChunk *chunks, Int chunk_count) {
+    Bool res = false;
+
+    if(should_only_write_changed_files) {
+        Bool unchanged = false;
+        res = system_write_chunks_to_file_if_changed(fname, chunks, chunk_count, &unchanged);
+        if(unchanged) {
+            system_atomic_add(&global_unchanged_file_count, 1);
+        }
+    } else {
+        res = system_write_chunks_to_file(fname, chunks, chunk_count);
+    }
+
+    return(res);
+}
+
 internal Bool write_static_file() {
     Char const *file =
         "//\n"
@@ -326,8 +397,15 @@ internal Bool write_static_file() {
         "#endif // !defined(STATIC_GENERATED_H)\n"
         "\n";
 
-    Int static_file_len = string_length(file);
-    Bool res = system_write_to_file(dir_name "/static_generated.h", file, static_file_len);
+    FileChunk chunk = { file, cast(PtrSize)string_length(file) };
+    Bool res = false;
+    if(global_resident_mode) {
+        // Every request would rewrite it otherwise, and it's almost always the same.
+        Bool unchanged = false;
+        res = system_write_chunks_to_file_if_changed(dir_name "/static_generated.h", &chunk, 1, &unchanged);
+    } else {
+        res = write_generated_file(dir_name "/static_generated.h", &chunk, 1);
+    }
 
     if(!res) {
         push_error(ErrorType_could_not_write_to_disk);
@@ -337,160 +415,1978 @@ internal Bool write_static_file() {
 }
 
 internal Bool should_write_to_file = false;
+internal Bool should_use_cache = false;
+
+// Turns foo.cpp into pp_generated/foo_generated.h.
+internal Bool get_generated_file_name(Char const *fname, Char *buf, Int buf_size) {
+    Char const *generated_folder = dir_name "/";
+    Int start = string_length(generated_folder);
+    Char const *generated_extension = "_generated.h";
+
+    Bool res = string_concat(buf, buf_size, generated_folder, start, "", 0);
+    if(res) {
+        // Add _generated.h to the filename.
+        res = string_concat(buf + start, buf_size - start,
+                            fname, string_length(fname) - 4, // TODO(Jonny): Hacky, actually detect the extension properly.
+                            generated_extension, string_length(generated_extension));
+    }
+
+    return(res);
+}
+
+//
+// Depfiles.
+//
+// A make rule, so Ninja and make know to regenerate foo_generated.h if foo.cpp, or the preprocessor itself, changes.
+internal Bool should_write_depfile = false;
+internal Char const *global_depfile_name = 0; // From -MF, otherwise it goes next to the generated file.
+internal Char global_executable_path[1024] = {};
+
+// Spaces and #s are backslash escaped, and $s doubled, which both make and Ninja understand.
+internal Void append_depfile_path(Char *buf, Int buf_size, Int *len, Char const *path, Bool escape = true) {
+    for(Char const *at = path; (*at) && (*len + 2 < buf_size); ++at) {
+        if(escape) {
+            if((*at == ' ') || (*at == '#')) { buf[(*len)++] = '\\'; }
+            else if(*at == '$')              { buf[(*len)++] = '$';  }
+        }
+
+        buf[(*len)++] = *at;
+    }
+}
+
+internal Bool get_depfile_name(Char const *generated_file_name, Char *buf, Int buf_size) {
+    Bool res = false;
+
+    if(global_depfile_name) {
+        res = string_concat(buf, buf_size, global_depfile_name, string_length(global_depfile_name), "", 0);
+    } else {
+        // foo_generated.h -> foo_generated.d
+        Int len = string_length(generated_file_name);
+        res = string_concat(buf, buf_size, generated_file_name, len - 1, "d", 1);
+    }
+
+    return(res);
+}
+
+internal Void write_depfile(Char const *generated_file_name, Char const **fnames, Int fname_count) {
+    PtrSize const name_len = 256;
+    Char depfile_name[name_len] = {};
+
+    // From scratch rather than the stack, because with --amalgamate it can list a lot of files.
+    MemoryArena *scratch = get_thread_scratch_arena();
+    TempMemory depfile_memory = begin_temp_memory(scratch);
+
+    Int const buf_size = 64 * 1024;
+    Char *buf = push_arena(scratch, Char, buf_size);
+    if(buf) {
+        Int len = 0;
+
+        append_depfile_path(buf, buf_size, &len, generated_file_name);
+        append_depfile_path(buf, buf_size, &len, ":", false);
+        for(Int i = 0; (i < fname_count); ++i) {
+            append_depfile_path(buf, buf_size, &len, " ", false);
+            append_depfile_path(buf, buf_size, &len, fnames[i]);
+        }
+
+        if(global_executable_path[0]) {
+            append_depfile_path(buf, buf_size, &len, " ", false);
+            append_depfile_path(buf, buf_size, &len, global_executable_path);
+        }
+
+        append_depfile_path(buf, buf_size, &len, "\n", false);
+
+        if((!get_depfile_name(generated_file_name, depfile_name, name_len)) ||
+           (!system_write_to_file(depfile_name, buf, len))) {
+            push_error(ErrorType_could_not_write_to_disk);
+        }
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    end_temp_memory(depfile_memory);
+}
+
+internal Bool has_depfile(Char const *source_name) {
+    PtrSize const len = 256;
+    Char generated_file_name[len] = {};
+    Char depfile_name[len] = {};
+    Bool res = ((get_generated_file_name(source_name, generated_file_name, len)) &&
+                (get_depfile_name(generated_file_name, depfile_name, len)) && (system_file_exists(depfile_name)));
+
+    return(res);
+}
+
+// The depfile's missing if -MD wasn't passed last time a file was generated.
+internal Void write_missing_depfile(Char const *source_name, Char const **fnames, Int fname_count) {
+    PtrSize const len = 256;
+    Char generated_file_name[len] = {};
+    if((!has_depfile(source_name)) && (get_generated_file_name(source_name, generated_file_name, len))) {
+        write_depfile(generated_file_name, fnames, fname_count);
+    }
+}
+
+//
+// Profiling.
+//
+// With -p every file's phases are timed, and what it found is counted. When it's off all this costs is a branch
+// around each phase, so it's left in release builds.
+internal Bool should_profile = false;
+
+enum ProfilePhase {
+    ProfilePhase_read, // Mapping the file, and checking the cache.
+    ProfilePhase_parse,
+    ProfilePhase_emit, // write_data.
+    ProfilePhase_write, // The generated file, depfile, and cache stamp.
+
+    ProfilePhase_count,
+};
+
+struct FileProfile {
+    Char const *file_name;
+    Bool was_generated; // Otherwise it was up to date.
+
+    Uint64 phase[ProfilePhase_count]; // In performance counts.
+
+    Int token_count;
+    Int macro_expansion_count;
+    Int struct_count;
+    Int enum_count;
+    Int member_count;
+    PtrSize bytes_emitted;
+
+    // While write_data waits on its sections the thread can run another file, which counts towards these as well.
+    PtrSize peak_arena_size;
+    PtrSize peak_scratch_size;
+};
+
+internal Uint64 begin_profile_phase(void) {
+    Uint64 res = (should_profile) ? system_get_performance_counter() : 0;
+
+    return(res);
+}
+
+internal Void end_profile_phase(FileProfile *profile, ProfilePhase phase, Uint64 start) {
+    if((should_profile) && (profile)) {
+        profile->phase[phase] += system_get_performance_counter() - start;
+    }
+}
+
+internal Void begin_profile_memory(MemoryArena *arena, MemoryArena *scratch) {
+    if(should_profile) {
+        arena->peak_size = arena->total_size;
+        scratch->peak_size = scratch->total_size;
+    }
+}
+
+internal Void end_profile_memory(FileProfile *profile, MemoryArena *arena, MemoryArena *scratch) {
+    if((should_profile) && (profile)) {
+        profile->peak_arena_size += arena->peak_size;
+        if(scratch->peak_size > profile->peak_scratch_size) {
+            profile->peak_scratch_size = scratch->peak_size;
+        }
+    }
+}
+
+internal Uint64 profile_to_microseconds(Uint64 counts) {
+    Uint64 res = (counts * 1000000) / system_get_performance_frequency();
+
+    return(res);
+}
+
+internal Void print_file_profile(FileProfile *profile) {
+    if(profile->was_generated) {
+        system_write_to_console("%s: read %llu us, parse %llu us, emit %llu us, write %llu us | %d tokens, %d macros expanded, "
+                                "%d structs, %d enums, %d members, %llu bytes emitted | peak arena %llu KB, peak scratch %llu KB\n",
+                                profile->file_name,
+                                cast(unsigned long long)profile_to_microseconds(profile->phase[ProfilePhase_read]),
+                                cast(unsigned long long)profile_to_microseconds(profile->phase[ProfilePhase_parse]),
+                                cast(unsigned long long)profile_to_microseconds(profile->phase[ProfilePhase_emit]),
+                                cast(unsigned long long)profile_to_microseconds(profile->phase[ProfilePhase_write]),
+                                profile->token_count, profile->macro_expansion_count, profile->struct_count,
+                                profile->enum_count, profile->member_count, cast(unsigned long long)profile->bytes_emitted,
+                                cast(unsigned long long)(profile->peak_arena_size / 1024),
+                                cast(unsigned long long)(profile->peak_scratch_size / 1024));
+    } else {
+        system_write_to_console("%s: up to date, read %llu us, write %llu us\n",
+                                profile->file_name,
+                                cast(unsigned long long)profile_to_microseconds(profile->phase[ProfilePhase_read]),
+                                cast(unsigned long long)profile_to_microseconds(profile->phase[ProfilePhase_write]));
+    }
+}
+
+// Times are added up across threads, so with -j they can come to more than the total time. Peaks are the biggest.
+internal Void add_file_profile(FileProfile *total, FileProfile *profile) {
+    total->was_generated |= profile->was_generated;
+
+    for(Int i = 0; (i < ProfilePhase_count); ++i) {
+        total->phase[i] += profile->phase[i];
+    }
+
+    total->token_count += profile->token_count;
+    total->macro_expansion_count += profile->macro_expansion_count;
+    total->struct_count += profile->struct_count;
+    total->enum_count += profile->enum_count;
+    total->member_count += profile->member_count;
+    total->bytes_emitted += profile->bytes_emitted;
 
-internal Void start_parsing(Char const *fname, Char const *file) {
-    ParseResult parse_res = parse_stream(file);
+    if(profile->peak_arena_size > total->peak_arena_size)     { total->peak_arena_size = profile->peak_arena_size;     }
+    if(profile->peak_scratch_size > total->peak_scratch_size) { total->peak_scratch_size = profile->peak_scratch_size; }
+}
+
+// fnames are the source files parse_res came from, for the depfile. See write_data for lookup_struct_count.
+internal Void write_parse_result(Char const *fname, ParseResult *parse_res, Int lookup_struct_count, Char const **fnames,
+                                 Int fname_count, MemoryArena *arena, FileProfile *profile) {
+    Uint64 emit_start = begin_profile_phase();
+    trace_begin("write_data");
+    OutputBuffer ob = write_data(fname, parse_res->struct_data, parse_res->struct_cnt,
+                                 parse_res->enum_data, parse_res->enum_cnt,
+                                 parse_res->func_data, parse_res->func_cnt,
+                                 &parse_res->members, &parse_res->symbols, arena, lookup_struct_count);
+    trace_end();
+    end_profile_phase(profile, ProfilePhase_emit, emit_start);
 
-    File file_to_write = write_data(fname, parse_res.struct_data, parse_res.struct_cnt,
-                                    parse_res.enum_data, parse_res.enum_cnt,
-                                    parse_res.func_data, parse_res.func_cnt);
+    if((should_profile) && (profile)) {
+        profile->was_generated = true;
+        profile->token_count += parse_res->token_count;
+        profile->macro_expansion_count += parse_res->macro_expansion_count;
+        profile->struct_count += parse_res->struct_cnt;
+        profile->enum_count += parse_res->enum_cnt;
+        profile->member_count += parse_res->members.cnt;
+        profile->bytes_emitted += ob.total_size;
+    }
 
+    Uint64 write_start = begin_profile_phase();
+    trace_begin("write");
     if(should_write_to_file) {
         PtrSize const len = 256;
-        Char generated_file_name[len] = dir_name "/"; // TODO(Jonny): MAX_PATH?
-        Int start = string_length(dir_name "/");
-        Char const *generated_extension = "_generated.h";
+        Char generated_file_name[len] = {}; // TODO(Jonny): MAX_PATH?
+        FileChunk *chunks = push_arena(arena, FileChunk, ob.chunk_count);
+        if((chunks) && (get_generated_file_name(fname, generated_file_name, len))) {
+            get_output_chunks(&ob, chunks);
 
-        // Add _generated.h to the filename.
-        if(string_concat(generated_file_name + start, len - start,
-                         fname, string_length(fname) - 4, // TODO(Jonny): Hacky, actually detect the extension properly.
-                         generated_extension, string_length(generated_extension))) {
-            Bool header_write_success = system_write_to_file(generated_file_name, file_to_write.data, file_to_write.size);
+            Bool header_write_success = write_generated_file(generated_file_name, chunks, ob.chunk_count);
             if(!header_write_success) {
                 push_error(ErrorType_could_not_write_to_disk);
+            } else if(should_write_depfile) {
+                write_depfile(generated_file_name, fnames, fname_count);
             }
-
-            system_free(file_to_write.data);
         }
     }
+    trace_end();
+    end_profile_phase(profile, ProfilePhase_write, write_start);
+}
+
+//
+// Cache.
+//
+// Every source file gets a stamp in cache_dir_name, named after a hash of the file's name. The stamp holds a hash of
+// the file's contents, seeded with the version of the preprocessor that generated it. So if the stamp matches, and
+// the generated file is still there, there's nothing to do.
+//
+// When #includes are followed, the stamp also lists every header the file pulled in, with a hash of each one's
+// contents, so editing a header regenerates everything which included it.
+internal Uint64 global_cache_seed = 0;
+internal Bool should_follow_includes = false;
+
+internal Void get_cache_stamp_name(Char const *fname, Char *buf, Int buf_size) {
+    Uint64 name_hash = hash_bytes(fname, string_length(fname));
+    stbsp_snprintf(buf, buf_size, cache_dir_name "/%016llx", cast(unsigned long long)name_hash);
+}
+
+// With --server or --watch the stamps are kept in memory as well, so a file which hasn't changed never has its stamp read. Every
+// request can come from a different folder, so the names are hashed with the working directory as the seed.
+struct MemoryCacheEntry {
+    Uint64 name_hash; // 0 for an empty slot.
+    Uint64 key;
+};
+
+// Open addressing with linear probing, max is always a power of two.
+struct MemoryCache {
+    MemoryCacheEntry *e;
+    Int cnt;
+    Int max;
 
-    for(Int i = 0; (i < parse_res.struct_cnt); ++i) {
-        system_free(parse_res.struct_data[i].members);
-        system_free(parse_res.struct_data[i].inherited);
+    Int volatile lock; // Files are checked from the thread pool.
+};
+
+internal MemoryCache global_memory_cache = {};
+internal Uint64 global_working_directory_hash = 0;
+
+internal Uint64 get_memory_cache_name_hash(Char const *fname) {
+    Uint64 res = hash_bytes(fname, string_length(fname), global_working_directory_hash);
+    if(!res) {
+        res = 1;
     }
-    system_free(parse_res.struct_data);
 
-    for(Int i = 0; (i < parse_res.enum_cnt); ++i) {
-        system_free(parse_res.enum_data[i].values);
+    return(res);
+}
+
+// Must be called with the lock held.
+internal MemoryCacheEntry *find_memory_cache_slot(MemoryCache *cache, Uint64 name_hash) {
+    Int mask = cache->max - 1;
+    Int index = cast(Int)(name_hash & mask);
+
+    MemoryCacheEntry *res = cache->e + index;
+    while((res->name_hash) && (res->name_hash != name_hash)) {
+        index = (index + 1) & mask;
+        res = cache->e + index;
     }
-    system_free(parse_res.enum_data);
 
-    for(Int i = 0; (i < parse_res.func_cnt); ++i) {
-        system_free(parse_res.func_data[i].params);
+    return(res);
+}
+
+internal Bool get_memory_cache_key(Char const *fname, Uint64 *key) {
+    Bool res = false;
+
+    MemoryCache *cache = &global_memory_cache;
+    Uint64 name_hash = get_memory_cache_name_hash(fname);
+
+    system_lock(&cache->lock);
+    if(cache->e) {
+        MemoryCacheEntry *entry = find_memory_cache_slot(cache, name_hash);
+        if(entry->name_hash) {
+            *key = entry->key;
+            res = true;
+        }
     }
-    system_free(parse_res.func_data);
+    system_unlock(&cache->lock);
+
+    return(res);
 }
 
-internal Void print_help(void) {
-    Char const *help = "    List of Commands.\n"
-                       "        -e - Print errors to the console.\n"
-                       "        -h - Print this help.\n"
-#if INTERNAL
-                       "    Internal Commands.\n"
-                       "        -s - Do not output any code, just see if there were errors parsing a file.\n"
-                       "        -t - Run tests on the code.\n"
-#endif
-                       "\n";
+internal Void set_memory_cache_key(Char const *fname, Uint64 key) {
+    MemoryCache *cache = &global_memory_cache;
+    Uint64 name_hash = get_memory_cache_name_hash(fname);
 
-    system_write_to_console(help);
+    system_lock(&cache->lock);
+
+    // Keep it at most half full.
+    if(cache->cnt + 1 >= cache->max / 2) {
+        Int new_max = (cache->max) ? cache->max * 2 : 1024;
+        MemoryCacheEntry *new_e = system_alloc(MemoryCacheEntry, new_max);
+        if(new_e) {
+            zero(new_e, sizeof(MemoryCacheEntry) * new_max);
+
+            MemoryCache new_cache = { new_e, cache->cnt, new_max };
+            for(Int i = 0; (i < cache->max); ++i) {
+                if(cache->e[i].name_hash) {
+                    *find_memory_cache_slot(&new_cache, cache->e[i].name_hash) = cache->e[i];
+                }
+            }
+
+            system_free(cache->e);
+            cache->e = new_e;
+            cache->max = new_max;
+        }
+    }
+
+    if((cache->e) && (cache->cnt + 1 < cache->max)) {
+        MemoryCacheEntry *entry = find_memory_cache_slot(cache, name_hash);
+        if(!entry->name_hash) {
+            entry->name_hash = name_hash;
+            ++cache->cnt;
+        }
+
+        entry->key = key;
+    }
+
+    system_unlock(&cache->lock);
 }
 
-Int main(Int argc, Char **argv) {// TODO(Jonny): Support wildcards.
-    system_get_file_extension("test_code.cpp");
+internal Uint64 hash_header_file(Char const *fname, Bool *found) {
+    Uint64 res = 0;
 
-    Int res = 0;
+    File file = system_map_file(fname);
+    *found = (file.data != 0);
+    if(file.data) {
+        res = hash_bytes(file.data, file.size, global_cache_seed);
+        system_unmap_file(&file);
+    }
 
-    if(argc <= 1) {
-        push_error(ErrorType_no_parameters);
-        print_help();
-    } else {
-        Bool should_log_errors = true;
-        Bool should_run_tests = false;
-        should_write_to_file = true;
+    return(res);
+}
 
-        PtrSize largest_source_file_size = 0;
-        Int number_of_files = 0;
-        for(Int i = 1; (i < argc); ++i) {
-            Char const *switch_name = argv[i];
+// The header list is a count, then for each header its hash, the length of its name, and the name.
+internal Bool are_stamp_headers_unchanged(Byte const *at, PtrSize size) {
+    Byte const *end = at + size;
 
-            SwitchType type = get_switch_type(switch_name);
-            switch(type) {
-                case SwitchType_silent:             { should_write_to_file = false;               } break;
-                case SwitchType_log_errors:         { should_log_errors = true;                   } break;
-                case SwitchType_run_tests:          { should_run_tests = true;                    } break;
-                case SwitchType_print_help:         { print_help();                               } break;
-                case SwitchType_set_dir:            { system_set_current_folder(switch_name + 2); } break;
-                case SwitchType_version:            { system_write_to_console("Version: 1.0");    } break;
-
-                case SwitchType_source_file: {
-                    if(!string_contains(switch_name, dir_name)) {
-                        PtrSize file_size = system_get_file_size(switch_name);
-                        if(!file_size) {
-                            push_error(ErrorType_cannot_find_file);
-                        } else {
-                            ++number_of_files;
-
-                            if(file_size > largest_source_file_size) {
-                                largest_source_file_size = file_size + 1; // We read the nul-terminator, so this has to be one greater.
-                            }
-                        }
-                    }
-                } break;
+    Int header_cnt = 0;
+    Bool res = (size >= sizeof(header_cnt));
+    if(res) {
+        copy(&header_cnt, cast(Void *)at, sizeof(header_cnt));
+        at += sizeof(header_cnt);
+    }
 
-                default: {
-                    system_write_to_console("Unknown argument %s", switch_name);
-                } break;
+    PtrSize const name_len = 256;
+    Char name[name_len] = {};
+    for(Int i = 0; (res) && (i < header_cnt); ++i) {
+        Uint64 stored_hash = 0;
+        Int len = 0;
+        if(end - at < sizeof(stored_hash) + sizeof(len)) {
+            res = false;
+        } else {
+            copy(&stored_hash, cast(Void *)at, sizeof(stored_hash));
+            copy(&len, cast(Void *)(at + sizeof(stored_hash)), sizeof(len));
+            at += sizeof(stored_hash) + sizeof(len);
+
+            if((len < 0) || (len >= name_len) || (end - at < len)) {
+                res = false;
+            } else {
+                copy(name, cast(Void *)at, len);
+                name[len] = 0;
+                at += len;
+
+                Bool found = false;
+                Uint64 hash = hash_header_file(name, &found);
+                res = ((found) && (hash == stored_hash));
             }
         }
+    }
 
-        if(should_run_tests) {
-#if RUN_TESTS
-            Int run_tests(void);
-            res = run_tests();
-#endif
+    if(at != end) {
+        res = false;
+    }
+
+    return(res);
+}
+
+internal Bool is_up_to_date(Char const *fname, Uint64 key) {
+    Bool res = false;
+
+    PtrSize const len = 256;
+    Char generated_file_name[len] = {};
+    if((get_generated_file_name(fname, generated_file_name, len)) && (system_file_exists(generated_file_name))) {
+        Uint64 stored_key = 0;
+
+        // Only the file's own key's kept in memory, so when headers count the stamp always has to be read.
+        if((global_resident_mode) && (!should_follow_includes) && (get_memory_cache_key(fname, &stored_key))) {
+            res = (stored_key == key);
         } else {
-            if(!number_of_files) {
-                push_error(ErrorType_no_files_pass_in);
-            } else {
-                Byte *file_memory = system_alloc(Byte, largest_source_file_size);
-                if(file_memory) {
-                    // Write static file to disk.
-                    if(should_write_to_file) {
-                        Bool create_folder_success = system_create_folder(dir_name);
-
-                        if(!create_folder_success) { push_error(ErrorType_could_not_create_directory); }
-                        else                       { write_static_file();                              }
-                    }
+            Char stamp_name[len] = {};
+            get_cache_stamp_name(fname, stamp_name, len);
 
-                    // Parse files
-                    for(Int i = 1; (i < argc); ++i) {
-                        Char const *file_name = argv[i];
-                        zero(file_memory, largest_source_file_size);
+            File stamp = system_map_file(stamp_name);
+            if(stamp.data) {
+                if(stamp.size >= sizeof(key)) {
+                    copy(&stored_key, stamp.data, sizeof(stored_key));
+                    res = (stored_key == key);
 
-                        SwitchType type = get_switch_type(file_name);
-                        if(type == SwitchType_source_file) {
-                            File file = system_read_entire_file_and_null_terminate(file_name, file_memory);
+                    if(should_follow_includes) {
+                        res = ((res) && (are_stamp_headers_unchanged(cast(Byte *)stamp.data + sizeof(key),
+                                                                     stamp.size - sizeof(key))));
+                    } else if(stamp.size != sizeof(key)) {
+                        res = false;
+                    }
 
-                            if(file.data) { start_parsing(file_name, file.data);       }
-                            else          { push_error(ErrorType_could_not_load_file); }
-                        }
+                    if((res) && (global_resident_mode) && (!should_follow_includes)) {
+                        set_memory_cache_key(fname, key);
                     }
+                }
+
+                system_unmap_file(&stamp);
+            }
+        }
+
+        // The headers are only known once it's parsed, so a missing depfile can't be written without parsing it.
+        if((res) && (should_follow_includes) && (should_write_depfile) && (!has_depfile(fname))) {
+            res = false;
+        }
+    }
+
+    return(res);
+}
+
+// header_names and header_hashes are the headers the file included, when they're being followed.
+internal Void write_cache_stamp(Char const *fname, Uint64 key, Char const **header_names = 0,
+                                Uint64 *header_hashes = 0, Int header_cnt = 0) {
+    PtrSize const len = 256;
+    Char stamp_name[len] = {};
+    get_cache_stamp_name(fname, stamp_name, len);
+
+    if(!should_follow_includes) {
+        // Not an error if this fails, we'll just regenerate the file next time.
+        system_write_to_file(stamp_name, cast(Char const *)&key, sizeof(key));
+
+        if(global_resident_mode) {
+            set_memory_cache_key(fname, key);
+        }
+    } else {
+        MemoryArena *scratch = get_thread_scratch_arena();
+        TempMemory stamp_memory = begin_temp_memory(scratch);
+
+        PtrSize size = sizeof(key) + sizeof(header_cnt);
+        for(Int i = 0; (i < header_cnt); ++i) {
+            size += sizeof(*header_hashes) + sizeof(Int) + string_length(header_names[i]);
+        }
+
+        Byte *buf = push_arena(scratch, Byte, size);
+        if(buf) {
+            Byte *at = buf;
+            copy(at, &key, sizeof(key));               at += sizeof(key);
+            copy(at, &header_cnt, sizeof(header_cnt)); at += sizeof(header_cnt);
+            for(Int i = 0; (i < header_cnt); ++i) {
+                Int name_len = string_length(header_names[i]);
+                copy(at, header_hashes + i, sizeof(*header_hashes)); at += sizeof(*header_hashes);
+                copy(at, &name_len, sizeof(name_len));               at += sizeof(name_len);
+                copy(at, cast(Void *)header_names[i], name_len);     at += name_len;
+            }
+
+            system_write_to_file(stamp_name, cast(Char const *)buf, size);
+        }
+
+        end_temp_memory(stamp_memory);
+    }
+}
+
+//
+// Following #includes.
+//
+// With -I or --follow-includes, any header a file #includes (that can be found) is parsed too, so its structs can be
+// used as the file's base classes and member types. No code's generated for them, that's left to whichever file
+// defines them, so two files including the same header don't both define it. Each header's parsed once per run, however
+// many files include it, and with the cache on the result's saved in cache_dir_name, so later runs don't parse it at
+// all until it changes. Headers are parsed on their own, so only -D macros are defined in them, not anything the file
+// including them #defined first.
+internal Char const **global_include_dirs = 0;
+internal Int global_include_dir_count = 0;
+
+struct Header {
+    Char path[256];
+    Uint64 path_hash; // Seeded with the working directory, because --server runs can be from anywhere.
+    Uint64 content_hash;
+    Bool found;
+    Int run; // The last run it was checked in.
+
+    // The parse result points into file, so it stays mapped for as long as the header's cached.
+    File file;
+    MemoryArena arena;
+    ParseResult parse_res;
+
+    // 1 until whichever thread's parsing it is done. Anyone else wanting it waits on this like a job counter, so they
+    // run other jobs rather than spinning.
+    Int volatile loading;
+};
+
+// Open addressing with linear probing, max is always a power of two. The Headers themselves never move, so they can
+// be used after the lock's released.
+//
+// With --server or --watch the headers are kept from run to run, and each one's only parsed again if it changed. The
+// parse results can point into the -D values, which only last as long as the run, so the cache keeps its own copy, and
+// is emptied when they change.
+struct HeaderCache {
+    Header **e;
+    Int cnt;
+    Int max;
+
+    Int volatile lock;
+
+    Int run;
+    Uint64 defines_hash;
+    Char const **defines;
+};
+
+internal HeaderCache global_header_cache = {};
+
+// Turns \s into /s, and takes out "./", "dir/../" and doubled /s, so the same header reached from two different
+// places is only parsed once.
+internal Void normalize_path(Char *path) {
+    Int len = string_length(path);
+    for(Int i = 0; (i < len); ++i) {
+        if(path[i] == '\\') {
+            path[i] = '/';
+        }
+    }
+
+    Int const max_segments = 128;
+    Int segment_starts[max_segments] = {}; // Where each segment kept so far starts in the output, including its /.
+    Bool segment_is_parent[max_segments] = {};
+    Int segment_cnt = 0;
 
-                    system_free(file_memory);
+    // The output's never longer than what's been read, so it can be written in place.
+    Int out_len = (path[0] == '/') ? 1 : 0;
+    Int at = out_len;
+    while(at < len) {
+        Int start = at;
+        while((at < len) && (path[at] != '/')) {
+            ++at;
+        }
+
+        Int segment_len = at - start;
+        ++at;
+
+        Bool is_current = ((segment_len == 1) && (path[start] == '.'));
+        Bool is_parent = ((segment_len == 2) && (path[start] == '.') && (path[start + 1] == '.'));
+        if((segment_len) && (!is_current)) {
+            if((is_parent) && (segment_cnt) && (segment_cnt < max_segments) && (!segment_is_parent[segment_cnt - 1])) {
+                out_len = segment_starts[--segment_cnt];
+            } else {
+                if(segment_cnt < max_segments) {
+                    segment_starts[segment_cnt] = out_len;
+                    segment_is_parent[segment_cnt] = is_parent;
+                }
+                ++segment_cnt;
+
+                if((out_len) && (path[out_len - 1] != '/')) {
+                    path[out_len++] = '/';
+                }
+
+                for(Int i = 0; (i < segment_len); ++i) {
+                    path[out_len++] = path[start + i];
                 }
             }
+        }
+    }
+
+    path[out_len] = 0;
+}
 
-            free_scratch_memory();
+// Quoted #includes look next to the file including them first, then in the -I folders. <> ones only look in the -I
+// folders, so the standard headers are left alone unless they've been asked for.
+internal Bool find_include(Char const *includer, IncludeDirective *include, Char *buf, Int buf_size) {
+    Bool res = false;
+
+    if(!include->is_system) {
+        Int dir_len = 0;
+        for(Int i = 0; (includer[i]); ++i) {
+            if((includer[i] == '/') || (includer[i] == '\\')) {
+                dir_len = i + 1;
+            }
         }
 
-        // Output errors.
-        if(should_log_errors) {
-            if(print_errors()) {
-                res = 255;
+        Int len = stbsp_snprintf(buf, buf_size, "%.*s%.*s", dir_len, includer, include->name.len, include->name.e);
+        res = ((len < buf_size) && (system_file_exists(buf)));
+    }
+
+    for(Int i = 0; (!res) && (i < global_include_dir_count); ++i) {
+        Int len = stbsp_snprintf(buf, buf_size, "%s/%.*s", global_include_dirs[i], include->name.len, include->name.e);
+        res = ((len < buf_size) && (system_file_exists(buf)));
+    }
+
+    if(res) {
+        normalize_path(buf);
+    }
+
+    return(res);
+}
+
+internal Void get_header_cache_name(Header *header, Char *buf, Int buf_size) {
+    Uint64 name_hash = hash_bytes(header->path, string_length(header->path));
+    stbsp_snprintf(buf, buf_size, cache_dir_name "/%016llx.header", cast(unsigned long long)name_hash);
+}
+
+// The cached header is its content hash, followed by the serialized ParseResult.
+internal Bool read_header_cache(Header *header) {
+    Bool res = false;
+
+    PtrSize const len = 256;
+    Char cache_name[len] = {};
+    get_header_cache_name(header, cache_name, len);
+
+    File cached = system_map_file(cache_name);
+    if(cached.data) {
+        Uint64 content_hash = 0;
+        if(cached.size >= sizeof(content_hash)) {
+            copy(&content_hash, cached.data, sizeof(content_hash));
+            if(content_hash == header->content_hash) {
+                res = deserialize_parse_result(cast(Byte *)cached.data + sizeof(content_hash),
+                                               cached.size - sizeof(content_hash), &header->parse_res, &header->arena);
+                if(!res) {
+                    clear_arena(&header->arena);
+                }
             }
         }
+
+        system_unmap_file(&cached);
     }
 
     return(res);
 }
 
+internal Void write_header_cache(Header *header) {
+    PtrSize size = 0;
+    Byte *data = serialize_parse_result(&header->parse_res, &size);
+    if(data) {
+        MemoryArena *scratch = get_thread_scratch_arena();
+        TempMemory cache_memory = begin_temp_memory(scratch);
+
+        Byte *buf = push_arena(scratch, Byte, sizeof(header->content_hash) + size);
+        if(buf) {
+            copy(buf, &header->content_hash, sizeof(header->content_hash));
+            copy(buf + sizeof(header->content_hash), data, size);
+
+            PtrSize const len = 256;
+            Char cache_name[len] = {};
+            get_header_cache_name(header, cache_name, len);
+
+            // Not an error if this fails, it'll just be parsed again next time.
+            system_write_to_file(cache_name, cast(Char const *)buf, sizeof(header->content_hash) + size);
+        }
+
+        end_temp_memory(cache_memory);
+        system_free(data);
+    }
+}
+
+internal Void load_header(Header *header) {
+    trace_begin("header", header->path);
+
+    header->file = system_map_file(header->path);
+    if(header->file.data) {
+        header->found = true;
+        header->content_hash = hash_bytes(header->file.data, header->file.size, global_cache_seed);
+
+        if((!should_use_cache) || (!read_header_cache(header))) {
+            Int error_count = get_error_count();
+            header->parse_res = parse_stream(header->file.data, header->file.size, &header->arena);
+
+            if((should_use_cache) && (get_error_count() == error_count)) {
+                write_header_cache(header);
+            }
+        }
+    }
+
+    trace_end();
+}
+
+// Only used for headers kept from an earlier run. The content hash is seeded with global_cache_seed, so this also
+// catches different -Ds or -Is.
+internal Void reload_header_if_changed(Header *header) {
+    File file = system_map_file(header->path);
+    Bool unchanged = ((file.data) && (header->found) &&
+                      (hash_bytes(file.data, file.size, global_cache_seed) == header->content_hash));
+    system_unmap_file(&file);
+
+    if(!unchanged) {
+        free_arena(&header->arena);
+        system_unmap_file(&header->file);
+        zero(&header->parse_res, sizeof(header->parse_res));
+        header->found = false;
+
+        load_header(header);
+    }
+}
+
+// Must be called with the lock held.
+internal Header **find_header_slot(HeaderCache *cache, Uint64 path_hash, Char const *path) {
+    Int mask = cache->max - 1;
+    Int index = cast(Int)(path_hash & mask);
+
+    Header **res = cache->e + index;
+    while((*res) && (((*res)->path_hash != path_hash) || (!string_compare((*res)->path, path)))) {
+        index = (index + 1) & mask;
+        res = cache->e + index;
+    }
+
+    return(res);
+}
+
+// The first thread to ask for a header in a run parses it (or checks it hasn't changed). Any others asking for it at
+// the same time wait until it's done.
+internal Header *get_header(Char const *path) {
+    HeaderCache *cache = &global_header_cache;
+    Uint64 path_hash = hash_bytes(path, string_length(path), global_working_directory_hash);
+
+    system_lock(&cache->lock);
+
+    // Keep it at most half full.
+    if(cache->cnt + 1 >= cache->max / 2) {
+        Int new_max = (cache->max) ? cache->max * 2 : 256;
+        Header **new_e = system_alloc(Header *, new_max);
+        if(new_e) {
+            zero(new_e, sizeof(Header *) * new_max);
+
+            HeaderCache new_cache = { new_e, cache->cnt, new_max };
+            for(Int i = 0; (i < cache->max); ++i) {
+                if(cache->e[i]) {
+                    *find_header_slot(&new_cache, cache->e[i]->path_hash, cache->e[i]->path) = cache->e[i];
+                }
+            }
+
+            system_free(cache->e);
+            cache->e = new_e;
+            cache->max = new_max;
+        }
+    }
+
+    Header *res = 0;
+    Bool is_new = false;
+    Bool needs_check = false;
+    if((cache->e) && (cache->cnt + 1 < cache->max)) {
+        Header **slot = find_header_slot(cache, path_hash, path);
+        res = *slot;
+        if(!res) {
+            res = system_alloc(Header);
+            if(res) {
+                zero(res, sizeof(Header));
+                string_copy(res->path, path);
+                res->path_hash = path_hash;
+                res->run = cache->run;
+                res->loading = 1;
+
+                *slot = res;
+                ++cache->cnt;
+                is_new = true;
+            }
+        } else if(res->run != cache->run) {
+            res->run = cache->run;
+            res->loading = 1;
+            needs_check = true;
+        }
+    }
+
+    system_unlock(&cache->lock);
+
+    if(res) {
+        if(is_new) {
+            load_header(res);
+            system_atomic_add(&res->loading, -1);
+        } else if(needs_check) {
+            reload_header_if_changed(res);
+            system_atomic_add(&res->loading, -1);
+        } else {
+            wait_for_jobs(&res->loading);
+        }
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    return(res);
+}
+
+internal Void free_header_cache(void) {
+    HeaderCache *cache = &global_header_cache;
+    for(Int i = 0; (i < cache->max); ++i) {
+        Header *header = cache->e[i];
+        if(header) {
+            free_arena(&header->arena);
+            system_unmap_file(&header->file);
+            system_free(header);
+        }
+    }
+
+    system_free(cache->e);
+    system_free(cache->defines);
+    zero(cache, sizeof(*cache));
+}
+
+// Starts a run, and returns the -Ds to parse with, which last as long as the headers do.
+internal Char const **begin_header_cache_run(Char const **defines, Int define_count) {
+    HeaderCache *cache = &global_header_cache;
+    Char const **res = defines;
+
+    // The null's hashed too, so -DAB isn't the same as -DA -DB.
+    Uint64 defines_hash = hash_bytes(&define_count, sizeof(define_count));
+    PtrSize size = sizeof(Char const *) * define_count;
+    for(Int i = 0; (i < define_count); ++i) {
+        Int len = string_length(defines[i]) + 1;
+        defines_hash = hash_bytes(defines[i], len, defines_hash);
+        size += len;
+    }
+
+    if((!cache->run) || (cache->defines_hash != defines_hash)) {
+        free_header_cache();
+
+        Byte *block = (define_count) ? system_alloc(Byte, size) : 0;
+        if(block) {
+            Char const **copies = cast(Char const **)block;
+            Char *at = cast(Char *)(copies + define_count);
+            for(Int i = 0; (i < define_count); ++i) {
+                string_copy(at, defines[i]);
+                copies[i] = at;
+                at += string_length(at) + 1;
+            }
+
+            cache->defines = copies;
+        } else if(define_count) {
+            push_error(ErrorType_ran_out_of_memory);
+        }
+
+        cache->defines_hash = defines_hash;
+    }
+
+    if(cache->defines) {
+        res = cache->defines;
+    }
+    ++cache->run;
+
+    return(res);
+}
+
+struct IncludedHeaders {
+    Header **e;
+    Int cnt;
+    Int max;
+};
+
+internal Void add_included_headers(IncludedHeaders *headers, Char const *includer, ParseResult *parse_res,
+                                   MemoryArena *arena) {
+    PtrSize const len = 256;
+    Char path[len] = {};
+    for(Int i = 0; (i < parse_res->include_cnt); ++i) {
+        // Ones which can't be found (like the standard headers, usually) are just skipped.
+        if((find_include(includer, parse_res->includes + i, path, len)) && (path[0])) {
+            Header *header = get_header(path);
+            if((header) && (header->found)) {
+                Bool already_added = false;
+                for(Int j = 0; (j < headers->cnt); ++j) {
+                    if(headers->e[j] == header) {
+                        already_added = true;
+                        break; // for
+                    }
+                }
+
+                if(!already_added) {
+                    if(headers->cnt == headers->max) {
+                        Int new_max = (headers->max) ? headers->max * 2 : 16;
+                        headers->e = cast(Header **)resize_arena_memory(arena, headers->e, sizeof(Header *) * headers->max,
+                                                                        sizeof(Header *) * new_max);
+                        headers->max = (headers->e) ? new_max : 0;
+                    }
+
+                    if(headers->e) {
+                        headers->e[headers->cnt++] = header;
+                    } else {
+                        headers->cnt = 0;
+                        push_error(ErrorType_ran_out_of_memory);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Every header the files include, and every header those include, etc, each one once. Which is what include guards and
+// #pragma once are there for anyway, and means include cycles end.
+internal IncludedHeaders get_included_headers(Char const **fnames, ParseResult *results, Int cnt, MemoryArena *arena) {
+    IncludedHeaders res = {};
+    for(Int i = 0; (i < cnt); ++i) {
+        add_included_headers(&res, fnames[i], results + i, arena);
+    }
+
+    // Breadth first, so it goes through the list as it grows.
+    for(Int i = 0; (i < res.cnt); ++i) {
+        add_included_headers(&res, res.e[i]->path, &res.e[i]->parse_res, arena);
+    }
+
+    return(res);
+}
+
+// The headers' structs are only there to be looked up (as base classes or member types), because the code for them
+// belongs to the file which defines them. Otherwise everything including a header would get its own copy. So the
+// files go first, and the headers' structs are left after struct_cnt, with their enums and functions dropped.
+internal ParseResult merge_with_headers(IncludedHeaders *headers, ParseResult *results, Int cnt,
+                                        Int *lookup_struct_count, MemoryArena *arena) {
+    ParseResult res = {};
+    *lookup_struct_count = 0;
+
+    ParseResult *all_results = push_arena(arena, ParseResult, headers->cnt + 1);
+    if(all_results) {
+        // Merged first, so which structs are the files' own is known, even if the files share some.
+        all_results[0] = (cnt == 1) ? results[0] : merge_parse_results(results, cnt, arena);
+        for(Int i = 0; (i < headers->cnt); ++i) {
+            all_results[1 + i] = headers->e[i]->parse_res;
+        }
+
+        res = merge_parse_results(all_results, headers->cnt + 1, arena);
+
+        // The files' own come first, and a struct's only ever dropped if one with the same name came before it.
+        *lookup_struct_count = res.struct_cnt - all_results[0].struct_cnt;
+        res.struct_cnt = all_results[0].struct_cnt;
+        res.enum_cnt = all_results[0].enum_cnt;
+        res.func_cnt = all_results[0].func_cnt;
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    return(res);
+}
+
+// The files, then the headers, for the depfile.
+internal Char const **get_names_with_headers(Char const **fnames, Int cnt, IncludedHeaders *headers,
+                                             MemoryArena *arena) {
+    Char const **res = push_arena(arena, Char const *, cnt + headers->cnt);
+    if(res) {
+        for(Int i = 0; (i < cnt); ++i) {
+            res[i] = fnames[i];
+        }
+        for(Int i = 0; (i < headers->cnt); ++i) {
+            res[cnt + i] = headers->e[i]->path;
+        }
+    }
+
+    return(res);
+}
+
+internal Void write_cache_stamp_with_headers(Char const *fname, Uint64 key, IncludedHeaders *headers,
+                                             MemoryArena *arena) {
+    Char const **header_names = push_arena(arena, Char const *, headers->cnt);
+    Uint64 *header_hashes = push_arena(arena, Uint64, headers->cnt);
+    if(((header_names) && (header_hashes)) || (!headers->cnt)) {
+        for(Int i = 0; (i < headers->cnt); ++i) {
+            header_names[i] = headers->e[i]->path;
+            header_hashes[i] = headers->e[i]->content_hash;
+        }
+
+        write_cache_stamp(fname, key, header_names, header_hashes, headers->cnt);
+    }
+}
+
+// Everything for the file comes from this thread's arena, so it's all thrown away at once at the end. This is a temp
+// memory block rather than a clear, because while write_data waits on its sections this thread may run another file.
+// The stamp's written here as well, while the headers the file included are still known.
+internal Void start_parsing(Char const *fname, File file, Uint64 cache_key, FileProfile *profile) {
+    MemoryArena *arena = get_thread_arena();
+    MemoryArena *scratch = get_thread_scratch_arena();
+    TempMemory file_memory = begin_temp_memory(arena);
+    begin_profile_memory(arena, scratch);
+
+    // Counted per file, rather than per thread, because the sections are written on other threads and this thread
+    // may run another file's job while it waits for them.
+    Int volatile file_errors = 0;
+    Int volatile *prev_error_counter = set_error_counter(&file_errors);
+
+    Uint64 parse_start = begin_profile_phase();
+    ParseResult parse_res = parse_stream(file.data, file.size, arena);
+
+    IncludedHeaders headers = {};
+    Int lookup_struct_count = 0;
+    Char const **fnames = &fname;
+    Int fname_count = 1;
+    if(should_follow_includes) {
+        headers = get_included_headers(&fname, &parse_res, 1, arena);
+        if(headers.cnt) {
+            parse_res = merge_with_headers(&headers, &parse_res, 1, &lookup_struct_count, arena);
+
+            fnames = get_names_with_headers(&fname, 1, &headers, arena);
+            fname_count = (fnames) ? 1 + headers.cnt : 0;
+        }
+    }
+    end_profile_phase(profile, ProfilePhase_parse, parse_start);
+
+    write_parse_result(fname, &parse_res, lookup_struct_count, fnames, fname_count, arena, profile);
+
+    // Don't cache files with errors, so they get reported again next time.
+    if((should_use_cache) && (!get_error_count())) {
+        Uint64 write_start = begin_profile_phase();
+        trace_begin("write_cache_stamp");
+        write_cache_stamp_with_headers(fname, cache_key, &headers, arena);
+        trace_end();
+        end_profile_phase(profile, ProfilePhase_write, write_start);
+    }
+
+    set_error_counter(prev_error_counter);
+    end_profile_memory(profile, arena, scratch);
+    end_temp_memory(file_memory);
+}
+
+//
+// Parsing files on the thread pool.
+//
+struct ParseFileJob {
+    Char const *file_name;
+    FileProfile profile;
+};
+
+internal Void parse_file_job(Void *data) {
+    ParseFileJob *job = cast(ParseFileJob *)data;
+    FileProfile *profile = &job->profile;
+    profile->file_name = job->file_name;
+    trace_begin("file", job->file_name);
+
+    Uint64 read_start = begin_profile_phase();
+    trace_begin("read");
+    File file = system_map_file(job->file_name);
+    if(file.data) {
+        Uint64 cache_key = 0;
+        Bool up_to_date = false;
+        if(should_use_cache) {
+            cache_key = hash_bytes(file.data, file.size, global_cache_seed);
+            up_to_date = is_up_to_date(job->file_name, cache_key);
+        }
+        trace_end();
+        end_profile_phase(profile, ProfilePhase_read, read_start);
+
+        if(up_to_date) {
+            if(should_write_depfile) {
+                Uint64 write_start = begin_profile_phase();
+                write_missing_depfile(job->file_name, &job->file_name, 1);
+                end_profile_phase(profile, ProfilePhase_write, write_start);
+            }
+        } else {
+            start_parsing(job->file_name, file, cache_key, profile);
+        }
+
+        system_unmap_file(&file);
+    } else {
+        trace_end();
+        push_error(ErrorType_cannot_find_file);
+    }
+
+    trace_end();
+}
+
+//
+// Amalgamation.
+//
+// With --amalgamate every file is parsed, the results are merged into one, and it's written out as a single
+// <name>_generated.h. So the TypeInfo specializations, pp::Type, get_members_of_str, etc. are only written once
+// however many files there are, and they can all be used from one translation unit without colliding.
+#define default_amalgamate_name "amalgamated"
+
+internal Bool should_amalgamate = false;
+internal Char global_amalgamate_file_name[256] = {}; // <name>.cpp, so it goes through the same naming as a real file.
+
+struct AmalgamateFileJob {
+    Char const *file_name;
+    File file;
+
+    // Not the thread's arena, because the results have to outlive the job.
+    MemoryArena arena;
+    ParseResult parse_res;
+};
+
+internal Void parse_amalgamated_file_job(Void *data) {
+    AmalgamateFileJob *job = cast(AmalgamateFileJob *)data;
+
+    trace_begin("file", job->file_name);
+    job->parse_res = parse_stream(job->file.data, job->file.size, &job->arena);
+    trace_end();
+}
+
+internal Void amalgamate_files(Int argc, Char **argv, FileProfile *profile) {
+    Char const *fname = global_amalgamate_file_name;
+    profile->file_name = fname;
+
+    AmalgamateFileJob *jobs = system_alloc(AmalgamateFileJob, argc);
+    Char const **fnames = system_alloc(Char const *, argc);
+    if((jobs) && (fnames)) {
+        // The parse jobs add their errors to this too, whichever thread they run on.
+        Int volatile file_errors = 0;
+        Int volatile *prev_error_counter = set_error_counter(&file_errors);
+
+        Uint64 read_start = begin_profile_phase();
+        trace_begin("read", fname);
+
+        // Files being changed, added, removed or reordered all change the key.
+        Uint64 cache_key = global_cache_seed;
+        Int file_count = 0;
+        for(Int i = 1; (i < argc); ++i) {
+            Char const *file_name = argv[i];
+
+            SwitchType type = get_switch_type(file_name);
+            if((type == SwitchType_source_file) && (!string_contains(file_name, dir_name))) {
+                AmalgamateFileJob *job = jobs + file_count;
+                job->file_name = file_name;
+                job->file = system_map_file(file_name);
+                if(job->file.data) {
+                    fnames[file_count++] = file_name;
+
+                    cache_key = hash_bytes(file_name, string_length(file_name), cache_key);
+                    cache_key = hash_bytes(job->file.data, job->file.size, cache_key);
+                } else {
+                    push_error(ErrorType_cannot_find_file);
+                }
+            }
+        }
+
+        Bool up_to_date = ((should_use_cache) && (!get_error_count()) && (is_up_to_date(fname, cache_key)));
+        trace_end();
+        end_profile_phase(profile, ProfilePhase_read, read_start);
+
+        if(up_to_date) {
+            if(should_write_depfile) {
+                Uint64 write_start = begin_profile_phase();
+                write_missing_depfile(fname, fnames, file_count);
+                end_profile_phase(profile, ProfilePhase_write, write_start);
+            }
+        } else if(file_count) {
+            // The files are still parsed in parallel, only the merge and the write are one job.
+            Uint64 parse_start = begin_profile_phase();
+            Int volatile files_remaining = 0;
+            for(Int i = 0; (i < file_count); ++i) {
+                add_job(parse_amalgamated_file_job, jobs + i, &files_remaining);
+            }
+
+            wait_for_jobs(&files_remaining);
+
+            MemoryArena *arena = get_thread_arena();
+            MemoryArena *scratch = get_thread_scratch_arena();
+            TempMemory amalgamate_memory = begin_temp_memory(arena);
+            begin_profile_memory(arena, scratch);
+
+            ParseResult *results = push_arena(arena, ParseResult, file_count);
+            if(results) {
+                for(Int i = 0; (i < file_count); ++i) {
+                    results[i] = jobs[i].parse_res;
+
+                    if(should_profile) {
+                        profile->peak_arena_size += jobs[i].arena.peak_size;
+                    }
+                }
+
+                // Headers included by more than one file are still only merged once.
+                IncludedHeaders headers = {};
+                if(should_follow_includes) {
+                    headers = get_included_headers(fnames, results, file_count, arena);
+                }
+
+                trace_begin("merge", fname);
+                Int lookup_struct_count = 0;
+                ParseResult parse_res = (headers.cnt) ? merge_with_headers(&headers, results, file_count,
+                                                                           &lookup_struct_count, arena)
+                                                      : merge_parse_results(results, file_count, arena);
+                trace_end();
+                end_profile_phase(profile, ProfilePhase_parse, parse_start);
+
+                Char const **all_fnames = fnames;
+                Int all_fname_count = file_count;
+                if(headers.cnt) {
+                    all_fnames = get_names_with_headers(fnames, file_count, &headers, arena);
+                    all_fname_count = (all_fnames) ? file_count + headers.cnt : 0;
+                }
+
+                write_parse_result(fname, &parse_res, lookup_struct_count, all_fnames, all_fname_count, arena, profile);
+
+                // Don't cache it if any file had errors, so they get reported again next time.
+                if((should_use_cache) && (!get_error_count())) {
+                    Uint64 write_start = begin_profile_phase();
+                    trace_begin("write_cache_stamp");
+                    write_cache_stamp_with_headers(fname, cache_key, &headers, arena);
+                    trace_end();
+                    end_profile_phase(profile, ProfilePhase_write, write_start);
+                }
+            } else {
+                push_error(ErrorType_ran_out_of_memory);
+            }
+
+            end_profile_memory(profile, arena, scratch);
+            end_temp_memory(amalgamate_memory);
+        }
+
+        for(Int i = 0; (i < file_count); ++i) {
+            free_arena(&jobs[i].arena);
+            system_unmap_file(&jobs[i].file);
+        }
+
+        set_error_counter(prev_error_counter);
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    system_free(fnames);
+    system_free(jobs);
+}
+
+internal Void print_help(void) {
+    Char const *help = "    List of Commands.\n"
+                       "        -e - Print errors to the console.\n"
+                       "        -f - Ignore the cache, and regenerate every file.\n"
+                       "        -u - Only write generated files whose contents have changed.\n"
+                       "        -h - Print this help.\n"
+                       "        -j<N> - Parse files on N threads. Just -j uses one thread per processor.\n"
+                       "        -D<name>[=<value>] - Define a macro for #if, #ifdef, etc, in every file. The value is 1 by default.\n"
+                       "        -I<dir> - Use the structs in any #included headers as base classes and member types, looking\n"
+                       "                  for the headers in <dir> too. Can be passed more than once.\n"
+                       "        --follow-includes - Like -I, but only looks next to the file including the header.\n"
+                       "        -p - Print how long each file spent reading, parsing, emitting and writing, and what was in it.\n"
+                       "        -MD - Write a Makefile/Ninja depfile (foo_generated.d) next to each generated file.\n"
+                       "        -MF<file> - Like -MD, but writes the depfile to <file>. Only works with one source file, or\n"
+                       "                    with --amalgamate.\n"
+                       "        --server[=<socket>] - Stay running, and generate files for --client. The socket is\n"
+                       "                              " dir_name "/server.sock by default. Not on Windows.\n"
+                       "        --client[=<socket>] - Send the rest of the command line to a --server. Runs it here\n"
+                       "                              instead if there's no server running.\n"
+                       "        --stop-server - With --client, shuts the server down.\n"
+                       "        --watch - Generate everything, then stay running and regenerate files as they're saved. Not\n"
+                       "                  on Windows.\n"
+                       "        --trace[=<file>] - Write a Chrome trace (for chrome://tracing or ui.perfetto.dev) of what each\n"
+                       "                           thread did. " dir_name "/trace.json by default.\n"
+                       "        --amalgamate[=<name>] - Generate one " dir_name "/<name>_generated.h for all the source files,\n"
+                       "                                instead of one each. <name> is " default_amalgamate_name " by default.\n"
+#if INTERNAL
+                       "    Internal Commands.\n"
+                       "        -s - Do not output any code, just see if there were errors parsing a file.\n"
+                       "        -t - Run tests on the code.\n"
+#endif
+                       "\n";
+
+    system_write_to_console(help);
+}
+
+//
+// Running a command line. Either straight from main, or for a --client.
+//
+internal Int run_command_line(Int argc, Char **argv) {
+    Int res = 0;
+
+    Bool should_log_errors = true;
+    Bool should_run_tests = false;
+    should_write_to_file = true;
+    should_use_cache = true;
+    should_only_write_changed_files = false;
+    should_write_depfile = false;
+    global_depfile_name = 0;
+    should_amalgamate = false;
+    should_profile = false;
+    Char const *trace_file_name = 0;
+    global_unchanged_file_count = 0;
+    Int thread_count = 1;
+
+    Char const **defines = system_alloc(Char const *, argc);
+    Int define_count = 0;
+
+    should_follow_includes = false;
+    Char const **include_dirs = system_alloc(Char const *, argc);
+    Int include_dir_count = 0;
+
+    Int number_of_files = 0;
+    for(Int i = 1; (i < argc); ++i) {
+        Char const *switch_name = argv[i];
+
+        SwitchType type = get_switch_type(switch_name);
+        switch(type) {
+            case SwitchType_silent:             { should_write_to_file = false;               } break;
+            case SwitchType_log_errors:         { should_log_errors = true;                   } break;
+            case SwitchType_run_tests:          { should_run_tests = true;                    } break;
+            case SwitchType_print_help:         { print_help();                               } break;
+            case SwitchType_set_dir:            { system_set_current_folder(switch_name + 2); } break;
+            case SwitchType_version:            { system_write_to_console("Version: " preprocessor_version); } break;
+            case SwitchType_force:              { should_use_cache = false;                   } break;
+            case SwitchType_write_changed_only: { should_only_write_changed_files = true;     } break;
+            case SwitchType_depfile:            { should_write_depfile = true;                } break;
+            case SwitchType_profile:            { should_profile = true;                      } break;
+            case SwitchType_follow_includes:    { should_follow_includes = true;              } break;
+
+            case SwitchType_depfile_name: {
+                should_write_depfile = true;
+                global_depfile_name = switch_name + 3;
+            } break;
+
+            case SwitchType_define: {
+                if((defines) && (switch_name[2])) {
+                    defines[define_count++] = switch_name + 2;
+                }
+            } break;
+
+            case SwitchType_include_dir: {
+                should_follow_includes = true;
+                if((include_dirs) && (switch_name[2])) {
+                    include_dirs[include_dir_count++] = switch_name + 2;
+                }
+            } break;
+
+            case SwitchType_trace: {
+                trace_file_name = get_long_switch_value(switch_name);
+                if((!trace_file_name) || (!trace_file_name[0])) {
+                    trace_file_name = dir_name "/trace.json";
+                }
+            } break;
+
+            case SwitchType_amalgamate: {
+                Char const *name = get_long_switch_value(switch_name);
+                if((!name) || (!name[0])) {
+                    name = default_amalgamate_name;
+                }
+
+                should_amalgamate = true;
+                stbsp_snprintf(global_amalgamate_file_name, sizeof(global_amalgamate_file_name), "%s.cpp", name);
+            } break;
+
+            // Handled by main.
+            case SwitchType_server: case SwitchType_client: case SwitchType_stop_server: case SwitchType_watch: {} break;
+
+            case SwitchType_thread_count: {
+                if(switch_name[2]) {
+                    ResultInt r = string_to_int(cast(Char *)switch_name + 2);
+                    if((r.success) && (r.e > 0)) { thread_count = r.e;                                         }
+                    else                         { system_write_to_console("Unknown argument %s", switch_name); }
+                } else {
+                    thread_count = system_get_processor_count();
+                }
+            } break;
+
+            case SwitchType_source_file: {
+                if(!string_contains(switch_name, dir_name)) {
+                    ++number_of_files;
+                }
+            } break;
+
+            default: {
+                system_write_to_console("Unknown argument %s", switch_name);
+            } break;
+        }
+    }
+
+    if((global_depfile_name) && (number_of_files != 1) && (!should_amalgamate)) {
+        system_write_to_console("-MF only works with one source file, writing depfiles next to the generated files.\n");
+        global_depfile_name = 0;
+    }
+
+    if(trace_file_name) {
+        start_tracing();
+    }
+
+    set_predefined_macros(begin_header_cache_run(defines, define_count), define_count);
+    global_include_dirs = include_dirs;
+    global_include_dir_count = include_dir_count;
+
+    if((should_write_depfile) && (!global_executable_path[0])) {
+        system_get_executable_path(global_executable_path, sizeof(global_executable_path));
+    }
+
+    if(should_run_tests) {
+#if RUN_TESTS
+        Int run_tests(void);
+        res = run_tests();
+#endif
+    } else {
+        if(!number_of_files) {
+            push_error(ErrorType_no_files_pass_in);
+        } else {
+            // Not capped at the number of files, because write_data can spread a big file's sections across
+            // any spare threads. A --server already has its pool running, so this fails and it's left alone.
+            Bool started_thread_pool = false;
+            if(thread_count > 1) {
+                started_thread_pool = start_thread_pool(thread_count);
+            }
+
+            ParseFileJob *jobs = system_alloc(ParseFileJob, argc);
+            if(jobs) {
+                // Write static file to disk.
+                if(should_write_to_file) {
+                    Bool create_folder_success = system_create_folder(dir_name);
+
+                    if(!create_folder_success) { push_error(ErrorType_could_not_create_directory); }
+                    else                       { write_static_file();                              }
+
+                    // Rebuilding the preprocessor invalidates everything.
+                    Char const *build_id = preprocessor_version " " __DATE__ " " __TIME__;
+                    global_cache_seed = hash_bytes(build_id, string_length(build_id));
+
+                    // So do different -Ds. The null's hashed too, so -DAB isn't the same as -DA -DB.
+                    for(Int i = 0; (i < define_count); ++i) {
+                        global_cache_seed = hash_bytes(defines[i], string_length(defines[i]) + 1, global_cache_seed);
+                    }
+
+                    // And whether, and from where, headers are pulled in.
+                    if(should_follow_includes) {
+                        global_cache_seed = hash_bytes("-I", 3, global_cache_seed);
+                        for(Int i = 0; (i < include_dir_count); ++i) {
+                            global_cache_seed = hash_bytes(include_dirs[i], string_length(include_dirs[i]) + 1,
+                                                           global_cache_seed);
+                        }
+                    }
+
+                    if((should_use_cache) && (!system_create_folder(cache_dir_name))) {
+                        should_use_cache = false;
+                    }
+                } else {
+                    should_use_cache = false;
+                }
+
+                Uint64 start = begin_profile_phase();
+                if(should_amalgamate) {
+                    amalgamate_files(argc, argv, &jobs[0].profile); // jobs[0] is argv[0], so it's free.
+                } else {
+                    // Parse files. Every file is independent, so they all go onto the thread pool.
+                    Int volatile files_remaining = 0;
+                    for(Int i = 1; (i < argc); ++i) {
+                        Char const *file_name = argv[i];
+
+                        SwitchType type = get_switch_type(file_name);
+                        if((type == SwitchType_source_file) && (!string_contains(file_name, dir_name))) {
+                            ParseFileJob *job = jobs + i;
+                            job->file_name = file_name;
+
+                            add_job(parse_file_job, job, &files_remaining);
+                        }
+                    }
+
+                    wait_for_jobs(&files_remaining);
+                }
+
+                if(should_profile) {
+                    Uint64 elapsed = system_get_performance_counter() - start;
+
+                    FileProfile total = {};
+                    Int file_count = 0;
+                    for(Int i = 0; (i < argc); ++i) {
+                        if(jobs[i].profile.file_name) {
+                            print_file_profile(&jobs[i].profile);
+                            add_file_profile(&total, &jobs[i].profile);
+                            ++file_count;
+                        }
+                    }
+
+                    total.file_name = "Total";
+                    print_file_profile(&total);
+                    system_write_to_console("%d file(s) in %llu us.\n", file_count,
+                                            cast(unsigned long long)profile_to_microseconds(elapsed));
+                }
+
+                if(should_only_write_changed_files) {
+                    system_write_to_console("%d generated file(s) unchanged.\n", global_unchanged_file_count);
+                }
+            }
+
+            if(started_thread_pool) {
+                stop_thread_pool();
+            }
+            system_free(jobs);
+        }
+    }
+
+    set_predefined_macros(0, 0);
+    system_free(defines);
+
+    // Everything's finished, so no other thread is still tracing.
+    if((trace_file_name) && (!write_trace(trace_file_name))) {
+        push_error(ErrorType_could_not_write_to_disk);
+    }
+
+    // After the trace, because it points at the headers' names. With --server or --watch they're kept for the next run.
+    if(!global_resident_mode) {
+        free_header_cache();
+    }
+    global_include_dirs = 0;
+    global_include_dir_count = 0;
+    system_free(include_dirs);
+
+    // Output errors.
+    if(should_log_errors) {
+        if(print_errors()) {
+            res = 255;
+        }
+    }
+
+    return(res);
+}
+
+//
+// Server and client.
+//
+// A --client sends a ServerRequestHeader, followed by its working directory and then its arguments (all null-terminated).
+// The --server runs them as a normal command line, and sends back a ServerResponseHeader, followed by everything that
+// would've been written to the console, and then everything that would've been written to stderr.
+#define server_protocol_version 1
+#define default_server_socket dir_name "/server.sock"
+#define max_server_request_size (1024 * 1024)
+
+struct ServerRequestHeader {
+    Uint32 version;
+    Uint32 size;
+};
+
+struct ServerResponseHeader {
+    Int32 res;
+    Uint32 output_size;
+    Uint32 error_size;
+};
+
+struct GrowableBuffer {
+    Char *e;
+    PtrSize size;
+    PtrSize max;
+};
+
+internal Void append_to_buffer(GrowableBuffer *buf, Char const *data, PtrSize size) {
+    if(buf->size + size > buf->max) {
+        PtrSize new_max = (buf->max) ? buf->max * 2 : 1024;
+        while(new_max < buf->size + size) {
+            new_max *= 2;
+        }
+
+        Char *p = cast(Char *)system_realloc(buf->e, new_max);
+        if(p) {
+            buf->e = p;
+            buf->max = new_max;
+        }
+    }
+
+    if(buf->size + size <= buf->max) {
+        copy(buf->e + buf->size, cast(Void *)data, size);
+        buf->size += size;
+    }
+}
+
+struct ServerOutput {
+    GrowableBuffer output;
+    GrowableBuffer errors;
+};
+
+internal Void capture_server_output(Char const *str, PtrSize len, Bool is_stderr, Void *data) {
+    ServerOutput *out = cast(ServerOutput *)data;
+    append_to_buffer((is_stderr) ? &out->errors : &out->output, str, len);
+}
+
+// Returns false if the server should stop.
+internal Bool handle_server_request(LocalSocket *client, ServerOutput *out) {
+    Bool res = true;
+
+    out->output.size = 0;
+    out->errors.size = 0;
+
+    ServerRequestHeader header = {};
+    Char *request = 0;
+    Char **argv = 0;
+    if((system_receive_from_local_socket(client, &header, sizeof(header))) &&
+       (header.version == server_protocol_version) && (header.size > 0) && (header.size <= max_server_request_size)) {
+        request = system_alloc(Char, header.size + 1);
+        if((request) && (system_receive_from_local_socket(client, request, header.size))) {
+            request[header.size] = 0;
+
+            // Everything the client sends is null-terminated, so a request which doesn't end in a 0 didn't come from a
+            // client (and may not even have a working directory).
+            Bool is_valid = (request[header.size - 1] == 0);
+
+            // The working directory takes the place of argv[0].
+            Int argc = 0;
+            for(PtrSize i = 0; (is_valid) && (i < header.size); ++i) {
+                if(!request[i]) { ++argc; }
+            }
+
+            argv = system_alloc(Char *, argc + 1);
+            if(argv) {
+                Char *at = request;
+                for(Int i = 0; (i < argc); ++i) {
+                    argv[i] = at;
+                    at += string_length(at) + 1;
+                }
+                argv[argc] = 0;
+
+                ServerResponseHeader response = {};
+                for(Int i = 1; (i < argc); ++i) {
+                    if(get_switch_type(argv[i]) == SwitchType_stop_server) {
+                        res = false;
+                    }
+                }
+
+                if(res) {
+                    system_capture_console(capture_server_output, out);
+
+                    if(!is_valid) {
+                        system_write_to_stderr("Server got a malformed request.\n");
+                        response.res = 255;
+                    } else if(system_set_working_directory(argv[0])) {
+                        global_working_directory_hash = hash_bytes(argv[0], string_length(argv[0]));
+                        system_set_current_folder(0);
+                        clear_errors();
+
+                        response.res = run_command_line(argc, argv);
+                    } else {
+                        system_write_to_stderr("Server could not change to the client's working directory.\n");
+                        response.res = 255;
+                    }
+
+                    system_capture_console(0, 0);
+                }
+
+                response.output_size = cast(Uint32)out->output.size;
+                response.error_size = cast(Uint32)out->errors.size;
+
+                // Not much to do if the client's gone.
+                if(system_send_to_local_socket(client, &response, sizeof(response))) {
+                    if(system_send_to_local_socket(client, out->output.e, out->output.size)) {
+                        system_send_to_local_socket(client, out->errors.e, out->errors.size);
+                    }
+                }
+            }
+        }
+    }
+
+    system_free(argv);
+    system_free(request);
+
+    return(res);
+}
+
+internal Int run_server(Char const *socket_path, Int thread_count) {
+    Int res = 0;
+
+    // Each request changes into the client's working directory, so the socket's removed by its full path at the end.
+    // It's still listened on by the path it was given, because a socket's path has to be quite short.
+    PtrSize const len = 1024;
+    Char full_socket_path[len] = {};
+    Char working_directory[len] = {};
+    if((socket_path[0] != '/') && (system_get_working_directory(working_directory, len))) {
+        stbsp_snprintf(full_socket_path, len, "%s/%s", working_directory, socket_path);
+    } else {
+        stbsp_snprintf(full_socket_path, len, "%s", socket_path);
+    }
+
+    LocalSocket listener = {};
+    if((!system_create_folder(dir_name)) || (!system_listen_local_socket(&listener, socket_path))) {
+        push_error(ErrorType_could_not_start_server);
+        if(print_errors()) {
+            res = 255;
+        }
+    } else {
+        system_write_to_console("Preprocessor server listening on %s.\n", socket_path);
+
+        global_resident_mode = true;
+        if(thread_count > 1) {
+            start_thread_pool(thread_count);
+        }
+
+        // Requests are handled one at a time, because each one can be from a different working directory.
+        ServerOutput out = {};
+        Bool running = true;
+        while(running) {
+            LocalSocket client = {};
+            if(system_accept_local_socket(&listener, &client)) {
+                running = handle_server_request(&client, &out);
+                system_close_local_socket(&client);
+            }
+        }
+
+        stop_thread_pool();
+        free_header_cache();
+        system_close_local_socket(&listener);
+        system_remove_local_socket(full_socket_path);
+
+        system_free(out.output.e);
+        system_free(out.errors.e);
+    }
+
+    return(res);
+}
+
+// Returns false if there's no server to send it to.
+internal Bool run_client(Char const *socket_path, Int argc, Char **argv, Int *res) {
+    Bool sent = false;
+
+    LocalSocket server = {};
+    if(system_connect_local_socket(&server, socket_path)) {
+        GrowableBuffer request = {};
+
+        Char working_directory[1024] = {};
+        if(system_get_working_directory(working_directory, sizeof(working_directory))) {
+            append_to_buffer(&request, working_directory, string_length(working_directory) + 1);
+            for(Int i = 1; (i < argc); ++i) {
+                if(get_switch_type(argv[i]) != SwitchType_client) {
+                    append_to_buffer(&request, argv[i], string_length(argv[i]) + 1);
+                }
+            }
+
+            ServerRequestHeader header = { server_protocol_version, cast(Uint32)request.size };
+            ServerResponseHeader response = {};
+            if((system_send_to_local_socket(&server, &header, sizeof(header))) &&
+               (system_send_to_local_socket(&server, request.e, request.size)) &&
+               (system_receive_from_local_socket(&server, &response, sizeof(response)))) {
+                sent = true;
+                *res = response.res;
+
+                PtrSize size = response.output_size + response.error_size;
+                Char *output = system_alloc(Char, size + 1);
+                if((output) && (system_receive_from_local_socket(&server, output, size))) {
+                    Char *errors = output + response.output_size;
+
+                    // system_write_to_console only has a small buffer, so print it in pieces.
+                    for(Uint32 i = 0; (i < response.output_size); i += 512) {
+                        Uint32 len = (response.output_size - i < 512) ? response.output_size - i : 512;
+                        system_write_to_console("%.*s", len, output + i);
+                    }
+
+                    errors[response.error_size] = 0;
+                    system_write_to_stderr(errors);
+                }
+
+                system_free(output);
+            }
+        }
+
+        system_free(request.e);
+        system_close_local_socket(&server);
+    }
+
+    return(sent);
+}
+
+//
+// Watching files.
+//
+// After the first run, each burst of saves becomes its own command line: the same switches, -u so unchanged output
+// doesn't touch the generated file's timestamp, and only the files which changed.
+#define watch_debounce_ms 2
+
+internal Int run_watch(Int argc, Char **argv, Int thread_count) {
+    Int res = 0;
+
+    global_resident_mode = true;
+    Char working_directory[1024] = {};
+    if(system_get_working_directory(working_directory, sizeof(working_directory))) {
+        global_working_directory_hash = hash_bytes(working_directory, string_length(working_directory));
+    }
+
+    if(thread_count > 1) {
+        start_thread_pool(thread_count);
+    }
+
+    res = run_command_line(argc, argv);
+
+    FileWatcher watcher = {};
+    Char **sub_argv = system_alloc(Char *, argc + 2);
+    Int *changed = system_alloc(Int, argc);
+    Bool watching = ((sub_argv) && (changed) && (system_create_file_watcher(&watcher)));
+    Bool amalgamate = false;
+    for(Int i = 1; (watching) && (i < argc); ++i) {
+        SwitchType type = get_switch_type(argv[i]);
+        if((type == SwitchType_source_file) && (!string_contains(argv[i], dir_name))) {
+            watching = system_watch_file(&watcher, argv[i], i);
+        } else if(type == SwitchType_amalgamate) {
+            amalgamate = true;
+        }
+    }
+
+    if(!watching) {
+        clear_errors();
+        push_error(ErrorType_could_not_watch_files);
+        if(print_errors()) {
+            res = 255;
+        }
+    } else {
+        system_write_to_console("Watching for changes...\n");
+
+        for(;;) {
+            Int changed_count = system_wait_for_file_changes(&watcher, changed, argc, -1);
+            if(changed_count < 0) {
+                break; // for
+            }
+
+            // Editors often write a file more than once when saving, so wait for it to settle.
+            while(changed_count < argc) {
+                Int more = system_wait_for_file_changes(&watcher, changed + changed_count, argc - changed_count,
+                                                        watch_debounce_ms);
+                if(more <= 0) {
+                    break; // while
+                }
+
+                changed_count += more;
+            }
+
+            if(changed_count) {
+                Uint64 start = system_get_performance_counter();
+
+                Int sub_argc = 0;
+                sub_argv[sub_argc++] = argv[0];
+                for(Int i = 1; (i < argc); ++i) {
+                    SwitchType type = get_switch_type(argv[i]);
+                    if((type != SwitchType_source_file) && (type != SwitchType_watch)) {
+                        sub_argv[sub_argc++] = argv[i];
+                    }
+                }
+                sub_argv[sub_argc++] = cast(Char *)"-u";
+
+                // With --amalgamate there's one generated file for all of them, so it needs every file. The cache
+                // still skips it if nothing actually changed.
+                if(amalgamate) {
+                    changed_count = 0;
+                    for(Int i = 1; (i < argc); ++i) {
+                        if((get_switch_type(argv[i]) == SwitchType_source_file) && (!string_contains(argv[i], dir_name))) {
+                            changed[changed_count++] = i;
+                        }
+                    }
+                }
+
+                // The same file can turn up twice, if it changed again after the first wait.
+                for(Int i = 0; (i < changed_count); ++i) {
+                    Bool duplicate = false;
+                    for(Int j = 0; (j < i); ++j) {
+                        if(changed[j] == changed[i]) {
+                            duplicate = true;
+                            break; // for
+                        }
+                    }
+
+                    if((!duplicate) && (sub_argc < argc + 1)) {
+                        sub_argv[sub_argc++] = argv[changed[i]];
+                    }
+                }
+                sub_argv[sub_argc] = 0;
+
+                clear_errors();
+                res = run_command_line(sub_argc, sub_argv);
+
+                Uint64 elapsed = system_get_performance_counter() - start;
+                Uint64 microseconds = (elapsed * 1000000) / system_get_performance_frequency();
+                system_write_to_console("Regenerated in %llu us.\n", cast(unsigned long long)microseconds);
+            }
+        }
+    }
+
+    system_destroy_file_watcher(&watcher);
+    system_free(changed);
+    system_free(sub_argv);
+    stop_thread_pool();
+    free_header_cache();
+
+    return(res);
+}
+
+Int main(Int argc, Char **argv) {// TODO(Jonny): Support wildcards.
+    system_get_file_extension("test_code.cpp");
+
+    Int res = 0;
+
+    if(argc <= 1) {
+        push_error(ErrorType_no_parameters);
+        print_help();
+    } else {
+        Char const *server_socket = 0;
+        Char const *client_socket = 0;
+        Bool stop_server = false;
+        Bool watch = false;
+        Int thread_count = 1;
+        for(Int i = 1; (i < argc); ++i) {
+            Char const *switch_name = argv[i];
+
+            SwitchType type = get_switch_type(switch_name);
+            if(type == SwitchType_server) {
+                server_socket = get_long_switch_value(switch_name);
+                if(!server_socket) { server_socket = default_server_socket; }
+            } else if(type == SwitchType_client) {
+                client_socket = get_long_switch_value(switch_name);
+                if(!client_socket) { client_socket = default_server_socket; }
+            } else if(type == SwitchType_stop_server) {
+                stop_server = true;
+            } else if(type == SwitchType_watch) {
+                watch = true;
+            } else if(type == SwitchType_thread_count) {
+                ResultInt r = string_to_int(cast(Char *)switch_name + 2);
+                thread_count = ((r.success) && (r.e > 0)) ? r.e : system_get_processor_count();
+            }
+        }
+
+        // See platform.cpp.
+        Bool is_supported = true;
+#if OS_WIN32
+        if((server_socket) || (watch)) {
+            system_write_to_stderr("--server and --watch aren't supported on Windows.\n");
+            push_error((server_socket) ? ErrorType_could_not_start_server : ErrorType_could_not_watch_files);
+            is_supported = false;
+        }
+#endif
+
+        if(!is_supported) {
+            if(print_errors()) {
+                res = 255;
+            }
+        } else if(server_socket) {
+            res = run_server(server_socket, thread_count);
+        } else if((client_socket) && (run_client(client_socket, argc, argv, &res))) {
+            // Done by the server.
+        } else if(watch) {
+            res = run_watch(argc, argv, thread_count);
+        } else if(!stop_server) {
+            res = run_command_line(argc, argv);
+        }
+
+        free_scratch_memory();
+    }
+
+#if MEM_CHECK
+    print_memory_report();
+#endif
+
+    return(res);
+}
@@ -17,14 +17,75 @@
 
 internal Char *global_folder = 0;
 Void system_set_current_folder(Char const *folder_name) {
+    if(global_folder) {
+        system_free(global_folder);
+        global_folder = 0;
+    }
+
     PtrSize len = string_length(folder_name);
+    if(len) {
+        global_folder = system_alloc(Char, len + 2);
+        if(global_folder) {
+            string_copy(global_folder, folder_name);
+            global_folder[len] = '/';
+            global_folder[len + 1] = 0;
+        }
+    }
+}
 
-    global_folder = system_alloc(Char, len + 2);
-    if(global_folder) {
-        string_copy(global_folder, folder_name);
-        global_folder[len] = '/';
+internal ConsoleOutputProc *global_console_capture = 0;
+internal Void *global_console_capture_data = 0;
+Void system_capture_console(ConsoleOutputProc *proc, Void *data) {
+    global_console_capture = proc;
+    global_console_capture_data = data;
+}
 
+// Returns true if the output was captured, so doesn't need printing.
+internal Bool capture_console_output(Char const *str, PtrSize len, Bool is_stderr) {
+    Bool res = false;
+
+    if(global_console_capture) {
+        global_console_capture(str, len, is_stderr, global_console_capture_data);
+        res = true;
     }
+
+    return(res);
+}
+
+Bool system_write_to_file(Char const *fname, Char const *data, PtrSize data_size) {
+    FileChunk chunk = { data, data_size };
+    Bool res = system_write_chunks_to_file(fname, &chunk, 1);
+
+    return(res);
+}
+
+// Same on every platform. Leaves the file (and its timestamp) alone if it already contains exactly the chunks, so build
+// systems don't rebuild everything that includes it.
+Bool system_write_chunks_to_file_if_changed(Char const *fname, FileChunk *chunks, Int chunk_count, Bool *unchanged) {
+    Bool res = false;
+    *unchanged = false;
+
+    File old_file = system_map_file(fname);
+    if(old_file.data) {
+        PtrSize total_size = 0;
+        for(Int i = 0; (i < chunk_count); ++i) {
+            total_size += chunks[i].size;
+        }
+
+        *unchanged = (old_file.size == total_size);
+        PtrSize offset = 0;
+        for(Int i = 0; (*unchanged) && (i < chunk_count); ++i) {
+            *unchanged = string_compare(old_file.data + offset, chunks[i].data, cast(Int)chunks[i].size);
+            offset += chunks[i].size;
+        }
+
+        system_unmap_file(&old_file);
+    }
+
+    if(*unchanged) { res = true;                                                  }
+    else           { res = system_write_chunks_to_file(fname, chunks, chunk_count); }
+
+    return(res);
 }
 
 //
@@ -35,51 +96,79 @@ Void system_set_current_folder(Char const *folder_name) {
 #include <windows.h>
 #include <Shlwapi.h>
 
-Void *system_malloc(PtrSize size, PtrSize cnt/*= 1*/) {
-    return HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size * cnt);
+internal Void *system_malloc_os(PtrSize size) {
+    return HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
 }
 
-Bool system_free(Void *ptr) {
+internal Bool system_free_os(Void *ptr) {
     if(ptr) return HeapFree(GetProcessHeap(), 0, ptr) != 0;
     else    return false;
 }
 
-Void *system_realloc(Void *ptr, PtrSize size) {
+internal Void *system_realloc_os(Void *ptr, PtrSize size) {
     return HeapReAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ptr, size);
 }
 
-File system_read_entire_file_and_null_terminate(Char const *fname, Void *memory) {
+internal Void *system_alloc_pages_os(PtrSize size) {
+    Void *res = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+    return(res);
+}
+
+internal Void system_free_pages_os(Void *ptr, PtrSize size) {
+    if(ptr) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+}
+
+File system_map_file(Char const *fname) {
     File res = {};
-    HANDLE fhandle;
     LARGE_INTEGER fsize;
-    DWORD fsize32, bytes_read;
 
     PtrSize const name_buf_size = 256;
     Char name_buf[name_buf_size] = {}; // MAX_PATH?
     string_concat(name_buf, name_buf_size, global_folder, string_length(global_folder), fname, string_length(fname));
 
-    fhandle = CreateFileA(name_buf, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+    HANDLE fhandle = CreateFileA(name_buf, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
     if(fhandle != INVALID_HANDLE_VALUE) {
         if(GetFileSizeEx(fhandle, &fsize)) {
-            fsize32 = safe_truncate_size_64(fsize.QuadPart);
-            if(ReadFile(fhandle, memory, fsize32, &bytes_read, 0)) {
-                if(bytes_read != fsize32) {
-                    push_error(ErrorType_did_not_read_entire_file);
-                } else {
-                    res.size = fsize32;
-                    res.data = cast(Char *)memory;
-                    res.data[res.size] = 0;
+            if(!fsize.QuadPart) {
+                // Can't map an empty file, so just hand back an empty (static) string.
+                res.data = cast(Char *)"";
+            } else {
+                HANDLE mapping = CreateFileMappingA(fhandle, 0, PAGE_READONLY, 0, 0, 0);
+                if(mapping) {
+                    res.data = cast(Char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    if(res.data) {
+#if ENVIRONMENT32
+                        res.size = safe_truncate_size_64(fsize.QuadPart);
+#else
+                        res.size = fsize.QuadPart;
+#endif
+                    }
+
+                    CloseHandle(mapping);
                 }
             }
-
-            CloseHandle(fhandle);
         }
+
+        CloseHandle(fhandle);
     }
 
     return(res);
 }
 
-Bool system_write_to_file(Char const *fname, Char const *data, PtrSize data_size) {
+Void system_unmap_file(File *file) {
+    if((file->data) && (file->size)) {
+        UnmapViewOfFile(file->data);
+    }
+
+    file->data = 0;
+    file->size = 0;
+}
+
+// WriteFileGather only works on unbuffered, page-aligned, files, so this is one WriteFile per chunk.
+Bool system_write_chunks_to_file(Char const *fname, FileChunk *chunks, Int chunk_count) {
     Bool res = false;
     HANDLE fhandle;
     DWORD fsize32, bytes_written;
@@ -90,14 +179,18 @@ Bool system_write_to_file(Char const *fname, Char const *data, PtrSize data_size
 
     fhandle = CreateFileA(name_buf, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, CREATE_ALWAYS, 0, 0);
     if(fhandle != INVALID_HANDLE_VALUE) {
+        res = true;
+        for(Int i = 0; (res) && (i < chunk_count); ++i) {
 #if ENVIRONMENT32
-        fsize32 = data_size;
+            fsize32 = chunks[i].size;
 #else
-        fsize32 = safe_truncate_size_64(data_size);
+            fsize32 = safe_truncate_size_64(chunks[i].size);
 #endif
-        if(WriteFile(fhandle, data, fsize32, &bytes_written, 0)) {
-            if(bytes_written != fsize32) push_error(ErrorType_did_not_write_entire_file);
-            else                         res = true;
+            res = false;
+            if(WriteFile(fhandle, chunks[i].data, fsize32, &bytes_written, 0)) {
+                if(bytes_written != fsize32) push_error(ErrorType_did_not_write_entire_file);
+                else                         res = true;
+            }
         }
 
         CloseHandle(fhandle);
@@ -106,27 +199,13 @@ Bool system_write_to_file(Char const *fname, Char const *data, PtrSize data_size
     return res;
 }
 
-PtrSize system_get_file_size(Char const *fname) {
-    PtrSize res = 0;
-    HANDLE fhandle;
-    LARGE_INTEGER large_int;
-
+Bool system_file_exists(Char const *fname) {
     PtrSize const name_buf_size = 256;
     Char name_buf[name_buf_size] = {}; // MAX_PATH?
     string_concat(name_buf, name_buf_size, global_folder, string_length(global_folder), fname, string_length(fname));
 
-    fhandle = CreateFileA(name_buf, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-    if(fhandle != INVALID_HANDLE_VALUE) {
-        if(GetFileSizeEx(fhandle, &large_int)) {
-#if ENVIRONMENT32
-            res = safe_truncate_size_64(large_int.QuadPart);
-#else
-            res = large_int.QuadPart;
-#endif
-        }
-
-        CloseHandle(fhandle);
-    }
+    DWORD attributes = GetFileAttributesA(name_buf);
+    Bool res = ((attributes != INVALID_FILE_ATTRIBUTES) && (!(attributes & FILE_ATTRIBUTE_DIRECTORY)));
 
     return(res);
 }
@@ -151,11 +230,15 @@ Void system_write_to_console(Char const *str, ...) {
     va_start(args, str);
     PtrSize bytes_written = stbsp_vsnprintf(buf, buf_size, str, args);
 
-    printf("%s", buf);
+    if(!capture_console_output(buf, string_length(buf), false)) {
+        printf("%s", buf);
+    }
 }
 
 Void system_write_to_stderr(Char const *str) {
-    fprintf(stderr, "%s", str);
+    if(!capture_console_output(str, string_length(str), true)) {
+        fprintf(stderr, "%s", str);
+    }
 }
 
 Char const *system_get_file_extension(Char const *fname) {
@@ -164,6 +247,120 @@ Char const *system_get_file_extension(Char const *fname) {
     return(res);
 }
 
+internal DWORD WINAPI win32_thread_proc(LPVOID param) {
+    Thread *thread = cast(Thread *)param;
+    thread->proc(thread->data);
+
+    return(0);
+}
+
+Bool system_create_thread(Thread *thread, ThreadProc *proc, Void *data) {
+    Bool res = false;
+
+    thread->proc = proc;
+    thread->data = data;
+
+    HANDLE handle = CreateThread(0, 0, win32_thread_proc, thread, 0, 0);
+    if(handle) {
+        thread->handle = cast(Uint64)handle;
+        res = true;
+    }
+
+    return(res);
+}
+
+Void system_join_thread(Thread *thread) {
+    HANDLE handle = cast(HANDLE)thread->handle;
+    if(handle) {
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+        thread->handle = 0;
+    }
+}
+
+Void system_yield_thread(void) {
+    SwitchToThread();
+}
+
+Int system_get_processor_count(void) {
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+
+    Int res = (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+
+    return(res);
+}
+
+Bool system_create_semaphore(Semaphore *semaphore) {
+    semaphore->handle = CreateSemaphoreA(0, 0, 0x7FFFFFFF, 0);
+
+    return(semaphore->handle != 0);
+}
+
+Void system_destroy_semaphore(Semaphore *semaphore) {
+    if(semaphore->handle) {
+        CloseHandle(cast(HANDLE)semaphore->handle);
+        semaphore->handle = 0;
+    }
+}
+
+Void system_signal_semaphore(Semaphore *semaphore, Int cnt/*= 1*/) {
+    ReleaseSemaphore(cast(HANDLE)semaphore->handle, cnt, 0);
+}
+
+Void system_wait_semaphore(Semaphore *semaphore) {
+    WaitForSingleObject(cast(HANDLE)semaphore->handle, INFINITE);
+}
+
+Uint64 system_get_performance_counter(void) {
+    LARGE_INTEGER counter = {};
+    QueryPerformanceCounter(&counter);
+
+    return(counter.QuadPart);
+}
+
+Uint64 system_get_performance_frequency(void) {
+    LARGE_INTEGER freq = {};
+    QueryPerformanceFrequency(&freq);
+
+    return(freq.QuadPart);
+}
+
+Bool system_get_executable_path(Char *buf, Int buf_size) {
+    DWORD len = GetModuleFileNameA(0, buf, buf_size);
+    Bool res = ((len > 0) && (cast(Int)len < buf_size));
+
+    return(res);
+}
+
+Bool system_get_working_directory(Char *buf, Int buf_size) {
+    DWORD len = GetCurrentDirectoryA(buf_size, buf);
+    Bool res = ((len > 0) && (cast(Int)len < buf_size));
+
+    return(res);
+}
+
+Bool system_set_working_directory(Char const *path) {
+    Bool res = (SetCurrentDirectoryA(path) != 0);
+
+    return(res);
+}
+
+// There's no file watcher or local socket on Windows, so main turns down --watch and --server before these are ever
+// called. They're only here so it links, and so --client can fail to connect and run the command line itself.
+Bool system_create_file_watcher(FileWatcher *watcher) { return(false); }
+Void system_destroy_file_watcher(FileWatcher *watcher) {}
+Bool system_watch_file(FileWatcher *watcher, Char const *fname, Int id) { return(false); }
+Int system_wait_for_file_changes(FileWatcher *watcher, Int *ids, Int max_ids, Int timeout_ms) { return(-1); }
+
+Bool system_listen_local_socket(LocalSocket *sock, Char const *path) { return(false); }
+Bool system_accept_local_socket(LocalSocket *listener, LocalSocket *res) { return(false); }
+Bool system_connect_local_socket(LocalSocket *sock, Char const *path) { return(false); }
+Bool system_send_to_local_socket(LocalSocket *sock, Void const *data, PtrSize size) { return(false); }
+Bool system_receive_from_local_socket(LocalSocket *sock, Void *data, PtrSize size) { return(false); }
+Void system_close_local_socket(LocalSocket *sock) {}
+Void system_remove_local_socket(Char const *path) {}
+
 //
 // Linux
 //
@@ -173,18 +370,30 @@ Char const *system_get_file_extension(Char const *fname) {
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <unistd.h>
-
-Void *system_malloc(PtrSize size, PtrSize cnt/*= 1*/) {
-    Void *res = malloc(size * cnt);
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include <poll.h>
+
+internal Void *system_malloc_os(PtrSize size) {
+    Void *res = malloc(size);
     if(res) {
-        zero(res, size * cnt);
+        zero(res, size);
     }
 
     return(res);
 }
 
-Bool system_free(Void *ptr) {
+internal Bool system_free_os(Void *ptr) {
     Bool res = false;
     if(ptr) {
         free(ptr);
@@ -194,69 +403,132 @@ Bool system_free(Void *ptr) {
     return(res);
 }
 
-Void *system_realloc(Void *ptr, PtrSize new_size) {
+internal Void *system_realloc_os(Void *ptr, PtrSize new_size) {
     Void *res = realloc(ptr, new_size);
     // TODO(Jonny): Is there a realloc and zero for linux?
 
     return(res);
 }
 
-File system_read_entire_file_and_null_terminate(Char const *fname, Void *memory) {
+internal Void *system_alloc_pages_os(PtrSize size) {
+    Void *res = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(res == MAP_FAILED) {
+        res = 0;
+    }
+
+    return(res);
+}
+
+internal Void system_free_pages_os(Void *ptr, PtrSize size) {
+    if(ptr) {
+        munmap(ptr, size);
+    }
+}
+
+File system_map_file(Char const *fname) {
     File res = {};
 
     PtrSize const name_buf_size = 256;
     Char name_buf[name_buf_size] = {}; // MAX_PATH?
     string_concat(name_buf, name_buf_size, global_folder, string_length(global_folder), fname, string_length(fname));
 
-    FILE *file = fopen(name_buf, "r");
-    if(file) {
-        fseek(file, 0, SEEK_END);
-        res.size = ftell(file);
-        fseek(file, 0, SEEK_SET);
+    Int fd = open(name_buf, O_RDONLY);
+    if(fd != -1) {
+        struct stat st = {};
+        if((fstat(fd, &st) == 0) && (S_ISREG(st.st_mode))) {
+            if(!st.st_size) {
+                // mmap fails on an empty file, so just hand back an empty (static) string.
+                res.data = cast(Char *)"";
+            } else {
+                Void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(p != MAP_FAILED) {
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+                    res.data = cast(Char *)p;
+                    res.size = st.st_size;
+                }
+            }
+        }
 
-        res.data = cast(Char *)memory;
-        fread(res.data, 1, res.size, file);
-        fclose(file);
+        // The mapping stays valid after the descriptor is closed.
+        close(fd);
     }
 
     return(res);
 }
 
-Bool system_write_to_file(Char const *fname, Char const *data, PtrSize data_size) {
-    assert(data_size > 0);
+Void system_unmap_file(File *file) {
+    if((file->data) && (file->size)) {
+        munmap(file->data, file->size);
+    }
+
+    file->data = 0;
+    file->size = 0;
+}
 
+// Hands all the chunks to writev at once, so a whole file is usually one system call.
+Bool system_write_chunks_to_file(Char const *fname, FileChunk *chunks, Int chunk_count) {
     Bool res = false;
 
     PtrSize const name_buf_size = 256;
     Char name_buf[name_buf_size] = {}; // MAX_PATH?
     string_concat(name_buf, name_buf_size, global_folder, string_length(global_folder), fname, string_length(fname));
 
-    FILE *file = fopen(name_buf, "w");
-    if(file) {
-        fwrite(data, 1, data_size, file);
-        fclose(file);
+    Int fd = open(name_buf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd != -1) {
         res = true;
+
+        // writev can write less than it was asked to, so keep track of how far through the chunks it's got.
+        Int chunk_index = 0;
+        PtrSize chunk_offset = 0;
+        while((res) && (chunk_index < chunk_count)) {
+            struct iovec iov[256];
+            Int iov_count = 0;
+            for(Int i = chunk_index; (i < chunk_count) && (iov_count < array_count(iov)); ++i, ++iov_count) {
+                PtrSize offset = (i == chunk_index) ? chunk_offset : 0;
+                iov[iov_count].iov_base = cast(Void *)(chunks[i].data + offset);
+                iov[iov_count].iov_len = chunks[i].size - offset;
+            }
+
+            ssize_t written = writev(fd, iov, iov_count);
+            if(written < 0) {
+                if(errno != EINTR) {
+                    push_error(ErrorType_did_not_write_entire_file);
+                    res = false;
+                }
+            } else {
+                PtrSize left = cast(PtrSize)written;
+                Int start_index = chunk_index;
+                PtrSize start_offset = chunk_offset;
+                while((chunk_index < chunk_count) && (left >= chunks[chunk_index].size - chunk_offset)) {
+                    left -= chunks[chunk_index].size - chunk_offset;
+                    chunk_offset = 0;
+                    ++chunk_index;
+                }
+                chunk_offset += left;
+
+                if((chunk_index == start_index) && (chunk_offset == start_offset)) {
+                    push_error(ErrorType_did_not_write_entire_file);
+                    res = false;
+                }
+            }
+        }
+
+        close(fd);
     }
 
     return(res);
 }
 
-PtrSize system_get_file_size(Char const *fname) {
-    PtrSize size = 0;
-
+Bool system_file_exists(Char const *fname) {
     PtrSize const name_buf_size = 256;
     Char name_buf[name_buf_size] = {}; // MAX_PATH?
     string_concat(name_buf, name_buf_size, global_folder, string_length(global_folder), fname, string_length(fname));
 
-    FILE *file = fopen(name_buf, "r");
-    if(file) {
-        fseek(file, 0, SEEK_END);
-        size = ftell(file) + 1;
-        fseek(file, 0, SEEK_SET);
-        fclose(file);
-    }
+    struct stat st = {};
+    Bool res = ((stat(name_buf, &st) == 0) && (S_ISREG(st.st_mode)));
 
-    return(size);
+    return(res);
 }
 
 Bool system_create_folder(Char const *name) {
@@ -278,11 +550,15 @@ Void system_write_to_console(Char const *str, ...) {
     PtrSize bytes_written = stbsp_vsnprintf(buf, buf_size, str, args);
     assert(bytes_written < buf_size);
 
-    printf("%s", buf);
+    if(!capture_console_output(buf, string_length(buf), false)) {
+        printf("%s", buf);
+    }
 }
 
 Void system_write_to_stderr(Char const *str) {
-    fprintf(stderr, "%s", str);
+    if(!capture_console_output(str, string_length(str), true)) {
+        fprintf(stderr, "%s", str);
+    }
 }
 
 Char const *system_get_file_extension(Char const *fname) {
@@ -296,5 +572,742 @@ Char const *system_get_file_extension(Char const *fname) {
     return(res);
 }
 
+internal Void *linux_thread_proc(Void *param) {
+    Thread *thread = cast(Thread *)param;
+    thread->proc(thread->data);
+
+    return(0);
+}
+
+Bool system_create_thread(Thread *thread, ThreadProc *proc, Void *data) {
+    Bool res = false;
+
+    thread->proc = proc;
+    thread->data = data;
+
+    pthread_t handle;
+    if(pthread_create(&handle, 0, linux_thread_proc, thread) == 0) {
+        thread->handle = cast(Uint64)handle;
+        res = true;
+    }
+
+    return(res);
+}
+
+Void system_join_thread(Thread *thread) {
+    if(thread->handle) {
+        pthread_join(cast(pthread_t)thread->handle, 0);
+        thread->handle = 0;
+    }
+}
+
+Void system_yield_thread(void) {
+    sched_yield();
+}
+
+Int system_get_processor_count(void) {
+    Int res = cast(Int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(res < 1) {
+        res = 1;
+    }
+
+    return(res);
+}
+
+Bool system_create_semaphore(Semaphore *semaphore) {
+    Bool res = false;
+
+    sem_t *sem = system_alloc(sem_t);
+    if(sem) {
+        if(sem_init(sem, 0, 0) == 0) {
+            semaphore->handle = sem;
+            res = true;
+        } else {
+            system_free(sem);
+        }
+    }
+
+    return(res);
+}
+
+Void system_destroy_semaphore(Semaphore *semaphore) {
+    if(semaphore->handle) {
+        sem_destroy(cast(sem_t *)semaphore->handle);
+        system_free(semaphore->handle);
+        semaphore->handle = 0;
+    }
+}
+
+Void system_signal_semaphore(Semaphore *semaphore, Int cnt/*= 1*/) {
+    for(Int i = 0; (i < cnt); ++i) {
+        sem_post(cast(sem_t *)semaphore->handle);
+    }
+}
+
+Void system_wait_semaphore(Semaphore *semaphore) {
+    // sem_wait can be interrupted by a signal, so keep going until it actually succeeds.
+    while(sem_wait(cast(sem_t *)semaphore->handle) != 0) {}
+}
+
+Uint64 system_get_performance_counter(void) {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    Uint64 res = (cast(Uint64)ts.tv_sec * 1000000000ull) + cast(Uint64)ts.tv_nsec;
+
+    return(res);
+}
+
+Uint64 system_get_performance_frequency(void) {
+    return(1000000000ull); // clock_gettime is in nanoseconds.
+}
+
+
+Bool system_get_executable_path(Char *buf, Int buf_size) {
+    Bool res = false;
+
+    ssize_t len = readlink("/proc/self/exe", buf, buf_size);
+    if((len > 0) && (len < buf_size)) {
+        buf[len] = 0;
+        res = true;
+    }
+
+    return(res);
+}
+
+Bool system_get_working_directory(Char *buf, Int buf_size) {
+    Bool res = (getcwd(buf, buf_size) != 0);
+
+    return(res);
+}
+
+Bool system_set_working_directory(Char const *path) {
+    Bool res = (chdir(path) == 0);
+
+    return(res);
+}
+
+// inotify loses track of a file when an editor saves by writing a new file and renaming it over the old one. So the
+// folders are watched instead, and events are matched up to files by name.
+struct LinuxWatchedFile {
+    Int wd;
+    Char *name; // Without the folder.
+    Int id;
+};
+
+struct LinuxFileWatcher {
+    LinuxWatchedFile *files;
+    Int cnt;
+    Int max;
+};
+
+Bool system_create_file_watcher(FileWatcher *watcher) {
+    Bool res = false;
+
+    zero(watcher, sizeof(*watcher));
+    Int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd != -1) {
+        LinuxFileWatcher *data = system_alloc(LinuxFileWatcher);
+        if(data) {
+            zero(data, sizeof(*data));
+            watcher->handle = fd;
+            watcher->data = data;
+            res = true;
+        } else {
+            close(fd);
+        }
+    }
+
+    return(res);
+}
+
+Void system_destroy_file_watcher(FileWatcher *watcher) {
+    LinuxFileWatcher *data = cast(LinuxFileWatcher *)watcher->data;
+    if(data) {
+        for(Int i = 0; (i < data->cnt); ++i) {
+            system_free(data->files[i].name);
+        }
+
+        system_free(data->files);
+        system_free(data);
+        close(cast(Int)watcher->handle);
+    }
+
+    zero(watcher, sizeof(*watcher));
+}
+
+Bool system_watch_file(FileWatcher *watcher, Char const *fname, Int id) {
+    Bool res = false;
+
+    LinuxFileWatcher *data = cast(LinuxFileWatcher *)watcher->data;
+
+    PtrSize const name_buf_size = 256;
+    Char name_buf[name_buf_size] = {}; // MAX_PATH?
+    string_concat(name_buf, name_buf_size, global_folder, string_length(global_folder), fname, string_length(fname));
+
+    // Split it into the folder and the name.
+    Char const *folder = ".";
+    Char *name = name_buf;
+    for(Char *at = name_buf; (*at); ++at) {
+        if(*at == '/') {
+            name = at + 1;
+        }
+    }
+    if(name != name_buf) {
+        name[-1] = 0;
+        folder = (name_buf[0]) ? name_buf : "/";
+    }
+
+    if((data) && (*name)) {
+        if(data->cnt >= data->max) {
+            Int new_max = (data->max) ? data->max * 2 : 32;
+            LinuxWatchedFile *p = cast(LinuxWatchedFile *)system_realloc(data->files, sizeof(LinuxWatchedFile) * new_max);
+            if(p) {
+                data->files = p;
+                data->max = new_max;
+            }
+        }
+
+        // Watching the same folder twice just gives back the same wd.
+        Int wd = inotify_add_watch(cast(Int)watcher->handle, folder, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if((wd != -1) && (data->cnt < data->max)) {
+            Int len = string_length(name);
+            Char *name_copy = system_alloc(Char, len + 1);
+            if(name_copy) {
+                string_copy(name_copy, name);
+                name_copy[len] = 0;
+
+                LinuxWatchedFile *file = data->files + data->cnt++;
+                file->wd = wd;
+                file->name = name_copy;
+                file->id = id;
+
+                res = true;
+            }
+        }
+    }
+
+    return(res);
+}
+
+Int system_wait_for_file_changes(FileWatcher *watcher, Int *ids, Int max_ids, Int timeout_ms) {
+    Int res = 0;
+
+    LinuxFileWatcher *data = cast(LinuxFileWatcher *)watcher->data;
+    Int fd = cast(Int)watcher->handle;
+
+    pollfd pfd = {};
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    Int poll_res = poll(&pfd, 1, timeout_ms);
+    if(poll_res < 0) {
+        res = (errno == EINTR) ? 0 : -1;
+    } else if(poll_res > 0) {
+        // Buffer has to be aligned for inotify_event.
+        Char buf[4096] __attribute__((aligned(__alignof__(inotify_event))));
+        for(;;) {
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if(len <= 0) {
+                break; // for
+            }
+
+            for(Char *at = buf; (at < buf + len); ) {
+                inotify_event *event = cast(inotify_event *)at;
+                if(event->len) {
+                    for(Int i = 0; (i < data->cnt); ++i) {
+                        LinuxWatchedFile *file = data->files + i;
+                        if((file->wd == event->wd) && (string_compare(file->name, event->name))) {
+                            Bool already_added = false;
+                            for(Int j = 0; (j < res); ++j) {
+                                if(ids[j] == file->id) {
+                                    already_added = true;
+                                    break; // for
+                                }
+                            }
+
+                            if((!already_added) && (res < max_ids)) {
+                                ids[res++] = file->id;
+                            }
+                        }
+                    }
+                }
+
+                at += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+
+    return(res);
+}
+
+internal Bool linux_get_socket_address(Char const *path, sockaddr_un *addr) {
+    Bool res = false;
+
+    zero(addr, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    Int len = string_length(path);
+    if(len < cast(Int)sizeof(addr->sun_path)) {
+        copy(addr->sun_path, cast(Void *)path, len);
+        res = true;
+    }
+
+    return(res);
+}
+
+Bool system_listen_local_socket(LocalSocket *sock, Char const *path) {
+    Bool res = false;
+
+    sockaddr_un addr;
+    if(linux_get_socket_address(path, &addr)) {
+        Int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd != -1) {
+            Int bind_res = bind(fd, cast(sockaddr *)&addr, sizeof(addr));
+            if((bind_res == -1) && (errno == EADDRINUSE)) {
+                // Either another server's using it, or one didn't clean up after itself.
+                LocalSocket other = {};
+                if(system_connect_local_socket(&other, path)) {
+                    system_close_local_socket(&other);
+                } else {
+                    unlink(path);
+                    bind_res = bind(fd, cast(sockaddr *)&addr, sizeof(addr));
+                }
+            }
+
+            if((bind_res == 0) && (listen(fd, 64) == 0)) {
+                sock->handle = fd;
+                res = true;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    return(res);
+}
+
+Bool system_accept_local_socket(LocalSocket *listener, LocalSocket *res_sock) {
+    Bool res = false;
+
+    Int fd = -1;
+    do {
+        fd = accept4(cast(Int)listener->handle, 0, 0, SOCK_CLOEXEC);
+    } while((fd == -1) && (errno == EINTR));
+
+    if(fd != -1) {
+        res_sock->handle = fd;
+        res = true;
+    }
+
+    return(res);
+}
+
+Bool system_connect_local_socket(LocalSocket *sock, Char const *path) {
+    Bool res = false;
+
+    sockaddr_un addr;
+    if(linux_get_socket_address(path, &addr)) {
+        Int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd != -1) {
+            if(connect(fd, cast(sockaddr *)&addr, sizeof(addr)) == 0) {
+                sock->handle = fd;
+                res = true;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    return(res);
+}
+
+Bool system_send_to_local_socket(LocalSocket *sock, Void const *data, PtrSize size) {
+    Byte const *at = cast(Byte const *)data;
+    while(size > 0) {
+        // MSG_NOSIGNAL, so a client going away doesn't kill the server with SIGPIPE.
+        ssize_t sent = send(cast(Int)sock->handle, at, size, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR) { continue; }
+            break; // while
+        }
+
+        at += sent;
+        size -= sent;
+    }
+
+    return(size == 0);
+}
+
+Bool system_receive_from_local_socket(LocalSocket *sock, Void *data, PtrSize size) {
+    Byte *at = cast(Byte *)data;
+    while(size > 0) {
+        ssize_t received = recv(cast(Int)sock->handle, at, size, 0);
+        if(received <= 0) {
+            if((received < 0) && (errno == EINTR)) { continue; }
+            break; // while
+        }
+
+        at += received;
+        size -= received;
+    }
+
+    return(size == 0);
+}
+
+Void system_close_local_socket(LocalSocket *sock) {
+    close(cast(Int)sock->handle);
+    sock->handle = -1;
+}
+
+Void system_remove_local_socket(Char const *path) {
+    unlink(path);
+}
+
+#endif
+
+//
+// Memory.
+//
+#if MEM_CHECK
+
+// Allocations are looked up by pointer, and sites by their MAKE_GUID string. Both tables use the _os functions directly,
+// so they're never tracked themselves.
+struct AllocationSite {
+    Char const *guid;
+    PtrSize live_size;
+    PtrSize peak_size;
+    PtrSize total_size;
+    Int allocation_count;
+    Int live_count;
+
+    PtrSize pushed_size; // Onto arenas. The arena's blocks are counted against whichever push needed them.
+    Int push_count;
+};
+
+struct Allocation {
+    Void *ptr; // 0 if the slot's empty.
+    PtrSize size;
+    Int site;
+};
+
+internal Int volatile global_allocation_lock = 0;
+// Once the table's full, any new sites all go into the last one.
+#define allocation_site_max 1024
+internal AllocationSite global_allocation_sites[allocation_site_max + 1];
+internal Allocation *global_allocations = 0;
+internal PtrSize global_allocation_max = 0; // Always a power of 2.
+internal PtrSize global_allocation_count = 0;
+internal PtrSize global_live_allocation_size = 0;
+
+internal PtrSize hash_allocation_ptr(Void *ptr) {
+    PtrSize res = cast(PtrSize)((cast(Uint64)ptr >> 4) * 11400714819323198485ull);
+
+    return(res);
+}
+
+internal Int get_allocation_site(Char const *guid) {
+    Int res = allocation_site_max;
+
+    // The same file and line can have different strings in different translation units, so compare the text.
+    Int mask = allocation_site_max - 1;
+    Int start = cast(Int)hash_bytes(guid, string_length(guid)) & mask;
+    for(Int i = 0; (i < allocation_site_max); ++i) {
+        Int index = (start + i) & mask;
+        AllocationSite *site = global_allocation_sites + index;
+        if((!site->guid) || (string_compare(site->guid, guid))) {
+            site->guid = guid;
+            res = index;
+
+            break; // for
+        }
+    }
+
+    if(res == allocation_site_max) {
+        global_allocation_sites[res].guid = "other";
+    }
+
+    return(res);
+}
+
+internal Void grow_allocation_table(void) {
+    Allocation *old_allocations = global_allocations;
+    PtrSize old_max = global_allocation_max;
+
+    global_allocation_max = (old_max) ? old_max * 2 : 4096;
+    global_allocations = cast(Allocation *)system_alloc_pages_os(sizeof(Allocation) * global_allocation_max);
+    assert(global_allocations);
+
+    PtrSize mask = global_allocation_max - 1;
+    for(PtrSize i = 0; (i < old_max); ++i) {
+        if(old_allocations[i].ptr) {
+            PtrSize j = hash_allocation_ptr(old_allocations[i].ptr) & mask;
+            while(global_allocations[j].ptr) {
+                j = (j + 1) & mask;
+            }
+
+            global_allocations[j] = old_allocations[i];
+        }
+    }
+
+    system_free_pages_os(old_allocations, sizeof(Allocation) * old_max);
+}
+
+// Must hold global_allocation_lock.
+internal Void track_allocation(Char const *guid, Void *ptr, PtrSize size) {
+    if((global_allocation_count + 1) * 2 > global_allocation_max) {
+        grow_allocation_table();
+    }
+
+    PtrSize mask = global_allocation_max - 1;
+    PtrSize i = hash_allocation_ptr(ptr) & mask;
+    while(global_allocations[i].ptr) {
+        i = (i + 1) & mask;
+    }
+
+    Int site_index = get_allocation_site(guid);
+    Allocation *allocation = global_allocations + i;
+    allocation->ptr = ptr;
+    allocation->size = size;
+    allocation->site = site_index;
+    ++global_allocation_count;
+    global_live_allocation_size += size;
+
+    AllocationSite *site = global_allocation_sites + site_index;
+    site->live_size += size;
+    site->total_size += size;
+    ++site->allocation_count;
+    ++site->live_count;
+    if(site->live_size > site->peak_size) {
+        site->peak_size = site->live_size;
+    }
+}
+
+// Must hold global_allocation_lock. Returns the slot ptr's in, or -1 if it was never allocated (or was already freed).
+internal Int find_allocation(Void *ptr) {
+    Int res = -1;
+
+    if(global_allocation_max) {
+        PtrSize mask = global_allocation_max - 1;
+        PtrSize i = hash_allocation_ptr(ptr) & mask;
+        while((global_allocations[i].ptr) && (global_allocations[i].ptr != ptr)) {
+            i = (i + 1) & mask;
+        }
+
+        if(global_allocations[i].ptr) {
+            res = cast(Int)i;
+        }
+    }
+
+    return(res);
+}
+
+// Must hold global_allocation_lock. Returns false if ptr isn't tracked.
+internal Bool untrack_allocation(Void *ptr) {
+    Bool res = false;
+
+    Int index = find_allocation(ptr);
+    if(index != -1) {
+        PtrSize mask = global_allocation_max - 1;
+        PtrSize i = cast(PtrSize)index;
+        AllocationSite *site = global_allocation_sites + global_allocations[i].site;
+        site->live_size -= global_allocations[i].size;
+        --site->live_count;
+        global_live_allocation_size -= global_allocations[i].size;
+        --global_allocation_count;
+
+        // Shift anything after it back, so lookups never stop early at the gap.
+        PtrSize j = (i + 1) & mask;
+        while(global_allocations[j].ptr) {
+            PtrSize k = hash_allocation_ptr(global_allocations[j].ptr) & mask;
+            Bool stays = (i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j));
+            if(!stays) {
+                global_allocations[i] = global_allocations[j];
+                i = j;
+            }
+
+            j = (j + 1) & mask;
+        }
+
+        zero(global_allocations + i, sizeof(Allocation));
+        res = true;
+    }
+
+    return(res);
+}
+
+Void *system_malloc_(Char const *guid, PtrSize size, PtrSize cnt/*= 1*/) {
+    Void *res = system_malloc_os(size * cnt);
+    if(res) {
+        system_lock(&global_allocation_lock);
+        track_allocation(guid, res, size * cnt);
+        system_unlock(&global_allocation_lock);
+    }
+
+    return(res);
+}
+
+Bool system_free_(Char const *guid, Void *ptr) {
+    Bool res = false;
+    if(ptr) {
+        system_lock(&global_allocation_lock);
+        Bool found = untrack_allocation(ptr);
+        system_unlock(&global_allocation_lock);
+
+        // Freeing it anyway would probably crash, so leave it and say where it happened.
+        if(found) { res = system_free_os(ptr);                                }
+        else      { push_error_(ErrorType_could_not_find_mallocd_ptr, guid); }
+    }
+
+    return(res);
+}
+
+Void *system_realloc_(Char const *guid, Void *ptr, PtrSize size) {
+    // Held over the realloc, otherwise another thread could be given ptr back before it's untracked.
+    system_lock(&global_allocation_lock);
+
+    Void *res = 0;
+    if((ptr) && (find_allocation(ptr) == -1)) {
+        push_error_(ErrorType_could_not_find_mallocd_ptr, guid);
+    } else {
+        res = system_realloc_os(ptr, size);
+
+        // The memory's counted against whoever grew it last, because that's what's making it bigger. If it failed, ptr
+        // is still there, and still tracked.
+        if(res) {
+            if(ptr) {
+                untrack_allocation(ptr);
+            }
+
+            track_allocation(guid, res, size);
+        }
+    }
+
+    system_unlock(&global_allocation_lock);
+
+    return(res);
+}
+
+Void *system_alloc_pages_(Char const *guid, PtrSize size) {
+    Void *res = system_alloc_pages_os(size);
+    if(res) {
+        system_lock(&global_allocation_lock);
+        track_allocation(guid, res, size);
+        system_unlock(&global_allocation_lock);
+    }
+
+    return(res);
+}
+
+Void system_free_pages_(Char const *guid, Void *ptr, PtrSize size) {
+    if(ptr) {
+        system_lock(&global_allocation_lock);
+        Bool found = untrack_allocation(ptr);
+        system_unlock(&global_allocation_lock);
+
+        if(found) { system_free_pages_os(ptr, size);                          }
+        else      { push_error_(ErrorType_could_not_find_mallocd_ptr, guid); }
+    }
+}
+
+Void system_track_arena_push_(Char const *guid, PtrSize size) {
+    system_lock(&global_allocation_lock);
+
+    AllocationSite *site = global_allocation_sites + get_allocation_site(guid);
+    site->pushed_size += size;
+    ++site->push_count;
+
+    system_unlock(&global_allocation_lock);
+}
+
+PtrSize system_get_live_allocation_size(void) {
+    system_lock(&global_allocation_lock);
+    PtrSize res = global_live_allocation_size;
+    system_unlock(&global_allocation_lock);
+
+    return(res);
+}
+
+Void print_memory_report(void) {
+    system_lock(&global_allocation_lock);
+
+    Int sites[array_count(global_allocation_sites)] = {};
+    Int site_count = 0;
+    for(Int i = 0; (i < array_count(global_allocation_sites)); ++i) {
+        AllocationSite *site = global_allocation_sites + i;
+        if(site->guid) {
+            // Insertion sort, biggest peak first, then most pushed onto arenas. There's only ever a few hundred.
+            Int j = site_count++;
+            while(j > 0) {
+                AllocationSite *prev = global_allocation_sites + sites[j - 1];
+                if((prev->peak_size > site->peak_size) ||
+                   ((prev->peak_size == site->peak_size) && (prev->pushed_size >= site->pushed_size))) {
+                    break; // while
+                }
+
+                sites[j] = sites[j - 1];
+                --j;
+            }
+
+            sites[j] = i;
+        }
+    }
+
+    Char buf[1024] = {};
+    stbsp_snprintf(buf, array_count(buf),
+                   "\nMemory by call site (%llu bytes still allocated):\n%14s %14s %14s %8s %8s %14s %8s  %s\n",
+                   cast(unsigned long long)global_live_allocation_size,
+                   "peak", "live", "total", "allocs", "live", "pushed", "pushes", "site");
+    system_write_to_stderr(buf);
+
+    for(Int i = 0; (i < site_count); ++i) {
+        AllocationSite *site = global_allocation_sites + sites[i];
+
+        // MAKE_GUID's made for error messages, so trim the "error" off the end.
+        Char const *error_suffix = ":1: error:";
+        Int guid_len = string_length(site->guid);
+        Int suffix_len = string_length(error_suffix);
+        if((guid_len > suffix_len) && (string_compare(site->guid + guid_len - suffix_len, error_suffix))) {
+            guid_len -= suffix_len;
+        }
+
+        stbsp_snprintf(buf, array_count(buf), "%14llu %14llu %14llu %8d %8d %14llu %8d  %.*s\n",
+                       cast(unsigned long long)site->peak_size, cast(unsigned long long)site->live_size,
+                       cast(unsigned long long)site->total_size, site->allocation_count, site->live_count,
+                       cast(unsigned long long)site->pushed_size, site->push_count, guid_len, site->guid);
+        system_write_to_stderr(buf);
+    }
+
+    system_unlock(&global_allocation_lock);
+}
+
+#else
+
+Void *system_malloc(PtrSize size, PtrSize cnt/*= 1*/) {
+    Void *res = system_malloc_os(size * cnt);
+
+    return(res);
+}
+
+Bool system_free(Void *ptr) {
+    Bool res = system_free_os(ptr);
+
+    return(res);
+}
+
+Void *system_realloc(Void *ptr, PtrSize size) {
+    Void *res = system_realloc_os(ptr, size);
+
+    return(res);
+}
+
+Void *system_alloc_pages(PtrSize size) {
+    Void *res = system_alloc_pages_os(size);
+
+    return(res);
+}
+
+Void system_free_pages(Void *ptr, PtrSize size) {
+    system_free_pages_os(ptr, size);
+}
 
 #endif
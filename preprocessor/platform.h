@@ -13,10 +13,34 @@
 
 #include "shared.h"
 
-// Memory.
-Void *system_malloc(PtrSize size, PtrSize cnt = 1);
-Bool system_free(Void *ptr);
-Void *system_realloc(Void *ptr, PtrSize size);
+// Memory. system_alloc_pages comes straight from the OS, and is already zeroed. For big blocks, like the ones in
+// MemoryArena.
+#if MEM_CHECK
+    // Every allocation's recorded against the line that made it, so print_memory_report can show where memory goes.
+    Void *system_malloc_(Char const *guid, PtrSize size, PtrSize cnt = 1);
+    Bool system_free_(Char const *guid, Void *ptr);
+    Void *system_realloc_(Char const *guid, Void *ptr, PtrSize size);
+    Void *system_alloc_pages_(Char const *guid, PtrSize size);
+    Void system_free_pages_(Char const *guid, Void *ptr, PtrSize size);
+
+    #define system_malloc(...) system_malloc_(MAKE_GUID, __VA_ARGS__)
+    #define system_free(ptr) system_free_(MAKE_GUID, ptr)
+    #define system_realloc(ptr, size) system_realloc_(MAKE_GUID, ptr, size)
+    #define system_alloc_pages(size) system_alloc_pages_(MAKE_GUID, size)
+    #define system_free_pages(ptr, size) system_free_pages_(MAKE_GUID, ptr, size)
+
+    // Arena pushes are never freed one at a time, so they're only added to the site's pushed bytes.
+    Void system_track_arena_push_(Char const *guid, PtrSize size);
+
+    PtrSize system_get_live_allocation_size(void);
+    Void print_memory_report(void); // Every call site, biggest peak first.
+#else
+    Void *system_malloc(PtrSize size, PtrSize cnt = 1);
+    Bool system_free(Void *ptr);
+    Void *system_realloc(Void *ptr, PtrSize size);
+    Void *system_alloc_pages(PtrSize size);
+    Void system_free_pages(Void *ptr, PtrSize size);
+#endif
 #if defined(system_alloc)
     #undef system_alloc
 #endif
@@ -24,9 +48,18 @@ Void *system_realloc(Void *ptr, PtrSize size);
 
 // File IO.
 struct File;
-File system_read_entire_file_and_null_terminate(Char const *fname, Void *memory);
+File system_map_file(Char const *fname); // Read-only, and _not_ null-terminated. data is null on failure.
+Void system_unmap_file(File *file);
 Bool system_write_to_file(Char const *fname, Char const *data, PtrSize data_size);
-PtrSize system_get_file_size(Char const *fname);
+
+// Writes a file out of lots of separate buffers, in one go.
+struct FileChunk {
+    Char const *data;
+    PtrSize size;
+};
+Bool system_write_chunks_to_file(Char const *fname, FileChunk *chunks, Int chunk_count);
+Bool system_write_chunks_to_file_if_changed(Char const *fname, FileChunk *chunks, Int chunk_count, Bool *unchanged);
+Bool system_file_exists(Char const *fname);
 
 Bool system_create_folder(Char const *name);
 
@@ -37,7 +70,112 @@ Void system_write_to_stderr(Char const *str);
 
 Char const *system_get_file_extension(Char const *fname);
 
-Void system_set_current_folder(Char const *folder_name);
+Void system_set_current_folder(Char const *folder_name); // Prefixed onto file names. Null (or "") to clear it.
+
+// Full path of the running executable.
+Bool system_get_executable_path(Char *buf, Int buf_size);
+
+// The process' actual working directory.
+Bool system_get_working_directory(Char *buf, Int buf_size);
+Bool system_set_working_directory(Char const *path);
+
+// While set, everything written with system_write_to_console and system_write_to_stderr goes to proc instead, so
+// --server can send it back to the client. Not thread-safe, set it when nothing else is printing.
+typedef Void ConsoleOutputProc(Char const *str, PtrSize len, Bool is_stderr, Void *data);
+Void system_capture_console(ConsoleOutputProc *proc, Void *data);
+
+// Threads.
+typedef Void ThreadProc(Void *data);
+struct Thread {
+    ThreadProc *proc;
+    Void *data;
+    Uint64 handle;
+};
+
+Bool system_create_thread(Thread *thread, ThreadProc *proc, Void *data);
+Void system_join_thread(Thread *thread);
+Void system_yield_thread(void);
+Int system_get_processor_count(void);
+
+struct Semaphore {
+    Void *handle;
+};
+
+Bool system_create_semaphore(Semaphore *semaphore);
+Void system_destroy_semaphore(Semaphore *semaphore);
+Void system_signal_semaphore(Semaphore *semaphore, Int cnt = 1);
+Void system_wait_semaphore(Semaphore *semaphore);
+
+// Watching files, for --watch. Each file is watched with an id, which is what's handed back when it changes. Saves
+// which replace the file (like most editors do) count as a change.
+struct FileWatcher {
+    Int64 handle;
+    Void *data;
+};
+
+Bool system_create_file_watcher(FileWatcher *watcher);
+Void system_destroy_file_watcher(FileWatcher *watcher);
+Bool system_watch_file(FileWatcher *watcher, Char const *fname, Int id);
+
+// Fills ids with the files which changed (each one only once), and returns how many. Returns 0 if nothing changed
+// within timeout_ms (-1 to wait forever), and -1 on error.
+Int system_wait_for_file_changes(FileWatcher *watcher, Int *ids, Int max_ids, Int timeout_ms);
+
+// Local sockets (Unix domain sockets on Linux), for --server.
+struct LocalSocket {
+    Int64 handle;
+};
+
+Bool system_listen_local_socket(LocalSocket *sock, Char const *path); // Fails if another server is using path.
+Bool system_accept_local_socket(LocalSocket *listener, LocalSocket *res);
+Bool system_connect_local_socket(LocalSocket *sock, Char const *path);
+Bool system_send_to_local_socket(LocalSocket *sock, Void const *data, PtrSize size); // Sends all of it.
+Bool system_receive_from_local_socket(LocalSocket *sock, Void *data, PtrSize size); // Waits for exactly size bytes.
+Void system_close_local_socket(LocalSocket *sock);
+Void system_remove_local_socket(Char const *path);
+
+// Timing.
+Uint64 system_get_performance_counter(void);
+Uint64 system_get_performance_frequency(void); // Counts per second.
+
+// Atomics. These return the new value.
+#if COMPILER_MSVC
+    #include <intrin.h>
+    inline Int system_atomic_add(Int volatile *dst, Int v) {
+        Int res = _InterlockedExchangeAdd(cast(long volatile *)dst, v) + v;
+
+        return(res);
+    }
+
+    inline Int system_atomic_compare_exchange(Int volatile *dst, Int new_value, Int expected) {
+        Int res = _InterlockedCompareExchange(cast(long volatile *)dst, new_value, expected);
+
+        return(res);
+    }
+#else
+    inline Int system_atomic_add(Int volatile *dst, Int v) {
+        Int res = __sync_add_and_fetch(dst, v);
+
+        return(res);
+    }
+
+    inline Int system_atomic_compare_exchange(Int volatile *dst, Int new_value, Int expected) {
+        Int res = __sync_val_compare_and_swap(dst, expected, new_value);
+
+        return(res);
+    }
+#endif
+
+// Spin lock built on the atomics above. Only meant for very short critical sections.
+inline Void system_lock(Int volatile *lock) {
+    while(system_atomic_compare_exchange(lock, 1, 0) != 0) {
+        system_yield_thread();
+    }
+}
+
+inline Void system_unlock(Int volatile *lock) {
+    system_atomic_compare_exchange(lock, 0, 1);
+}
 
 #define _PLATFORM_H
 #endif
\ No newline at end of file
@@ -96,5 +96,58 @@ typedef double Float64;
     #endif
 #endif
 
+// SSE2 is part of x64, so this is only 0 on old x86 builds (or other architectures).
+#define SIMD_SSE2 0
+
+#if (defined(__SSE2__)) || (defined(_M_X64)) || ((defined(_M_IX86_FP)) && (_M_IX86_FP >= 2))
+    #undef SIMD_SSE2
+    #define SIMD_SSE2 1
+#endif
+
+// AddressSanitizer can't tell a deliberate read past the end of a string (which stays on the same page, so can't
+// fault) from a real overflow, so anything doing that has to be turned off for it.
+#define ADDRESS_SANITIZER 0
+
+#if defined(__SANITIZE_ADDRESS__)
+    #undef ADDRESS_SANITIZER
+    #define ADDRESS_SANITIZER 1
+#elif defined(__has_feature)
+    #if __has_feature(address_sanitizer)
+        #undef ADDRESS_SANITIZER
+        #define ADDRESS_SANITIZER 1
+    #endif
+#endif
+
+// Whether the compiler can build AVX2 functions without being told to target AVX2 everywhere. They're only called
+// once the CPU's been checked for it.
+#define SIMD_AVX2 0
+
+#if (SIMD_SSE2) && ((COMPILER_MSVC) || (defined(__x86_64__)) || (defined(__i386__)))
+    #undef SIMD_AVX2
+    #define SIMD_AVX2 1
+#endif
+
+// AVX2 functions have to call _mm256_zeroupper before they return, or call anything else. Otherwise any SSE code run
+// afterwards pays for the top halves of the AVX registers, which made the SSE2 versions slower than the scalar ones.
+// Compilers don't reliably insert it themselves for functions with the AVX2 target attribute.
+#if COMPILER_MSVC
+    #define AVX2_FUNCTION
+#else
+    #define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+// TODO(Jonny): This should probably be a flag, rather than compiled into the preprocessor.
+#if COMPILER_MSVC
+    #define GUID__(file, seperator, line) file seperator line ")"
+    #define GUID_(file, line) GUID__(file, "(", #line)
+    #define GUID(file, line) GUID_(file, line)
+    #define MAKE_GUID GUID(__FILE__, __LINE__)
+#else
+    #define GUID__(file, seperator, line) file seperator line ":1: error:"
+    #define GUID_(file, line) GUID__(file, ":", #line)
+    #define GUID(file, line) GUID_(file, line)
+    #define MAKE_GUID GUID(__FILE__, __LINE__)
+#endif
+
 #define _SHARED_H
 #endif
\ No newline at end of file
@@ -12,6 +12,17 @@
 #include "google_test/gtest.h"
 #include "platform.h"
 #include "lexer.h"
+#include "write_file.h"
+#include "thread_pool.h"
+#include "stb_sprintf.h"
+#if SIMD_SSE2
+    // lexer.cpp includes these too, but they can't go inside the namespace.
+    #include <emmintrin.h>
+    #if SIMD_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+#define LEXER_INCLUDED_FOR_INTERNALS
 namespace {
 #include "lexer.cpp"
 }
@@ -20,17 +31,23 @@ namespace {
 //
 // Test utils.
 //
+internal MemoryArena global_test_arena = {}; // Never cleared, the tests just leak into it.
+
 internal StructData parse_struct_test(Char const *str, int ahead = 0) {
-    Tokenizer tokenizer = {str};
+    TokenArray tokens = tokenize(str, string_length(str));
+    Tokenizer tokenizer = create_tokenizer(&tokens);
 
     eat_token(&tokenizer);
     for(int i = 0; (i < ahead); ++i) {
-        parse_struct(&tokenizer, StructType_struct);
+        parse_struct(&tokenizer, StructType_struct, &global_test_arena);
         eat_token(&tokenizer);
         eat_token(&tokenizer);
     }
 
-    return(parse_struct(&tokenizer, StructType_struct).sd);
+    StructData res = parse_struct(&tokenizer, StructType_struct, &global_test_arena).sd;
+    free_token_array(&tokens);
+
+    return(res);
 }
 
 enum StructCompareFailure {
@@ -129,11 +146,56 @@ TEST(StructTest, struct_name) {
     ASSERT_TRUE(string_compare("my_name", gen.name.e, gen.name.len)) << "Error: Failed to properly generate struct name.";
 }
 
+TEST(StructTest, multiple_declarators_test) {
+    Char const *str = "struct A {\n"
+                      "    int a, *b, c[4];\n"
+                      "    void func(int x, int y) { if(x) { y = 1; } }\n"
+                      "    std::vector<int, Alloc> v = {1, 2}, w;\n"
+                      "};";
+
+    StructData hardcoded = {};
+    hardcoded.name = create_string("A");
+    hardcoded.member_count = 5;
+    hardcoded.members = system_alloc(Variable, hardcoded.member_count);
+    Int member_index = 0;
+    hardcoded.members[member_index++] = create_variable("int", "a");
+    hardcoded.members[member_index++] = create_variable("int", "b", 1);
+    hardcoded.members[member_index++] = create_variable("int", "c", 0, 4);
+    hardcoded.members[member_index++] = create_variable("std::vector<int, Alloc>", "v");
+    hardcoded.members[member_index++] = create_variable("std::vector<int, Alloc>", "w");
+
+    StructData generated = parse_struct_test(str);
+    StructCompareFailure struct_compare_failure = compare_struct_data(hardcoded, generated);
+    ASSERT_TRUE(struct_compare_failure == StructCompareFailure_success)
+            << "Failed because struct_compare_failure == " << struct_compare_failure_to_string(struct_compare_failure);
+}
+
+TEST(StructTest, not_null_terminated_test) {
+    // Memory-mapped files aren't null-terminated, so the tokenizer should stop at the size it's given.
+    Char const *str = "struct A { int a; int b; };struct B { int c; };";
+    Int len = string_contains_pos(str, "struct B");
+
+    TokenArray tokens = tokenize(str, len);
+    Tokenizer tokenizer = create_tokenizer(&tokens);
+    eat_token(&tokenizer);
+    StructData gen = parse_struct(&tokenizer, StructType_struct, &global_test_arena).sd;
+    eat_token(&tokenizer);
+
+    ASSERT_TRUE(gen.member_count == 2) << "Error: Number of members in struct not correct";
+    ASSERT_TRUE(get_token(&tokenizer).type == TokenType_end_of_stream) << "Error: Read past the end of the stream.";
+
+    free_token_array(&tokens);
+}
+
 EnumData parse_enum_test(Char const *str) {
-    Tokenizer tokenizer = {str};
+    TokenArray tokens = tokenize(str, string_length(str));
+    Tokenizer tokenizer = create_tokenizer(&tokens);
 
     eat_token(&tokenizer);
-    return(parse_enum(&tokenizer).ed);
+    EnumData res = parse_enum(&tokenizer, &global_test_arena).ed;
+    free_token_array(&tokens);
+
+    return(res);
 }
 
 TEST(EnumTest, enum_name_test) {
@@ -160,6 +222,840 @@ TEST(EnumTest, enum_number_of_values_test) {
     ASSERT_TRUE(gen.no_of_values == 3) << "Error: Did not generate the correct number of values for an enum.";
 }
 
+internal StructData parse_stream_test(Char const *str) {
+    StructData res = {};
+
+    ParseResult pr = ::parse_stream(str, string_length(str), &global_test_arena); // The one in the anonymous namespace is ambiguous.
+    if(pr.struct_cnt) {
+        res = pr.struct_data[0];
+    }
+
+    return(res);
+}
+
+TEST(MacroTest, macro_expansion_test) {
+    Char const *str = "#define EMPTY\n"
+                      "#define NAME Wrong\n"
+                      "#define NAME Right\n"
+                      "struct EMPTY NAME { int a; };";
+    StructData gen = parse_stream_test(str);
+    ASSERT_TRUE(string_compare("Right", gen.name.e, gen.name.len)) << "Error: Failed to properly expand macros.";
+}
+
+TEST(MacroTest, recursive_macro_test) {
+    Char const *str = "#define A B\n"
+                      "#define B A\n"
+                      "struct Name { A a; };";
+    StructData gen = parse_stream_test(str);
+    ASSERT_TRUE(gen.member_count == 1) << "Error: Failed to handle recursive macros.";
+}
+
+TEST(MacroTest, conditional_compilation_test) {
+    Char const *str = "#define VERSION 3\n"
+                      "#if 0\n"
+                      "    #if 1\n"
+                      "    struct Nested { int a; };\n"
+                      "    #endif\n"
+                      "struct Zero { int a; };\n"
+                      "#elif VERSION > 2 && !defined(OTHER)\n"
+                      "    #ifdef FROM_COMMAND_LINE\n"
+                      "    struct Right { int a; };\n"
+                      "    #else\n"
+                      "    struct Undefined { int a; };\n"
+                      "    #endif\n"
+                      "#else\n"
+                      "struct Else { int a; };\n"
+                      "#endif\n"
+                      "#if (VERSION * 2 == 6) ? 0 : 1\n"
+                      "struct Ternary { int a; };\n"
+                      "#endif\n"
+                      "#if 1\n"
+                      "struct Unterminated { int a; };";
+
+    Char const *defines[] = { "FROM_COMMAND_LINE" };
+    ::set_predefined_macros(defines, array_count(defines));
+    ParseResult pr = ::parse_stream(str, string_length(str), &global_test_arena);
+    ::set_predefined_macros(0, 0);
+
+    ASSERT_TRUE(pr.struct_cnt == 2) << "Error: Didn't skip the right groups.";
+    ASSERT_TRUE(string_compare("Right", pr.struct_data[0].name.e, pr.struct_data[0].name.len));
+    ASSERT_TRUE(string_compare("Unterminated", pr.struct_data[1].name.e, pr.struct_data[1].name.len));
+}
+
+// The values don't point into the stream, so this needs them to be found wherever they are in memory.
+TEST(MacroTest, predefined_macro_expansion_test) {
+    Char const *str = "struct A { TYPE a[SIZE]; FLAG *b; };";
+
+    Char const *defines[] = { "SIZE=4", "TYPE=float", "FLAG" };
+    ::set_predefined_macros(defines, array_count(defines));
+    ParseResult pr = ::parse_stream(str, string_length(str), &global_test_arena);
+    ::set_predefined_macros(0, 0);
+
+    ASSERT_TRUE((pr.struct_cnt == 1) && (pr.members.cnt == 2));
+
+    MemberTable *m = &pr.members;
+    Symbol *sym = pr.symbols.symbols;
+    ASSERT_TRUE((string_compare(sym[m->type_id[0]].str, create_string("float"))) && (m->array_count[0] == 4));
+    ASSERT_TRUE((string_compare(sym[m->type_id[1]].str, create_string("1"))) && (m->ptr[1] == 1));
+}
+
+TEST(StructTest, member_table_test) {
+    Char const *str = "struct A { int a; float *b; };\n"
+                      "class B : public A { public: char c[4]; int d; struct { A e; }; };";
+    ParseResult pr = ::parse_stream(str, string_length(str), &global_test_arena);
+    ASSERT_TRUE(pr.struct_cnt == 2);
+
+    StructData *a = pr.struct_data + 0;
+    StructData *b = pr.struct_data + 1;
+    ASSERT_TRUE((a->first_member == 0) && (a->member_count == 2) && (b->first_member == 2) && (b->member_count == 3))
+            << "Error: Members weren't packed one struct after the other.";
+    ASSERT_TRUE(pr.members.cnt == 5);
+
+    MemberTable *m = &pr.members;
+    Symbol *sym = pr.symbols.symbols;
+    ASSERT_TRUE((string_compare(sym[m->type_id[1]].str, create_string("float"))) && (m->ptr[1] == 1));
+    ASSERT_TRUE((string_compare(sym[m->name_id[2]].str, create_string("c"))) && (m->array_count[2] == 4));
+    ASSERT_TRUE(m->type_id[3] == m->type_id[0]) << "Error: The same type got two IDs.";
+    ASSERT_TRUE(m->type_id[4] == a->name_id);
+    ASSERT_TRUE((m->flags[2] & MemberFlag_access_mask) == Access_public);
+    ASSERT_TRUE((m->flags[4] & MemberFlag_anonymous_depth_mask) && (!(m->flags[3] & MemberFlag_anonymous_depth_mask)));
+    ASSERT_TRUE((b->inherited_count == 1) && (b->inherited_ids[0] == a->name_id));
+}
+
+TEST(StructTest, merge_parse_results_test) {
+    // The same struct and enum in both files, like a header they both include.
+    Char const *a_str = "struct A { int a; B *b; }; enum E { x, y };";
+    Char const *b_str = "struct B : public A { float f; }; struct A { int a; B *b; }; enum E { x, y };";
+
+    MemoryArena arena = {};
+    ParseResult results[2] = {};
+    results[0] = ::parse_stream(a_str, string_length(a_str), &arena);
+    results[1] = ::parse_stream(b_str, string_length(b_str), &arena);
+
+    ParseResult pr = ::merge_parse_results(results, 2, &arena);
+    ASSERT_TRUE((pr.struct_cnt == 2) && (pr.enum_cnt == 1)) << "Error: Duplicate structs or enums were kept.";
+    ASSERT_TRUE(pr.members.cnt == 3);
+
+    StructData *a = pr.struct_data + 0;
+    StructData *b = pr.struct_data + 1;
+    ASSERT_TRUE((string_compare(a->name, create_string("A"))) && (string_compare(b->name, create_string("B"))));
+    ASSERT_TRUE((b->first_member == 2) && (b->member_count == 1));
+
+    // The IDs came from different tables, so they all have to point into the merged one.
+    ASSERT_TRUE(pr.members.type_id[a->first_member + 1] == b->name_id) << "Error: A member's type wasn't remapped.";
+    ASSERT_TRUE((b->inherited_count == 1) && (b->inherited_ids[0] == a->name_id));
+    ASSERT_TRUE(string_compare(pr.symbols.symbols[pr.members.name_id[2]].str, create_string("f")));
+
+    free_arena(&arena);
+}
+
+TEST(StructTest, serialize_parse_result_test) {
+    Char const *str = "#include \"common.h\"\n"
+                      "#include <stdio.h>\n"
+                      "struct A { int a; float *b[2]; };\n"
+                      "struct B : public A { A a; };\n"
+                      "enum E { x = 2, y };";
+
+    MemoryArena arena = {};
+    ParseResult pr = ::parse_stream(str, string_length(str), &arena);
+    ASSERT_TRUE(pr.include_cnt == 2);
+    ASSERT_TRUE((string_compare(pr.includes[0].name, create_string("common.h"))) && (!pr.includes[0].is_system));
+    ASSERT_TRUE((string_compare(pr.includes[1].name, create_string("stdio.h"))) && (pr.includes[1].is_system));
+
+    PtrSize size = 0;
+    Byte *data = ::serialize_parse_result(&pr, &size);
+    ASSERT_TRUE(data);
+
+    // Nothing in the copy can point into the original.
+    MemoryArena copy_arena = {};
+    ParseResult copy = {};
+    ASSERT_TRUE(::deserialize_parse_result(data, size, &copy, &copy_arena));
+    free_arena(&arena);
+
+    ASSERT_TRUE((copy.struct_cnt == 2) && (copy.enum_cnt == 1) && (copy.members.cnt == 3) && (copy.include_cnt == 2));
+    ASSERT_TRUE(string_compare(copy.struct_data[1].name, create_string("B")));
+    ASSERT_TRUE((copy.struct_data[1].inherited_count == 1) &&
+                (copy.struct_data[1].inherited_ids[0] == copy.struct_data[0].name_id));
+    ASSERT_TRUE((copy.members.ptr[1] == 1) && (copy.members.array_count[1] == 2));
+    ASSERT_TRUE((copy.enum_data[0].no_of_values == 2) && (copy.enum_data[0].values[1].value == 3));
+    ASSERT_TRUE(string_compare(copy.includes[1].name, create_string("stdio.h")));
+
+    // The symbol table still works, so it can be merged.
+    ASSERT_TRUE(::find_symbol(&copy.symbols, create_string("float")) == copy.members.type_id[1]);
+
+    // A truncated one's rejected, rather than read past the end.
+    ParseResult truncated = {};
+    ASSERT_FALSE(::deserialize_parse_result(data, size - 1, &truncated, &copy_arena));
+
+    system_free(data);
+    free_arena(&copy_arena);
+}
+
+//
+// Symbol table.
+//
+TEST(SymbolTest, symbol_table_test) {
+    MemoryArena arena = {};
+    SymbolTable table = {};
+    table.arena = &arena;
+
+    // Enough to make the table grow a few times.
+    Char names[1000][8] = {};
+    Int ids[1000] = {};
+    for(Int i = 0; (i < 1000); ++i) {
+        Int len = stbsp_snprintf(names[i], sizeof(names[i]), "Type%d", i);
+        ids[i] = intern_string(&table, create_string(names[i], len));
+        ASSERT_TRUE(ids[i] != 0);
+    }
+
+    for(Int i = 0; (i < 1000); ++i) {
+        ASSERT_TRUE(intern_string(&table, create_string(names[i])) == ids[i]) << "Error: Interned the same string twice.";
+        ASSERT_TRUE(find_symbol(&table, create_string(names[i])) == ids[i]);
+    }
+
+    ASSERT_TRUE(find_symbol(&table, create_string("Type1000")) == 0);
+    ASSERT_TRUE(intern_string(&table, create_string("")) == 0);
+
+    free_arena(&arena);
+}
+
+//
+// Output.
+//
+TEST(OutputTest, large_output_test) {
+    // The output buffer used to be a fixed 1MB, and anything after that was lost.
+    Int struct_count = 300;
+    Int size = 128 * struct_count;
+    Char *str = system_alloc(Char, size);
+    ASSERT_TRUE(str != 0);
+
+    Int len = 0;
+    for(Int i = 0; (i < struct_count); ++i) {
+        len += stbsp_snprintf(str + len, size - len, "struct S%d { int a; float *b; char c[4]; S%d *next; };\n", i, i);
+    }
+
+    MemoryArena arena = {};
+    ParseResult pr = ::parse_stream(str, len, &arena);
+    OutputBuffer ob = write_data("large.cpp", pr.struct_data, pr.struct_cnt, pr.enum_data, pr.enum_cnt,
+                                 pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, &arena);
+
+    ASSERT_TRUE(pr.struct_cnt == struct_count);
+    ASSERT_TRUE(ob.total_size > 1024 * 1024) << "Error: Expected more than 1MB of output.";
+    ASSERT_TRUE(ob.chunk_count > 1);
+
+    PtrSize total_size = 0;
+    for(OutputChunk *chunk = ob.first; (chunk); chunk = chunk->next) {
+        total_size += chunk->used;
+    }
+    ASSERT_TRUE(total_size == ob.total_size);
+
+    Char const *guard = "#endif // Header guard.\n\n";
+    Int guard_len = string_length(guard);
+    ASSERT_TRUE((ob.last->used >= guard_len) && (string_compare(ob.last->data + ob.last->used - guard_len, guard, guard_len)))
+            << "Error: The end of the output is missing.";
+
+    free_arena(&arena);
+    system_free(str);
+}
+
+internal Char *flatten_output(OutputBuffer *ob) {
+    Char *res = system_alloc(Char, ob->total_size + 1);
+    if(res) {
+        PtrSize len = 0;
+        for(OutputChunk *chunk = ob->first; (chunk); chunk = chunk->next) {
+            copy(res + len, chunk->data, chunk->used);
+            len += chunk->used;
+        }
+    }
+
+    return(res);
+}
+
+TEST(OutputTest, parallel_sections_test) {
+    // Big enough that write_data splits it into jobs when there's a thread pool.
+    Int struct_count = 1500;
+    Int size = 128 * struct_count;
+    Char *str = system_alloc(Char, size);
+    ASSERT_TRUE(str != 0);
+
+    Int len = 0;
+    for(Int i = 0; (i < struct_count); ++i) {
+        len += stbsp_snprintf(str + len, size - len, "struct S%d { int a; float *b; char c[4]; S%d *next; };\n", i, i);
+    }
+
+    MemoryArena arena = {};
+    ParseResult pr = ::parse_stream(str, len, &arena);
+    OutputBuffer serial = write_data("parallel.cpp", pr.struct_data, pr.struct_cnt, pr.enum_data, pr.enum_cnt,
+                                     pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, &arena);
+
+    ASSERT_TRUE(start_thread_pool(4));
+    OutputBuffer parallel = write_data("parallel.cpp", pr.struct_data, pr.struct_cnt, pr.enum_data, pr.enum_cnt,
+                                       pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, &arena);
+    stop_thread_pool();
+
+    ASSERT_TRUE(parallel.total_size == serial.total_size);
+
+    Char *a = flatten_output(&serial);
+    Char *b = flatten_output(&parallel);
+    ASSERT_TRUE((a) && (b));
+    ASSERT_TRUE(string_compare(a, b, cast(Int)serial.total_size)) << "Error: Sections were joined in the wrong order.";
+
+    system_free(a);
+    system_free(b);
+    free_arena(&arena);
+    system_free(str);
+}
+
+TEST(OutputTest, anonymous_union_test) {
+    Char const *str = "struct V { int tag; union { float f; int i; }; struct { short a; short b; }; union { char c; }; };";
+    MemoryArena arena = {};
+    ParseResult pr = ::parse_stream(str, string_length(str), &arena);
+    OutputBuffer ob = write_data("union.cpp", pr.struct_data, pr.struct_cnt, pr.enum_data, pr.enum_cnt,
+                                 pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, &arena);
+
+    Char *output = flatten_output(&ob);
+    ASSERT_TRUE(output != 0);
+    output[ob.total_size] = 0;
+
+    // The recreated struct has to have the same layout, or the offsets and sizeof are wrong.
+    ASSERT_TRUE(string_contains(output, "_int tag;  union { _float f;  _int i; };")) << "Error: The union was written as a struct.";
+    ASSERT_TRUE(string_contains(output, "}; struct { _short a;  _short b; }; union { _char c;  }; };"));
+
+    system_free(output);
+    free_arena(&arena);
+}
+
+TEST(OutputTest, nested_anonymous_test) {
+    Char const *str = "struct N { union { struct { int i; int j; }; float f[2]; }; bool flag; };\n"
+                      "struct M { union { int a; }; union { int b; }; struct { struct { }; int c, d; }; };";
+    MemoryArena arena = {};
+    ParseResult pr = ::parse_stream(str, string_length(str), &arena);
+    OutputBuffer ob = write_data("nested.cpp", pr.struct_data, pr.struct_cnt, pr.enum_data, pr.enum_cnt,
+                                 pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, &arena);
+
+    Char *output = flatten_output(&ob);
+    ASSERT_TRUE(output != 0);
+    output[ob.total_size] = 0;
+
+    // Closing the inner struct mustn't close the union around it too.
+    ASSERT_TRUE(string_contains(output, "struct _N {  union { struct { _int i;  _int j; }; _float f[2]; }; _bool flag;  };"))
+            << "Error: The nesting was lost.";
+
+    // Two unions side by side are separate, and an empty struct is left out.
+    ASSERT_TRUE(string_contains(output, "struct _M {  union { _int a; }; union { _int b; }; struct { _int c;  _int d;  }; };"));
+
+    system_free(output);
+    free_arena(&arena);
+}
+
+TEST(OutputTest, lookup_struct_test) {
+    // Like a file which includes the header defining Common.
+    Char const *str = "struct A { Common c; int y; };\n"
+                      "struct Common { int a; float *b; };";
+    MemoryArena arena = {};
+    ParseResult pr = ::parse_stream(str, string_length(str), &arena);
+    ASSERT_TRUE(pr.struct_cnt == 2);
+
+    OutputBuffer ob = write_data("lookup.cpp", pr.struct_data, 1, pr.enum_data, pr.enum_cnt,
+                                 pr.func_data, pr.func_cnt, &pr.members, &pr.symbols, &arena, 1);
+
+    Char *output = flatten_output(&ob);
+    ASSERT_TRUE(output != 0);
+    output[ob.total_size] = 0;
+
+    ASSERT_TRUE(string_contains(output, "struct _A {"));
+    ASSERT_TRUE(!string_contains(output, "struct _Common {")) << "Error: Wrote code for a struct which was only for lookup.";
+
+    // But it's still used for A's member.
+    Int pos = string_contains_pos(output, "class TypeInfo<Common> {");
+    ASSERT_TRUE(pos >= 0);
+    Int member_count_pos = string_contains_pos(output + pos, "member_count = 2;");
+    ASSERT_TRUE((member_count_pos >= 0) && (member_count_pos < string_contains_pos(output + pos + 1, "class TypeInfo<")));
+
+    system_free(output);
+    free_arena(&arena);
+}
+
+//
+// Errors.
+//
+internal Void push_error_job(Void *data) {
+    push_error(*cast(ErrorType *)data);
+}
+
+TEST(ErrorTest, pool_error_list_test) {
+    // More pools than there are error lists, so the lists have to be given back when the threads exit.
+    for(Int i = 0; (i < 40); ++i) {
+        ASSERT_TRUE(start_thread_pool(4));
+
+        ErrorType type = ErrorType_unknown_token_found;
+        Int volatile counter = 0;
+        for(Int j = 0; (j < 16); ++j) {
+            add_job(push_error_job, &type, &counter);
+        }
+        wait_for_jobs(&counter);
+
+        stop_thread_pool();
+        clear_errors();
+    }
+
+    ASSERT_TRUE(start_thread_pool(4));
+    ErrorType type = ErrorType_unknown_token_found;
+    Int volatile counter = 0;
+    add_job(push_error_job, &type, &counter);
+    wait_for_jobs(&counter);
+    stop_thread_pool();
+
+    ASSERT_TRUE(print_errors()) << "Error: Lost an error pushed after the pool was restarted.";
+    clear_errors();
+}
+
+struct NestedErrorJob {
+    Int volatile errors;
+    ErrorType type;
+};
+
+internal Void nested_error_job(Void *data) {
+    NestedErrorJob *job = cast(NestedErrorJob *)data;
+
+    Int volatile *prev_error_counter = set_error_counter(&job->errors);
+    push_error(job->type);
+    set_error_counter(prev_error_counter);
+}
+
+TEST(ErrorTest, error_counter_test) {
+    ASSERT_TRUE(start_thread_pool(4));
+
+    Int volatile errors = 0;
+    Int volatile *prev_error_counter = set_error_counter(&errors);
+
+    // Errors from jobs count against whoever added them, whichever thread they ran on...
+    ErrorType type = ErrorType_unknown_token_found;
+    Int volatile counter = 0;
+    for(Int i = 0; (i < 16); ++i) {
+        add_job(push_error_job, &type, &counter);
+    }
+
+    // ...unless the job counts its own.
+    NestedErrorJob nested[4] = {};
+    for(Int i = 0; (i < array_count(nested)); ++i) {
+        nested[i].type = ErrorType_unknown_token_found;
+        add_job(nested_error_job, nested + i, &counter);
+    }
+    wait_for_jobs(&counter);
+
+    ASSERT_TRUE(get_error_count() == 16) << "Error: Errors went to the wrong counter.";
+    for(Int i = 0; (i < array_count(nested)); ++i) {
+        ASSERT_TRUE(nested[i].errors == 1);
+    }
+
+    set_error_counter(prev_error_counter);
+    stop_thread_pool();
+    clear_errors();
+}
+
+//
+// Memory arena.
+//
+TEST(ArenaTest, arena_test) {
+    MemoryArena arena = {};
+
+    Int *a = push_arena(&arena, Int, 16);
+    ASSERT_TRUE(a != 0);
+    for(Int i = 0; (i < 16); ++i) a[i] = i + 1;
+
+    // The last thing pushed should grow in place, and keep its contents.
+    Int *b = cast(Int *)resize_arena_memory(&arena, a, sizeof(Int) * 16, sizeof(Int) * 32);
+    ASSERT_TRUE(a == b) << "Error: Failed to resize the last allocation in place.";
+    ASSERT_TRUE((b[15] == 16) && (b[16] == 0)) << "Error: Resizing lost data, or didn't zero the new memory.";
+
+    // Bigger than a block, so this needs a new one.
+    Byte *big = push_arena(&arena, Byte, arena_block_size * 2);
+    ASSERT_TRUE(big != 0);
+    big[arena_block_size * 2 - 1] = 1;
+
+    // Memory reused after a clear should still come back zeroed.
+    clear_arena(&arena);
+    Byte *c = push_arena(&arena, Byte, arena_block_size * 2);
+    ASSERT_TRUE((c == big) && (c[arena_block_size * 2 - 1] == 0)) << "Error: Arena memory wasn't zeroed after a clear.";
+
+    // Temp memory only throws away what came after it, including anything absorbed from another arena.
+    Int *kept = push_arena(&arena, Int);
+    *kept = 42;
+    PtrSize size_before_temp = arena.total_size;
+    TempMemory temp = begin_temp_memory(&arena);
+    push_arena(&arena, Byte, arena_block_size * 4);
+
+    MemoryArena other = {};
+    push_arena(&other, Int, 16);
+    absorb_arena(&arena, &other);
+    ASSERT_TRUE((other.base == 0) && (arena.absorbed != 0));
+
+    PtrSize peak = arena.total_size;
+    ASSERT_TRUE(peak >= size_before_temp + arena_block_size) << "Error: The absorbed blocks weren't counted.";
+
+    end_temp_memory(temp);
+    ASSERT_TRUE((*kept == 42) && (arena.absorbed == 0) && (arena.base + arena.used == cast(Byte *)(kept + 1)));
+    ASSERT_TRUE((arena.total_size == size_before_temp) && (arena.peak_size == peak)) << "Error: Lost track of the arena's size.";
+
+    free_arena(&arena);
+    ASSERT_TRUE(arena.base == 0);
+}
+
+//
+// Allocation tracking.
+//
+#if MEM_CHECK
+TEST(MemoryTest, allocation_tracking_test) {
+    PtrSize size_before = system_get_live_allocation_size();
+
+    // Enough to make the table grow a few times, and to free from the middle of clusters.
+    Int const cnt = 10000;
+    Int **ptrs = system_alloc(Int *, cnt);
+    for(Int i = 0; (i < cnt); ++i) {
+        ptrs[i] = system_alloc(Int, 4);
+        ASSERT_TRUE(ptrs[i] != 0);
+    }
+
+    PtrSize ptrs_size = sizeof(Int *) * cnt;
+    ASSERT_TRUE(system_get_live_allocation_size() == size_before + ptrs_size + (sizeof(Int) * 4 * cnt));
+
+    for(Int i = 0; (i < cnt); i += 2) {
+        ASSERT_TRUE(system_free(ptrs[i]));
+    }
+    ASSERT_TRUE(system_get_live_allocation_size() == size_before + ptrs_size + (sizeof(Int) * 4 * (cnt / 2)));
+
+    // Growing moves the size over to the new pointer.
+    ptrs[1] = cast(Int *)system_realloc(ptrs[1], sizeof(Int) * 1024);
+    ASSERT_TRUE(ptrs[1] != 0);
+    ASSERT_TRUE(system_get_live_allocation_size() == size_before + ptrs_size + (sizeof(Int) * 4 * (cnt / 2 - 1)) + (sizeof(Int) * 1024));
+
+    for(Int i = 1; (i < cnt); i += 2) {
+        ASSERT_TRUE(system_free(ptrs[i]));
+    }
+    system_free(ptrs);
+    ASSERT_TRUE(system_get_live_allocation_size() == size_before) << "Error: Lost track of some allocations.";
+
+    // Freeing something that was never allocated is an error, rather than a crash.
+    Int error_count = get_error_count();
+    Int not_allocated = 0;
+    ASSERT_TRUE(!system_free(&not_allocated));
+    ASSERT_TRUE(get_error_count() == error_count + 1);
+    clear_errors();
+}
+#endif
+
+//
+// Tracing.
+//
+TEST(TraceTest, trace_test) {
+    Char const *fname = "trace_test.json";
+
+    // Nothing's recorded until tracing's started.
+    trace_begin("ignored");
+    trace_end();
+
+    start_tracing();
+    trace_begin("outer", "a \"quoted\" file.cpp");
+    trace_begin("inner");
+    trace_end();
+    trace_end();
+    ASSERT_TRUE(write_trace(fname)) << "Error: Failed to write the trace.";
+
+    File file = system_map_file(fname);
+    ASSERT_TRUE(file.data != 0);
+
+    Char buf[4096] = {};
+    ASSERT_TRUE(file.size < sizeof(buf));
+    copy(buf, file.data, file.size);
+    system_unmap_file(&file);
+    remove(fname);
+
+    Int begin_cnt = 0, end_cnt = 0;
+    for(Char *at = buf; (*at); ++at) {
+        if(string_compare(at, "\"ph\": \"B\"", 9)) { ++begin_cnt; }
+        else if(string_compare(at, "\"ph\": \"E\"", 9)) { ++end_cnt; }
+    }
+
+    ASSERT_TRUE((begin_cnt == 2) && (end_cnt == 2)) << "Error: Trace events didn't match up.";
+    ASSERT_TRUE(string_contains(buf, "\"file\": \"a \\\"quoted\\\" file.cpp\"")) << "Error: The file name wasn't escaped.";
+    ASSERT_TRUE(!string_contains(buf, "ignored")) << "Error: Recorded an event before tracing started.";
+}
+
+//
+// Scanning.
+//
+TEST(ScanTest, simd_matches_scalar_test) {
+    Char const *strs[] = {
+        "    \t\t  \r\n   \v\f          x",
+        "an_identifier_which_is_longer_than_16_bytes0123456789 + 1",
+        "12345678901234567890123456789012345678901234567890;",
+        "a comment which goes on for a while, before it ends\r\nnext line",
+        "a block comment * with / some * / fake endings **/ int x;",
+        "a block comment which straddles sixteen bytes*/",
+        "an unterminated block comment, the null at the end should stop it",
+        "",
+
+        // Long enough for the AVX2 versions to get through a couple of blocks before the tail.
+        "                    \t\t\t\t                              \v\f                              \r\n",
+        "an_identifier_which_is_long_enough_for_a_couple_of_avx2_blocks_0123456789_and_more + 1",
+        "a block comment * / with * fake / endings ** spread over a few blocks, * and then / the real one **/ int x;",
+        "a line which goes on for long enough to need a few blocks, before it finally ends here\r\nnext line",
+    };
+
+    SimdLevel level_before = get_simd_level();
+    SimdLevel supported = set_simd_level(SimdLevel_avx2);
+    set_simd_level(level_before);
+
+    Int str_count = array_count(strs);
+    for(Int i = 0; (i < str_count); ++i) {
+        Char const *str = strs[i];
+        Int len = string_length(str) + 1; // Include the null.
+
+        // Try every start and end, so the SIMD blocks hit every alignment, and the tails every length.
+        for(Int start = 0; (start < len); ++start) {
+            for(Int end = start; (end <= len); ++end) {
+                Char const *a = str + start;
+                Char const *b = str + end;
+
+                Char const *ws = skip_whitespace(a, b, SimdLevel_none);
+                Char const *iden = skip_identifier(a, b, SimdLevel_none);
+                Char const *digits = skip_digits(a, b, SimdLevel_none);
+                Char const *eol = find_end_of_line(a, b, SimdLevel_none);
+                Char const *comment = find_end_of_block_comment(a, b, SimdLevel_none);
+
+                for(Int i_level = SimdLevel_sse2; (i_level <= supported); ++i_level) {
+                    SimdLevel level = cast(SimdLevel)i_level;
+                    Char const *level_str = simd_level_to_string(level);
+                    ASSERT_TRUE(ws == skip_whitespace(a, b, level)) << "Error: skip_whitespace mismatch on string " << i << " with " << level_str;
+                    ASSERT_TRUE(iden == skip_identifier(a, b, level)) << "Error: skip_identifier mismatch on string " << i << " with " << level_str;
+                    ASSERT_TRUE(digits == skip_digits(a, b, level)) << "Error: skip_digits mismatch on string " << i << " with " << level_str;
+                    ASSERT_TRUE(eol == find_end_of_line(a, b, level)) << "Error: find_end_of_line mismatch on string " << i << " with " << level_str;
+                    ASSERT_TRUE(comment == find_end_of_block_comment(a, b, level)) << "Error: find_end_of_block_comment mismatch on string " << i << " with " << level_str;
+                }
+            }
+        }
+    }
+}
+
+// stb_sprintf is built without float support, so this is rounded to a whole MB/s.
+internal Int mb_per_second(Int bytes, Uint64 counts) {
+    Float64 seconds = cast(Float64)counts / cast(Float64)system_get_performance_frequency();
+    Int res = (seconds > 0) ? cast(Int)((cast(Float64)bytes / (1024.0 * 1024.0)) / seconds) : 0;
+
+    return(res);
+}
+
+// Not really a test, just prints how fast the lexer gets through a big, header-like, buffer at each SIMD level.
+TEST(ScanTest, scanning_speed_test) {
+    Char const *snippet = "/*  A block comment, like the ones at the top of most files.\n"
+                          "    It goes on for a couple of lines. */\n"
+                          "\n"
+                          "// Some member data.\n"
+                          "struct SomeLongishStructName : public BaseClass {\n"
+                          "    unsigned int some_member_variable;                 // Trailing comment.\n"
+                          "    float        another_member[16];                   // Another one.\n"
+                          "    char const  *a_string_pointer_with_a_long_name;\n"
+                          "\n"
+                          "    int method(int a, int b) { return(a + b + 1234567); }\n"
+                          "};\n"
+                          "\n";
+    Int snippet_len = string_length(snippet);
+
+    Int repeat = 32 * 1024;
+    Int size = snippet_len * repeat;
+    Char *buf = system_alloc(Char, size);
+    ASSERT_TRUE(buf != 0);
+    for(Int i = 0; (i < repeat); ++i) {
+        copy(buf + (i * snippet_len), cast(Void *)snippet, snippet_len);
+    }
+
+    Int token_count[SimdLevel_count] = {};
+    Int line_count[SimdLevel_count] = {};
+    SimdLevel supported = set_simd_level(SimdLevel_avx2);
+    for(Int level = SimdLevel_none; (level <= supported); ++level) {
+        set_simd_level(cast(SimdLevel)level);
+        Char const *level_str = simd_level_to_string(cast(SimdLevel)level);
+
+        Uint64 start = system_get_performance_counter();
+        TokenArray tokens = tokenize(buf, size);
+        Uint64 end = system_get_performance_counter();
+
+        token_count[level] = tokens.cnt;
+        free_token_array(&tokens);
+        system_write_to_console("[          ] tokenize (%-4s):         %d MB/s\n", level_str, mb_per_second(size, end - start));
+
+        // Just the scanning, without the rest of the lexer.
+        start = system_get_performance_counter();
+        for(Char const *at = buf, *buf_end = buf + size; (at < buf_end); ++at) {
+            at = find_end_of_line(at, buf_end, cast(SimdLevel)level);
+            ++line_count[level];
+        }
+        end = system_get_performance_counter();
+
+        system_write_to_console("[          ] find_end_of_line (%-4s): %d MB/s\n", level_str, mb_per_second(size, end - start));
+
+        ASSERT_TRUE(token_count[level] == token_count[SimdLevel_none]) << "Error: SIMD and scalar lexers produced different tokens.";
+        ASSERT_TRUE(line_count[level] == line_count[SimdLevel_none]) << "Error: SIMD and scalar lexers found different lines.";
+    }
+
+    set_simd_level(supported);
+    system_free(buf);
+}
+
+//
+// Strings and memory.
+//
+TEST(StringTest, simd_matches_scalar_test) {
+    Char buf[256] = {};
+    Char other[256] = {};
+    Byte dst[256] = {};
+
+    SimdLevel supported = set_simd_level(SimdLevel_avx2);
+    for(Int level = SimdLevel_none; (level <= supported); ++level) {
+        set_simd_level(cast(SimdLevel)level);
+
+        // Every start and length, so the blocks hit every alignment, and the tails every length.
+        for(Int start = 0; (start < 64); ++start) {
+            for(Int len = 0; (start + len + 1 < array_count(buf)); ++len) {
+                for(Int i = 0; (i < array_count(buf)); ++i) {
+                    buf[i] = cast(Char)('a' + (i % 7));
+                    other[i] = buf[i];
+                }
+                buf[start + len] = 0;
+
+                Char *str = buf + start;
+                ASSERT_TRUE(string_length(str) == len);
+
+                ASSERT_TRUE(string_compare(str, other + start, len));
+                if(len) {
+                    other[start + len - 1] = 'X';
+                    ASSERT_FALSE(string_compare(str, other + start, len)) << "Error: Missed a difference in the last byte.";
+                }
+
+                // Put the needle in the last place it fits, with near-misses before it.
+                Char const *target = "xyz";
+                if(len >= 3) {
+                    str[0] = 'x'; str[1] = 'y';
+                    str[len - 3] = 'x'; str[len - 2] = 'y'; str[len - 1] = 'z';
+                    ASSERT_TRUE(string_contains_pos(str, target) == len - 3);
+                    ASSERT_TRUE(string_contains(create_string(str, len), target));
+                    ASSERT_FALSE(string_contains(create_string(str, len - 1), target)) << "Error: Read past the end.";
+                } else {
+                    ASSERT_TRUE(string_contains_pos(str, target) == -1);
+                }
+                ASSERT_TRUE(string_contains_pos(str, "") == -1);
+
+                zero(dst, sizeof(dst));
+                copy(dst + (start / 2), str, len);
+                ASSERT_TRUE((string_compare(cast(Char *)dst + (start / 2), str, len)) && (dst[(start / 2) + len] == 0));
+
+                set(dst + start, 0xAB, len);
+                Bool set_correctly = (dst[start + len] != 0xAB);
+                for(Int i = 0; (i < len); ++i) {
+                    if(dst[start + i] != 0xAB) { set_correctly = false; }
+                }
+                ASSERT_TRUE(set_correctly);
+            }
+        }
+    }
+
+    set_simd_level(supported);
+}
+
+// Not really a test either, just prints how fast the primitives are at each SIMD level, on the kind of work the
+// generator does with them. That's lots of short copies into the output chunks, zeroing arena blocks, taking the
+// length of identifiers, and looking for std:: types in type names.
+TEST(StringTest, primitives_speed_test) {
+    Int const size = 1024 * 1024;
+    Byte *dst = system_alloc(Byte, size);
+    Byte *src = system_alloc(Byte, size);
+    ASSERT_TRUE((dst) && (src));
+
+    Char const *snippet = "    unsigned int some_member_variable;                 // Trailing comment.\n";
+    Int snippet_len = string_length(snippet);
+    for(Int i = 0; (i + snippet_len < size); i += snippet_len) {
+        copy(src + i, cast(Void *)snippet, snippet_len);
+    }
+    src[size - 1] = 0;
+
+    Char const *type_names[] = {"int", "unsigned int", "SomeLongishStructName", "std::vector<SomeLongishStructName>",
+                                "char const *", "BenchStruct1234", "std::string"};
+
+    Int found_count[SimdLevel_count] = {};
+    SimdLevel supported = set_simd_level(SimdLevel_avx2);
+    for(Int level = SimdLevel_none; (level <= supported); ++level) {
+        set_simd_level(cast(SimdLevel)level);
+        Char const *level_str = simd_level_to_string(cast(SimdLevel)level);
+
+        Int const repeat = 32;
+        Uint64 start = system_get_performance_counter();
+        for(Int r = 0; (r < repeat); ++r) {
+            for(Int i = 0; (i + 80 < size); i += 80) {
+                copy(dst + i, src + i, 16 + (i & 63));
+            }
+        }
+        Uint64 end = system_get_performance_counter();
+        system_write_to_console("[          ] copy, short (%s):         %d MB/s\n", level_str,
+                                mb_per_second(size * repeat, end - start));
+
+        start = system_get_performance_counter();
+        for(Int r = 0; (r < repeat); ++r) {
+            copy(dst, src, size);
+        }
+        end = system_get_performance_counter();
+        system_write_to_console("[          ] copy, 1 MB (%s):          %d MB/s\n", level_str,
+                                mb_per_second(size * repeat, end - start));
+
+        start = system_get_performance_counter();
+        for(Int r = 0; (r < repeat); ++r) {
+            zero(dst, size);
+        }
+        end = system_get_performance_counter();
+        system_write_to_console("[          ] set, 1 MB (%s):           %d MB/s\n", level_str,
+                                mb_per_second(size * repeat, end - start));
+
+        Int bytes = 0;
+        start = system_get_performance_counter();
+        for(Int r = 0; (r < repeat * 1024); ++r) {
+            for(Int i = 0; (i < array_count(type_names)); ++i) {
+                bytes += string_length(type_names[i]);
+            }
+        }
+        end = system_get_performance_counter();
+        system_write_to_console("[          ] string_length, names (%s): %d MB/s\n", level_str,
+                                mb_per_second(bytes, end - start));
+
+        bytes = 0;
+        start = system_get_performance_counter();
+        for(Int r = 0; (r < repeat * 1024); ++r) {
+            for(Int i = 0; (i < array_count(type_names)); ++i) {
+                found_count[level] += string_contains(type_names[i], "std::vector");
+                bytes += string_length(type_names[i]);
+            }
+        }
+        end = system_get_performance_counter();
+        system_write_to_console("[          ] string_contains, names (%s): %d MB/s\n", level_str,
+                                mb_per_second(bytes, end - start));
+
+        start = system_get_performance_counter();
+        for(Int r = 0; (r < repeat); ++r) {
+            found_count[level] += (string_contains_pos(cast(Char *)src, "std::vector") != -1);
+        }
+        end = system_get_performance_counter();
+        system_write_to_console("[          ] string_contains, 1 MB (%s): %d MB/s\n", level_str,
+                                mb_per_second(size * repeat, end - start));
+    }
+
+    set_simd_level(supported);
+    system_free(src);
+    system_free(dst);
+
+    for(Int level = SimdLevel_none; (level <= supported); ++level) {
+        ASSERT_TRUE(found_count[level] == found_count[0]) << "Error: The SIMD levels found different things.";
+    }
+}
+
 Int run_tests(void) {
     Int res = 0;
     // Google test uses so much memory, it's difficult to run in x86.
@@ -0,0 +1,226 @@
+/*===================================================================================================
+  File:                    thread_pool.cpp
+  Author:                  Jonathan Livingstone
+  Email:                   seagull127@ymail.com
+  Licence:                 Public Domain
+                           No Warranty is offered or implied about the reliability,
+                           suitability, or usability
+                           The use of this code is at your own risk
+                           Anyone can use this code, modify it, sell it to terrorists, etc.
+  ===================================================================================================*/
+
+#include "thread_pool.h"
+#include "platform.h"
+#include "utils.h"
+
+struct Job {
+    JobProc *proc;
+    Void *data;
+    Int volatile *counter;
+    Int volatile *error_counter; // Whoever added the job sees the errors it pushes.
+};
+
+// The owner pushes and pops at the tail, thieves take from the head. Guarded by a spin lock, because the critical
+// sections are a handful of instructions and jobs are big (a whole file, or a whole section of one).
+struct WorkQueue {
+    Job *jobs;
+    Int head;
+    Int tail;
+    Int size;
+
+    Int volatile lock;
+};
+
+struct ThreadPool {
+    Int thread_count;
+    WorkQueue *queues;
+    Thread *threads;
+    Int *thread_indices;
+
+    Semaphore semaphore;
+    Int volatile shutting_down;
+};
+
+internal ThreadPool global_thread_pool = {};
+internal thread_local Int global_thread_index = 0;
+
+internal Bool push_job(WorkQueue *queue, Job job) {
+    Bool res = false;
+
+    system_lock(&queue->lock);
+
+    if(queue->head == queue->tail) {
+        queue->head = 0;
+        queue->tail = 0;
+    }
+
+    if(queue->tail >= queue->size) {
+        Int new_size = (queue->size) ? queue->size * 2 : 64;
+        Void *p = system_realloc(queue->jobs, sizeof(Job) * new_size);
+        if(p) {
+            queue->jobs = cast(Job *)p;
+            queue->size = new_size;
+        }
+    }
+
+    if(queue->tail < queue->size) {
+        queue->jobs[queue->tail++] = job;
+        res = true;
+    }
+
+    system_unlock(&queue->lock);
+
+    return(res);
+}
+
+internal Bool pop_job(WorkQueue *queue, Job *job, Bool steal) {
+    Bool res = false;
+
+    system_lock(&queue->lock);
+
+    if(queue->head < queue->tail) {
+        if(steal) { *job = queue->jobs[queue->head++]; }
+        else      { *job = queue->jobs[--queue->tail]; }
+
+        res = true;
+    }
+
+    system_unlock(&queue->lock);
+
+    return(res);
+}
+
+// Try our own queue first, then go round everybody else's.
+internal Bool run_next_job(Int thread_index) {
+    ThreadPool *pool = &global_thread_pool;
+
+    Job job = {};
+    Bool found = pop_job(pool->queues + thread_index, &job, false);
+    for(Int i = 1; (!found) && (i < pool->thread_count); ++i) {
+        Int victim = (thread_index + i) % pool->thread_count;
+        found = pop_job(pool->queues + victim, &job, true);
+    }
+
+    if(found) {
+        Int volatile *prev_error_counter = set_error_counter(job.error_counter);
+        job.proc(job.data);
+        set_error_counter(prev_error_counter);
+
+        system_atomic_add(job.counter, -1);
+    }
+
+    return(found);
+}
+
+internal Void worker_thread_proc(Void *data) {
+    ThreadPool *pool = &global_thread_pool;
+    global_thread_index = *cast(Int *)data;
+
+    for(;;) {
+        system_wait_semaphore(&pool->semaphore);
+        if(system_atomic_add(&pool->shutting_down, 0)) {
+            break; // for
+        }
+
+        while(run_next_job(global_thread_index)) {}
+    }
+
+    release_error_list();
+    free_scratch_memory();
+}
+
+Bool start_thread_pool(Int thread_count) {
+    ThreadPool *pool = &global_thread_pool;
+    Bool res = false;
+
+    if((thread_count > 1) && (!pool->thread_count)) {
+        pool->queues = system_alloc(WorkQueue, thread_count);
+        pool->threads = system_alloc(Thread, thread_count);
+        pool->thread_indices = system_alloc(Int, thread_count);
+
+        if((pool->queues) && (pool->threads) && (pool->thread_indices) && (system_create_semaphore(&pool->semaphore))) {
+            pool->shutting_down = 0;
+            pool->thread_count = 1;
+
+            // Index 0 is the thread which started the pool.
+            global_thread_index = 0;
+            for(Int i = 1; (i < thread_count); ++i) {
+                pool->thread_indices[i] = i;
+                if(!system_create_thread(pool->threads + i, worker_thread_proc, pool->thread_indices + i)) {
+                    break; // for
+                }
+
+                ++pool->thread_count;
+            }
+
+            res = (pool->thread_count > 1);
+        }
+
+        if(!res) {
+            stop_thread_pool();
+        }
+    }
+
+    return(res);
+}
+
+Void stop_thread_pool(void) {
+    ThreadPool *pool = &global_thread_pool;
+
+    if(pool->thread_count > 1) {
+        system_atomic_add(&pool->shutting_down, 1);
+        system_signal_semaphore(&pool->semaphore, pool->thread_count - 1);
+
+        for(Int i = 1; (i < pool->thread_count); ++i) {
+            system_join_thread(pool->threads + i);
+        }
+    }
+
+    if(pool->queues) {
+        for(Int i = 0; (i < pool->thread_count); ++i) {
+            system_free(pool->queues[i].jobs);
+        }
+    }
+
+    system_destroy_semaphore(&pool->semaphore);
+    system_free(pool->queues);
+    system_free(pool->threads);
+    system_free(pool->thread_indices);
+
+    zero(pool, sizeof(*pool));
+}
+
+Void add_job(JobProc *proc, Void *data, Int volatile *counter) {
+    ThreadPool *pool = &global_thread_pool;
+
+    system_atomic_add(counter, 1);
+
+    Job job = { proc, data, counter, get_error_counter() };
+    if((pool->thread_count > 1) && (push_job(pool->queues + global_thread_index, job))) {
+        system_signal_semaphore(&pool->semaphore);
+    } else {
+        // No pool (or we couldn't grow the queue), so just do it now.
+        proc(data);
+        system_atomic_add(counter, -1);
+    }
+}
+
+Void wait_for_jobs(Int volatile *counter) {
+    ThreadPool *pool = &global_thread_pool;
+
+    while(system_atomic_add(counter, 0) > 0) {
+        if((pool->thread_count <= 1) || (!run_next_job(global_thread_index))) {
+            system_yield_thread();
+        }
+    }
+}
+
+Int get_thread_count(void) {
+    Int res = (global_thread_pool.thread_count > 1) ? global_thread_pool.thread_count : 1;
+
+    return(res);
+}
+
+Int get_thread_index(void) {
+    return(global_thread_index);
+}
@@ -0,0 +1,37 @@
+/*===================================================================================================
+  File:                    thread_pool.h
+  Author:                  Jonathan Livingstone
+  Email:                   seagull127@ymail.com
+  Licence:                 Public Domain
+                           No Warranty is offered or implied about the reliability,
+                           suitability, or usability
+                           The use of this code is at your own risk
+                           Anyone can use this code, modify it, sell it to terrorists, etc.
+  ===================================================================================================*/
+
+#if !defined(_THREAD_POOL_H)
+
+#include "shared.h"
+
+//
+// Work-stealing thread pool.
+//
+// Every thread (including the one that started the pool) owns a queue. Jobs are pushed onto the queue of the thread
+// that created them, and idle threads steal from the other end of everyone else's queue. If the pool was never
+// started, add_job just runs the job straight away, so calling code looks the same either way.
+typedef Void JobProc(Void *data);
+
+Bool start_thread_pool(Int thread_count);
+Void stop_thread_pool(void);
+
+// counter is incremented here, and decremented once the job has finished.
+Void add_job(JobProc *proc, Void *data, Int volatile *counter);
+
+// Runs jobs (from any queue) until counter reaches zero.
+Void wait_for_jobs(Int volatile *counter);
+
+Int get_thread_count(void);
+Int get_thread_index(void);
+
+#define _THREAD_POOL_H
+#endif
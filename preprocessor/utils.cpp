@@ -17,11 +17,33 @@
 #define STB_SPRINTF_IMPLEMENTATION
 #include "stb_sprintf.h"
 
+#if SIMD_SSE2
+    #include <emmintrin.h>
+    #if SIMD_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
 //
 // Error stuff.
 //
-internal Error global_errors[32];
-internal Int global_error_count = 0;
+// Each thread pushes to its own list, so worker threads never have to synchronise on an error. A thread claims one of
+// the lists the first time it pushes an error, and gives it back with release_error_list before it exits. Its errors
+// are moved onto the retired list then, so they can still be printed once the thread's gone, and the list can be
+// claimed again by the next thread pool's threads.
+struct ErrorList {
+    Error e[32];
+    Int cnt;
+    Int total; // Including the ones which didn't fit.
+    Bool in_use;
+};
+
+internal ErrorList global_error_lists[64];
+internal ErrorList global_retired_errors = {}; // Also used by any threads which couldn't get a list of their own.
+internal Int volatile global_error_lock = 0;
+
+internal thread_local ErrorList *global_errors = 0;
+internal thread_local Int volatile *global_error_counter = 0;
 
 Char const *ErrorTypeToString(ErrorType e) {
     Char const *res = 0;
@@ -50,6 +72,8 @@ Char const *ErrorTypeToString(ErrorType e) {
         case ERROR_TYPE_TO_STRING(ErrorType_incorrect_number_of_members_for_struct);
         case ERROR_TYPE_TO_STRING(ErrorType_incorrect_struct_name);
         case ERROR_TYPE_TO_STRING(ErrorType_incorrect_number_of_base_structs);
+        case ERROR_TYPE_TO_STRING(ErrorType_could_not_start_server);
+        case ERROR_TYPE_TO_STRING(ErrorType_could_not_watch_files);
 
         default: assert(0); break;
     }
@@ -64,44 +88,129 @@ Char const *ErrorTypeToString(ErrorType e) {
     return(res);
 }
 
-Void push_error_(ErrorType type, Char const *guid) {
-    if(global_error_count + 1 < array_count(global_errors)) {
-        Error *e = global_errors + global_error_count++;
+internal Void add_error(ErrorList *list, ErrorType type, Char const *guid) {
+    ++list->total;
+    if(list->cnt + 1 < array_count(list->e)) {
+        Error *e = list->e + list->cnt++;
 
         e->type = type;
         e->guid = guid;
     }
 }
 
+Void push_error_(ErrorType type, Char const *guid) {
+    if(!global_errors) {
+        system_lock(&global_error_lock);
+        for(Int i = 0; (i < array_count(global_error_lists)); ++i) {
+            if(!global_error_lists[i].in_use) {
+                global_errors = global_error_lists + i;
+                global_errors->in_use = true;
+                break; // for
+            }
+        }
+        system_unlock(&global_error_lock);
+    }
+
+    if(global_errors) {
+        add_error(global_errors, type, guid);
+    } else {
+        system_lock(&global_error_lock);
+        add_error(&global_retired_errors, type, guid);
+        system_unlock(&global_error_lock);
+    }
+
+    if(global_error_counter) {
+        system_atomic_add(global_error_counter, 1);
+    }
+}
+
+Void release_error_list(void) {
+    if(global_errors) {
+        system_lock(&global_error_lock);
+        for(Int i = 0; (i < global_errors->cnt); ++i) {
+            add_error(&global_retired_errors, global_errors->e[i].type, global_errors->e[i].guid);
+        }
+
+        // The ones which didn't fit still count.
+        global_retired_errors.total += global_errors->total - global_errors->cnt;
+
+        zero(global_errors, sizeof(*global_errors));
+        system_unlock(&global_error_lock);
+
+        global_errors = 0;
+    }
+}
+
+internal Void print_error_list(ErrorList *list) {
+    for(Int i = 0; (i < list->cnt); ++i) {
+        Char buffer[256] = {};
+        stbsp_snprintf(buffer, array_count(buffer), "%s %s\n\n", list->e[i].guid, ErrorTypeToString(list->e[i].type));
+        system_write_to_stderr(buffer);
+    }
+}
+
+// Should only be called when no other threads are pushing errors.
 Bool print_errors() {
     Bool res = false;
 
-    if(global_error_count) {
+    Int error_count = global_retired_errors.cnt;
+    for(Int i = 0; (i < array_count(global_error_lists)); ++i) {
+        error_count += global_error_lists[i].cnt;
+    }
+
+    if(error_count) {
         res = true;
 
-        // TODO(Jonny): Write errors to disk?
         system_write_to_stderr("\nPreprocessor errors:\n");
-        for(Int i = 0; (i < global_error_count); ++i) {
-            Char buffer[256] = {};
-            stbsp_snprintf(buffer, array_count(buffer), "%s %s\n\n",
-                           global_errors[i].guid, ErrorTypeToString(global_errors[i].type));
-            system_write_to_stderr(buffer);
+        print_error_list(&global_retired_errors);
+        for(Int i = 0; (i < array_count(global_error_lists)); ++i) {
+            print_error_list(global_error_lists + i);
         }
 
-        Char buffer2[256] = {};
-        stbsp_snprintf(buffer2, array_count(buffer2), "Preprocessor finished with %d error(s).\n\n\n", global_error_count);
-        system_write_to_stderr(buffer2);
+        Char buffer[256] = {};
+        stbsp_snprintf(buffer, array_count(buffer), "Preprocessor finished with %d error(s).\n\n\n", error_count);
+        system_write_to_stderr(buffer);
     }
 
     return(res);
 }
 
+Int get_error_count(void) {
+    Int res = 0;
+    if(global_error_counter) { res = system_atomic_add(global_error_counter, 0); }
+    else if(global_errors)   { res = global_errors->total;                       }
+
+    return(res);
+}
+
+Int volatile *set_error_counter(Int volatile *counter) {
+    Int volatile *res = global_error_counter;
+    global_error_counter = counter;
+
+    return(res);
+}
+
+Int volatile *get_error_counter(void) {
+    return(global_error_counter);
+}
+
+// Threads which are kept around (like the thread pool's, with --server) keep their lists.
+Void clear_errors(void) {
+    for(Int i = 0; (i < array_count(global_error_lists)); ++i) {
+        global_error_lists[i].cnt = 0;
+        global_error_lists[i].total = 0;
+    }
+
+    global_retired_errors.cnt = 0;
+    global_retired_errors.total = 0;
+}
+
 //
 // Scratch memory.
 //
-// A quick-to-access temp region of memory. Should be frequently cleared.
-internal Int scratch_memory_index = 0;
-internal Void *global_scratch_memory = 0;
+// A quick-to-access temp region of memory. Should be frequently cleared. Each thread has its own.
+internal thread_local Int scratch_memory_index = 0;
+internal thread_local Void *global_scratch_memory = 0;
 
 Void *push_scratch_memory(Int size/*= scratch_memory_size*/) {
     if(!global_scratch_memory) {
@@ -129,7 +238,517 @@ Void clear_scratch_memory(void) {
 Void free_scratch_memory() {
     if(global_scratch_memory) {
         system_free(global_scratch_memory);
+        global_scratch_memory = 0;
+        scratch_memory_index = 0;
+    }
+
+    free_arena(get_thread_arena());
+    free_arena(get_thread_scratch_arena());
+}
+
+//
+// Memory arena.
+//
+// Every block starts with one of these, so clear_arena and free_arena can find the older ones.
+struct MemoryArenaBlock {
+    Byte *prev;
+    PtrSize size;
+};
+
+#define arena_alignment 16
+internal PtrSize align_arena_size(PtrSize size) {
+    PtrSize res = (size + (arena_alignment - 1)) & ~cast(PtrSize)(arena_alignment - 1);
+
+    return(res);
+}
+
+internal PtrSize const arena_header_size = align_arena_size(sizeof(MemoryArenaBlock));
+
+// Blocks come straight from the OS, so they're already zeroed. With MEM_CHECK, a block's counted against the push which
+// needed it.
+#if MEM_CHECK
+internal Bool push_arena_block(MemoryArena *arena, PtrSize min_size, Char const *guid) {
+#else
+internal Bool push_arena_block(MemoryArena *arena, PtrSize min_size) {
+#endif
+    Bool res = false;
+
+    PtrSize size = (arena->size * 2 > arena_block_size) ? arena->size * 2 : arena_block_size;
+    if(size < min_size + arena_header_size) {
+        size = min_size + arena_header_size;
+    }
+
+#if MEM_CHECK
+    Byte *block = cast(Byte *)system_alloc_pages_(guid, size);
+#else
+    Byte *block = cast(Byte *)system_alloc_pages(size);
+#endif
+    if(block) {
+        MemoryArenaBlock *header = cast(MemoryArenaBlock *)block;
+        header->prev = arena->base;
+        header->size = size;
+
+        arena->base = block;
+        arena->size = size;
+        arena->used = arena_header_size;
+        arena->dirty = arena_header_size;
+
+        arena->total_size += size;
+        if(arena->total_size > arena->peak_size) {
+            arena->peak_size = arena->total_size;
+        }
+
+        res = true;
+    }
+
+    return(res);
+}
+
+#if MEM_CHECK
+Void *push_arena_size_(Char const *guid, MemoryArena *arena, PtrSize size, PtrSize cnt/*= 1*/) {
+#else
+Void *push_arena_size(MemoryArena *arena, PtrSize size, PtrSize cnt/*= 1*/) {
+#endif
+    Void *res = 0;
+
+    size *= cnt;
+    PtrSize start = align_arena_size(arena->used);
+    if((!arena->base) || (start + size > arena->size)) {
+#if MEM_CHECK
+        Bool pushed_block = push_arena_block(arena, size, guid);
+#else
+        Bool pushed_block = push_arena_block(arena, size);
+#endif
+        if(pushed_block) {
+            start = arena->used;
+        }
+    }
+
+    if((arena->base) && (start + size <= arena->size)) {
+        res = arena->base + start;
+        arena->used = start + size;
+
+        // Only the bits which have been used before need zeroing.
+        if(start < arena->dirty) {
+            zero(res, ((arena->used < arena->dirty) ? arena->used : arena->dirty) - start);
+        }
+        if(arena->used > arena->dirty) {
+            arena->dirty = arena->used;
+        }
+
+#if MEM_CHECK
+        system_track_arena_push_(guid, size);
+#endif
+    } else {
+        push_error(ErrorType_ran_out_of_memory);
+    }
+
+    return(res);
+}
+
+#if MEM_CHECK
+Void *resize_arena_memory_(Char const *guid, MemoryArena *arena, Void *ptr, PtrSize old_size, PtrSize new_size) {
+#else
+Void *resize_arena_memory(MemoryArena *arena, Void *ptr, PtrSize old_size, PtrSize new_size) {
+#endif
+    Void *res = 0;
+
+    Byte *ptr8 = cast(Byte *)ptr;
+    if((ptr) && (ptr8 + old_size == arena->base + arena->used) && (ptr8 - arena->base + new_size <= arena->size)) {
+        res = ptr;
+        arena->used = ptr8 - arena->base + new_size;
+
+        if((new_size > old_size) && (ptr8 + old_size < arena->base + arena->dirty)) {
+            PtrSize dirty_end = (arena->used < arena->dirty) ? arena->used : arena->dirty;
+            zero(ptr8 + old_size, dirty_end - (ptr8 - arena->base + old_size));
+        }
+        if(arena->used > arena->dirty) {
+            arena->dirty = arena->used;
+        }
+
+#if MEM_CHECK
+        if(new_size > old_size) {
+            system_track_arena_push_(guid, new_size - old_size);
+        }
+#endif
+    } else {
+#if MEM_CHECK
+        res = push_arena_size_(guid, arena, new_size);
+#else
+        res = push_arena_size(arena, new_size);
+#endif
+        if((res) && (ptr)) {
+            copy(res, ptr, (old_size < new_size) ? old_size : new_size);
+        }
+    }
+
+    return(res);
+}
+
+// Frees block, and every block chained from it, up to (but not including) end. Returns how many bytes were freed.
+internal PtrSize free_arena_blocks(Byte *block, Byte *end) {
+    PtrSize res = 0;
+
+    while((block) && (block != end)) {
+        MemoryArenaBlock *header = cast(MemoryArenaBlock *)block;
+        Byte *prev = header->prev;
+        res += header->size;
+        system_free_pages(block, header->size);
+        block = prev;
+    }
+
+    return(res);
+}
+
+// Keeps the newest (biggest) block, so once an arena has grown to fit a file it doesn't go back to the OS again.
+Void clear_arena(MemoryArena *arena) {
+    arena->total_size -= free_arena_blocks(arena->absorbed, 0);
+    arena->absorbed = 0;
+
+    if(arena->base) {
+        MemoryArenaBlock *header = cast(MemoryArenaBlock *)arena->base;
+        arena->total_size -= free_arena_blocks(header->prev, 0);
+
+        header->prev = 0;
+        arena->used = arena_header_size;
+    }
+}
+
+Void free_arena(MemoryArena *arena) {
+    free_arena_blocks(arena->absorbed, 0);
+    free_arena_blocks(arena->base, 0);
+
+    zero(arena, sizeof(*arena));
+}
+
+// src's own blocks and anything it had absorbed go onto the front of arena's absorbed list, so end_temp_memory can
+// still tell which ones came after it.
+internal Void absorb_arena_blocks(MemoryArena *arena, Byte *block) {
+    if(block) {
+        MemoryArenaBlock *last = cast(MemoryArenaBlock *)block;
+        while(last->prev) {
+            last = cast(MemoryArenaBlock *)last->prev;
+        }
+
+        last->prev = arena->absorbed;
+        arena->absorbed = block;
+    }
+}
+
+Void absorb_arena(MemoryArena *arena, MemoryArena *src) {
+    absorb_arena_blocks(arena, src->absorbed);
+    absorb_arena_blocks(arena, src->base);
+
+    arena->total_size += src->total_size;
+    if(arena->total_size > arena->peak_size) {
+        arena->peak_size = arena->total_size;
     }
+
+    zero(src, sizeof(*src));
+}
+
+TempMemory begin_temp_memory(MemoryArena *arena) {
+    TempMemory res = {arena, arena->base, arena->used, arena->absorbed};
+
+    return(res);
+}
+
+Void end_temp_memory(TempMemory temp) {
+    MemoryArena *arena = temp.arena;
+
+    arena->total_size -= free_arena_blocks(arena->absorbed, temp.absorbed);
+    arena->absorbed = temp.absorbed;
+
+    if(!temp.base) {
+        // Nothing was in the arena to begin with.
+        clear_arena(arena);
+    } else if(arena->base != temp.base) {
+        arena->total_size -= free_arena_blocks(arena->base, temp.base);
+
+        // Don't know how much of the old block got written to before it was replaced, so assume all of it.
+        MemoryArenaBlock *header = cast(MemoryArenaBlock *)temp.base;
+        arena->base = temp.base;
+        arena->size = header->size;
+        arena->used = temp.used;
+        arena->dirty = header->size;
+    } else {
+        arena->used = temp.used;
+    }
+}
+
+internal thread_local MemoryArena global_thread_arena = {};
+MemoryArena *get_thread_arena(void) {
+    return(&global_thread_arena);
+}
+
+internal thread_local MemoryArena global_thread_scratch_arena = {};
+MemoryArena *get_thread_scratch_arena(void) {
+    return(&global_thread_scratch_arena);
+}
+
+//
+// Tracing.
+//
+// Each thread's events go into its own list of blocks, so recording one is just a couple of stores. Like the error
+// lists, a thread's buffer is registered the first time it records something. The buffers come from the heap rather
+// than being thread_local, because the thread pool's threads have usually exited by the time they're written out.
+struct TraceEvent {
+    Char const *name;
+    Char const *arg;
+    Uint64 time;
+    Bool is_begin;
+};
+
+#define trace_events_per_block 4096
+struct TraceBlock {
+    TraceBlock *next;
+    Int cnt;
+    TraceEvent e[trace_events_per_block];
+};
+
+struct TraceBuffer {
+    TraceBlock *first;
+    TraceBlock *last;
+    Int thread_id;
+};
+
+internal Bool global_tracing = false;
+internal Int global_trace_generation = 0;
+internal Uint64 global_trace_start = 0;
+
+// If the generation's changed, write_trace has freed the thread's buffer since it was made.
+internal thread_local TraceBuffer *global_trace_buffer = 0;
+internal thread_local Int global_trace_buffer_generation = 0;
+
+internal TraceBuffer *global_trace_buffers[64];
+internal Int volatile global_trace_buffer_count = 0;
+
+Void start_tracing(void) {
+    global_trace_start = system_get_performance_counter();
+    global_tracing = true;
+}
+
+internal TraceBuffer *get_trace_buffer(void) {
+    TraceBuffer *res = (global_trace_buffer_generation == global_trace_generation) ? global_trace_buffer : 0;
+
+    if(!res) {
+
+        Int index = system_atomic_add(&global_trace_buffer_count, 1) - 1;
+        if(index < array_count(global_trace_buffers)) {
+            res = system_alloc(TraceBuffer);
+            if(res) {
+                res->thread_id = index + 1;
+                global_trace_buffers[index] = res;
+            }
+        }
+
+        global_trace_buffer = res;
+        global_trace_buffer_generation = global_trace_generation;
+    }
+
+    return(res);
+}
+
+internal Void push_trace_event(Char const *name, Char const *arg, Bool is_begin) {
+    TraceBuffer *buf = get_trace_buffer();
+    if(buf) {
+        if((!buf->last) || (buf->last->cnt == trace_events_per_block)) {
+            TraceBlock *block = system_alloc(TraceBlock);
+            if(block) {
+                if(buf->last) { buf->last->next = block; }
+                else          { buf->first = block;      }
+                buf->last = block;
+            }
+        }
+
+        if((buf->last) && (buf->last->cnt < trace_events_per_block)) {
+            TraceEvent *e = buf->last->e + buf->last->cnt++;
+            e->name = name;
+            e->arg = arg;
+            e->time = system_get_performance_counter();
+            e->is_begin = is_begin;
+        }
+    }
+}
+
+Void trace_begin(Char const *name, Char const *arg/*= 0*/) {
+    if(global_tracing) {
+        push_trace_event(name, arg, true);
+    }
+}
+
+Void trace_end(void) {
+    if(global_tracing) {
+        push_trace_event(0, 0, false);
+    }
+}
+
+// Backslashes (Windows paths) and quotes need escaping, and anything else odd is left out.
+internal Int write_trace_json_string(Char *buf, Int size, Char const *str) {
+    Int res = 0;
+
+    if(res < size) { buf[res++] = '"'; }
+    for(Char const *at = str; (*at) && (res + 3 < size); ++at) {
+        if((*at == '\\') || (*at == '"')) {
+            buf[res++] = '\\';
+            buf[res++] = *at;
+        } else if(cast(Uint8)*at >= ' ') {
+            buf[res++] = *at;
+        }
+    }
+    if(res < size) { buf[res++] = '"'; }
+
+    return(res);
+}
+
+Bool write_trace(Char const *fname) {
+    Bool res = false;
+
+    Int buffer_count = global_trace_buffer_count;
+    if(buffer_count > array_count(global_trace_buffers)) {
+        buffer_count = array_count(global_trace_buffers);
+    }
+
+    // Names and file names are short, so this is plenty for every event.
+    Int const max_event_size = 1024;
+    Int event_count = 0;
+    for(Int i = 0; (i < buffer_count); ++i) {
+        if(global_trace_buffers[i]) {
+            for(TraceBlock *block = global_trace_buffers[i]->first; (block); block = block->next) {
+                event_count += block->cnt;
+            }
+        }
+    }
+
+    PtrSize size = (cast(PtrSize)event_count + buffer_count + 1) * max_event_size;
+    Char *out = system_alloc(Char, size);
+    if(out) {
+        PtrSize len = 0;
+        len += stbsp_snprintf(out + len, cast(Int)(size - len), "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+        Uint64 freq = system_get_performance_frequency();
+        Bool first = true;
+        for(Int i = 0; (i < buffer_count); ++i) {
+            TraceBuffer *buf = global_trace_buffers[i];
+            if(!buf) {
+                continue; // for
+            }
+
+            len += stbsp_snprintf(out + len, cast(Int)(size - len),
+                                  "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                                  "\"args\": {\"name\": \"Thread %d\"}}",
+                                  (first) ? "" : ",\n", buf->thread_id, buf->thread_id);
+            first = false;
+
+            for(TraceBlock *block = buf->first; (block); block = block->next) {
+                for(Int j = 0; (j < block->cnt); ++j) {
+                    TraceEvent *e = block->e + j;
+
+                    // Timestamps are in microseconds, but stb_sprintf doesn't do floats.
+                    Uint64 ns = cast(Uint64)((cast(Float64)(e->time - global_trace_start) * 1000000000.0) / cast(Float64)freq);
+
+                    len += stbsp_snprintf(out + len, cast(Int)(size - len),
+                                          ",\n{\"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %llu.%03llu",
+                                          (e->is_begin) ? 'B' : 'E', buf->thread_id,
+                                          cast(unsigned long long)(ns / 1000), cast(unsigned long long)(ns % 1000));
+
+                    if(e->name) {
+                        len += stbsp_snprintf(out + len, cast(Int)(size - len), ", \"name\": ");
+                        len += write_trace_json_string(out + len, cast(Int)(size - len), e->name);
+                    }
+                    if(e->arg) {
+                        len += stbsp_snprintf(out + len, cast(Int)(size - len), ", \"args\": {\"file\": ");
+                        len += write_trace_json_string(out + len, cast(Int)(size - len), e->arg);
+                        len += stbsp_snprintf(out + len, cast(Int)(size - len), "}");
+                    }
+                    len += stbsp_snprintf(out + len, cast(Int)(size - len), "}");
+                }
+            }
+        }
+
+        len += stbsp_snprintf(out + len, cast(Int)(size - len), "\n]}\n");
+
+        res = system_write_to_file(fname, out, len);
+        system_free(out);
+    }
+
+    // Throw everything away, so the next run (with --server or --watch) starts again.
+    for(Int i = 0; (i < buffer_count); ++i) {
+        TraceBlock *block = (global_trace_buffers[i]) ? global_trace_buffers[i]->first : 0;
+        while(block) {
+            TraceBlock *next = block->next;
+            system_free(block);
+            block = next;
+        }
+
+        system_free(global_trace_buffers[i]);
+        global_trace_buffers[i] = 0;
+    }
+
+    global_trace_buffer_count = 0;
+    ++global_trace_generation;
+    global_tracing = false;
+
+    return(res);
+}
+
+//
+// SIMD.
+//
+// The level's picked once, before main. Everything checks it per call, which is a predictable branch, and only on
+// inputs long enough for SIMD to be worth it.
+
+internal SimdLevel get_supported_simd_level(void) {
+    SimdLevel res = SimdLevel_none;
+
+#if SIMD_SSE2
+    res = SimdLevel_sse2;
+
+    #if SIMD_AVX2
+        #if COMPILER_MSVC
+            // The OS has to save the YMM registers too (OSXSAVE, then XCR0's SSE and AVX bits), not just the CPU.
+            int info[4] = {};
+            __cpuid(info, 0);
+            if(info[0] >= 7) {
+                __cpuid(info, 1);
+                Bool has_avx = ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6));
+
+                __cpuidex(info, 7, 0);
+                if((has_avx) && (info[1] & (1 << 5))) {
+                    res = SimdLevel_avx2;
+                }
+            }
+        #else
+            __builtin_cpu_init(); // Has to be called first when this runs before main, which it does.
+            if(__builtin_cpu_supports("avx2")) {
+                res = SimdLevel_avx2;
+            }
+        #endif
+    #endif
+#endif
+
+    return(res);
+}
+
+internal SimdLevel global_supported_simd_level = get_supported_simd_level();
+internal SimdLevel global_simd_level = global_supported_simd_level;
+
+SimdLevel get_simd_level(void) {
+    return(global_simd_level);
+}
+
+SimdLevel set_simd_level(SimdLevel level) {
+    global_simd_level = (level < global_supported_simd_level) ? level : global_supported_simd_level;
+
+    return(global_simd_level);
+}
+
+Char const *simd_level_to_string(SimdLevel level) {
+    Char const *res = "none";
+    if(level == SimdLevel_sse2)      { res = "sse2"; }
+    else if(level == SimdLevel_avx2) { res = "avx2"; }
+
+    return(res);
 }
 
 //
@@ -141,12 +760,51 @@ String create_string(Char const *str, Int len/*= 0*/) {
     return(res);
 }
 
+#if (SIMD_SSE2) && (!ADDRESS_SANITIZER)
+    #define STRING_LENGTH_SSE2 1
+#else
+    #define STRING_LENGTH_SSE2 0
+#endif
+
+#if STRING_LENGTH_SSE2
+// Only reads whole aligned blocks. They can go past the null, but never onto the next page, so it can't fault.
+internal Int string_length_sse2(Char const *str) {
+    __m128i zero = _mm_setzero_si128();
+    PtrSize offset = cast(PtrSize)str & 15;
+    Char const *block = str - offset;
+
+    Uint32 mask = cast(Uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(cast(__m128i const *)block), zero));
+    mask >>= offset;
+    if(!mask) {
+        do {
+            block += 16;
+            mask = cast(Uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(cast(__m128i const *)block), zero));
+        } while(!mask);
+
+        offset = 0;
+    }
+
+    Int res = cast(Int)(block + offset - str) + find_first_set_bit(mask);
+
+    return(res);
+}
+#endif
+
 Int string_length(Char const *str) {
     Int res = 0;
 
     if(str) {
-        while(*str++) {
-            ++res;
+        SimdLevel level = (STRING_LENGTH_SSE2) ? global_simd_level : SimdLevel_none;
+        switch(level) {
+#if STRING_LENGTH_SSE2
+            case SimdLevel_sse2: case SimdLevel_avx2: { res = string_length_sse2(str); } break;
+#endif
+
+            default: {
+                while(*str++) {
+                    ++res;
+                }
+            } break;
         }
     }
 
@@ -168,13 +826,22 @@ Bool string_concat(Char *dest, Int len, Char const *a, Int a_len, Char const *b,
 }
 
 Bool string_compare(Char const *a, Char const *b, Int len) {
-    for(Int i = 0; (i < len); ++i, ++a, ++b) {
-        if(*a != *b) {
-            return(false);
+    Bool res = true;
+
+#if SIMD_SSE2
+    if(global_simd_level >= SimdLevel_sse2) {
+        for(; (res) && (len >= 16); len -= 16, a += 16, b += 16) {
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128(cast(__m128i const *)a), _mm_loadu_si128(cast(__m128i const *)b));
+            res = (_mm_movemask_epi8(eq) == 0xFFFF);
         }
     }
+#endif
 
-    return(true);
+    for(Int i = 0; (res) && (i < len); ++i) {
+        res = (a[i] == b[i]);
+    }
+
+    return(res);
 }
 
 Bool string_compare(Char const *a, Char const *b) {
@@ -193,18 +860,7 @@ Void string_copy(Char *dest, Char const *src) {
 }
 
 Bool string_compare(String a, String b) {
-    Bool res = false;
-
-    if(a.len == b.len) {
-        res = true;
-
-        for(Int i = 0; (i < a.len); ++i) {
-            if(a.e[i] != b.e[i]) {
-                res = false;
-                break;
-            }
-        }
-    }
+    Bool res = ((a.len == b.len) && (string_compare(a.e, b.e, a.len)));
 
     return(res);
 }
@@ -221,24 +877,127 @@ Bool string_compare_array(String *a, String *b, Int cnt) {
     return(res);
 }
 
-Bool string_contains(String str, Char const *target) {
-    Int target_len = string_length(target);
+// Returns where target first starts in str, or -1. An empty target's never found.
+internal Int find_substring_scalar(Char const *str, Int str_len, Char const *target, Int target_len) {
+    Int res = -1;
+    if(target_len) {
+        for(Int i = 0; (i + target_len <= str_len); ++i) {
+            if((str[i] == target[0]) && (string_compare(str + i + 1, target + 1, target_len - 1))) {
+                res = i;
+                break; // for
+            }
+        }
+    }
 
-    for(Int i = 0; (i < str.len); ++i) {
-        if(str.e[i] == target[0]) {
-            for(int j = 0; (j < target_len); ++j) {
-                if(str.e[i + j] != target[j]) {
-                    break;
-                }
+    return(res);
+}
 
-                if(j == (target_len - 1)) {
-                    return(true);
-                }
+// Each block checks 16 starting positions at once, by comparing the first byte of target against one load and the
+// last byte against another, target_len - 1 further on. Only positions where both match get compared properly, which
+// is hardly any in normal text.
+#if SIMD_SSE2
+internal Int find_substring_sse2(Char const *str, Int str_len, Char const *target, Int target_len) {
+    __m128i first = _mm_set1_epi8(target[0]);
+    __m128i last = _mm_set1_epi8(target[target_len - 1]);
+
+    Int res = -1;
+    Int i = 0;
+    for(; (res == -1) && (i + target_len - 1 + 16 <= str_len); i += 16) {
+        __m128i block_first = _mm_loadu_si128(cast(__m128i const *)(str + i));
+        __m128i block_last = _mm_loadu_si128(cast(__m128i const *)(str + i + target_len - 1));
+        Uint32 mask = cast(Uint32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                                  _mm_cmpeq_epi8(block_last, last)));
+        while(mask) {
+            Int pos = i + find_first_set_bit(mask);
+            if(string_compare(str + pos + 1, target + 1, target_len - 2)) {
+                res = pos;
+                break; // while
             }
+
+            mask &= mask - 1;
         }
     }
 
-    return(false);
+    if(res == -1) {
+        res = find_substring_scalar(str + i, str_len - i, target, target_len);
+        if(res != -1) {
+            res += i;
+        }
+    }
+
+    return(res);
+}
+#endif
+
+#if SIMD_AVX2
+// The candidates are compared inline, so nothing's called with the AVX registers dirty.
+AVX2_FUNCTION internal Int find_substring_avx2(Char const *str, Int str_len, Char const *target, Int target_len) {
+    __m256i first = _mm256_set1_epi8(target[0]);
+    __m256i last = _mm256_set1_epi8(target[target_len - 1]);
+
+    Int res = -1;
+    Int i = 0;
+    for(; (res == -1) && (i + target_len - 1 + 32 <= str_len); i += 32) {
+        __m256i block_first = _mm256_loadu_si256(cast(__m256i const *)(str + i));
+        __m256i block_last = _mm256_loadu_si256(cast(__m256i const *)(str + i + target_len - 1));
+        Uint32 mask = cast(Uint32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                                        _mm256_cmpeq_epi8(block_last, last)));
+        while(mask) {
+            Int pos = i + find_first_set_bit(mask);
+
+            Int j = 1;
+            while((j < target_len - 1) && (str[pos + j] == target[j])) {
+                ++j;
+            }
+
+            if(j >= target_len - 1) {
+                res = pos;
+                break; // while
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    _mm256_zeroupper();
+
+    // Whatever's left is less than a block, so SSE2 can still do some of it.
+    if(res == -1) {
+        res = find_substring_sse2(str + i, str_len - i, target, target_len);
+        if(res != -1) {
+            res += i;
+        }
+    }
+
+    return(res);
+}
+#endif
+
+internal Int find_substring(Char const *str, Int str_len, Char const *target, Int target_len) {
+    SimdLevel level = SimdLevel_none;
+    if(target_len) {
+        if((global_simd_level >= SimdLevel_avx2) && (str_len >= target_len + 31)) { level = SimdLevel_avx2; }
+        else if(global_simd_level >= SimdLevel_sse2)                               { level = SimdLevel_sse2; }
+    }
+
+    Int res = -1;
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: { res = find_substring_avx2(str, str_len, target, target_len); } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: { res = find_substring_sse2(str, str_len, target, target_len); } break;
+#endif
+        default:             { res = find_substring_scalar(str, str_len, target, target_len); } break;
+    }
+
+    return(res);
+}
+
+Bool string_contains(String str, Char const *target) {
+    Bool res = (find_substring(str.e, str.len, target, string_length(target)) != -1);
+
+    return(res);
 }
 
 Bool string_contains(Char const *str, Char const *target) {
@@ -247,27 +1006,11 @@ Bool string_contains(Char const *str, Char const *target) {
 }
 
 Int string_contains_pos(Char const *str, Char const *target) {
-    Int target_len = string_length(target);
-    Int str_len = string_length(str);
-
-    for(Int i = 0; (i < str_len); ++i) {
-        if(str[i] == target[0]) {
-            for(int j = 0; (j < target_len); ++j) {
-                if(str[i + j] != target[j]) {
-                    break;
-                }
+    Int res = find_substring(str, string_length(str), target, string_length(target));
 
-                if(j == (target_len - 1)) {
-                    return(i);
-                }
-            }
-        }
-    }
-
-    return(-1);
+    return(res);
 }
 
-
 //
 // Stuff
 //
@@ -337,6 +1080,42 @@ Uint32 safe_truncate_size_64(Uint64 v) {
     return(res);
 }
 
+// MurmurHash64A. Not cryptographic, but fast, and good enough to tell if a file changed.
+Uint64 hash_bytes(Void const *data, PtrSize size, Uint64 seed/*= 0*/) {
+    Uint64 const m = 0xc6a4a7935bd1e995ULL;
+    Int const r = 47;
+
+    Uint64 res = seed ^ (size * m);
+
+    Byte const *at = cast(Byte const *)data;
+    Byte const *end = at + (size & ~7);
+    for(; (at < end); at += 8) {
+        Uint64 k = *cast(Uint64 const *)at;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        res ^= k;
+        res *= m;
+    }
+
+    Int remaining = cast(Int)(size & 7);
+    if(remaining) {
+        for(Int i = remaining - 1; (i >= 0); --i) {
+            res ^= cast(Uint64)at[i] << (i * 8);
+        }
+
+        res *= m;
+    }
+
+    res ^= res >> r;
+    res *= m;
+    res ^= res >> r;
+
+    return(res);
+}
+
 Variable create_variable(Char const *type, Char const *name, Int ptr/*= 0*/, Int array_count/*= 1*/) {
     Variable res;
     res.type = create_string(type);
@@ -347,6 +1126,91 @@ Variable create_variable(Char const *type, Char const *name, Int ptr/*= 0*/, Int
     return(res);
 }
 
+//
+// Symbol table.
+//
+internal Int *find_symbol_slot(SymbolTable *table, String str, Uint64 hash) {
+    Int mask = table->slot_cnt - 1;
+    Int index = cast(Int)(hash & mask);
+
+    Int *res = table->slots + index;
+    while(*res) {
+        Symbol *sym = table->symbols + *res;
+        if((sym->hash == hash) && (string_compare(sym->str, str))) {
+            break; // while
+        }
+
+        index = (index + 1) & mask;
+        res = table->slots + index;
+    }
+
+    return(res);
+}
+
+internal Bool grow_symbol_table(SymbolTable *table) {
+    Bool res = false;
+
+    Int new_max = (table->max) ? table->max * 2 : 256;
+    Symbol *symbols = cast(Symbol *)resize_arena_memory(table->arena, table->symbols, sizeof(Symbol) * table->max,
+                                                        sizeof(Symbol) * new_max);
+    Int *slots = push_arena(table->arena, Int, new_max * 2);
+    if((symbols) && (slots)) {
+        table->symbols = symbols;
+        table->max = new_max;
+        if(!table->cnt) {
+            table->cnt = 1; // ID 0 is never used.
+        }
+
+        table->slots = slots;
+        table->slot_cnt = new_max * 2;
+        for(Int i = 1; (i < table->cnt); ++i) {
+            *find_symbol_slot(table, table->symbols[i].str, table->symbols[i].hash) = i;
+        }
+
+        res = true;
+    }
+
+    return(res);
+}
+
+Int intern_string(SymbolTable *table, String str) {
+    Int res = 0;
+
+    if(str.len) {
+        Uint64 hash = hash_bytes(str.e, str.len);
+        Int *slot = (table->slots) ? find_symbol_slot(table, str, hash) : 0;
+        if((slot) && (*slot)) {
+            res = *slot;
+        } else {
+            // Keep the table at most half full.
+            if((table->cnt + 1 >= table->max) && (grow_symbol_table(table))) {
+                slot = find_symbol_slot(table, str, hash);
+            }
+
+            if((slot) && (table->cnt < table->max)) {
+                res = table->cnt++;
+                table->symbols[res].str = str;
+                table->symbols[res].hash = hash;
+                *slot = res;
+            } else {
+                push_error(ErrorType_ran_out_of_memory);
+            }
+        }
+    }
+
+    return(res);
+}
+
+Int find_symbol(SymbolTable *table, String str) {
+    Int res = 0;
+
+    if((str.len) && (table->slots)) {
+        res = *find_symbol_slot(table, str, hash_bytes(str.e, str.len));
+    }
+
+    return(res);
+}
+
 Bool compare_variable(Variable a, Variable b) {
     Bool res = true;
 
@@ -377,18 +1241,148 @@ Char to_caps(Char c) {
     return(res);
 }
 
+// Anything shorter than a block is done a byte at a time. Otherwise the first and last blocks are stored unaligned,
+// overlapping the ones next to them, and everything in between's stored aligned, so there's never a tail to do a byte
+// at a time and no store straddles a cache line.
+internal Void copy_scalar(Byte *dest, Byte const *src, PtrSize size) {
+    for(PtrSize i = 0; (i < size); ++i) {
+        dest[i] = src[i];
+    }
+}
+
+#if SIMD_SSE2
+internal Void copy_sse2(Byte *dest, Byte const *src, PtrSize size) {
+    __m128i first = _mm_loadu_si128(cast(__m128i const *)src);
+    __m128i last = _mm_loadu_si128(cast(__m128i const *)(src + size - 16));
+
+    PtrSize i = 16 - (cast(PtrSize)dest & 15);
+    for(; (i + 64 <= size); i += 64) {
+        __m128i a = _mm_loadu_si128(cast(__m128i const *)(src + i));
+        __m128i b = _mm_loadu_si128(cast(__m128i const *)(src + i + 16));
+        __m128i c = _mm_loadu_si128(cast(__m128i const *)(src + i + 32));
+        __m128i d = _mm_loadu_si128(cast(__m128i const *)(src + i + 48));
+        _mm_store_si128(cast(__m128i *)(dest + i), a);
+        _mm_store_si128(cast(__m128i *)(dest + i + 16), b);
+        _mm_store_si128(cast(__m128i *)(dest + i + 32), c);
+        _mm_store_si128(cast(__m128i *)(dest + i + 48), d);
+    }
+    for(; (i + 16 <= size); i += 16) {
+        _mm_store_si128(cast(__m128i *)(dest + i), _mm_loadu_si128(cast(__m128i const *)(src + i)));
+    }
+
+    _mm_storeu_si128(cast(__m128i *)dest, first);
+    _mm_storeu_si128(cast(__m128i *)(dest + size - 16), last);
+}
+#endif
+
+#if SIMD_AVX2
+AVX2_FUNCTION internal Void copy_avx2(Byte *dest, Byte const *src, PtrSize size) {
+    __m256i first = _mm256_loadu_si256(cast(__m256i const *)src);
+    __m256i last = _mm256_loadu_si256(cast(__m256i const *)(src + size - 32));
+
+    PtrSize i = 32 - (cast(PtrSize)dest & 31);
+    for(; (i + 128 <= size); i += 128) {
+        __m256i a = _mm256_loadu_si256(cast(__m256i const *)(src + i));
+        __m256i b = _mm256_loadu_si256(cast(__m256i const *)(src + i + 32));
+        __m256i c = _mm256_loadu_si256(cast(__m256i const *)(src + i + 64));
+        __m256i d = _mm256_loadu_si256(cast(__m256i const *)(src + i + 96));
+        _mm256_store_si256(cast(__m256i *)(dest + i), a);
+        _mm256_store_si256(cast(__m256i *)(dest + i + 32), b);
+        _mm256_store_si256(cast(__m256i *)(dest + i + 64), c);
+        _mm256_store_si256(cast(__m256i *)(dest + i + 96), d);
+    }
+    for(; (i + 32 <= size); i += 32) {
+        _mm256_store_si256(cast(__m256i *)(dest + i), _mm256_loadu_si256(cast(__m256i const *)(src + i)));
+    }
+
+    _mm256_storeu_si256(cast(__m256i *)dest, first);
+    _mm256_storeu_si256(cast(__m256i *)(dest + size - 32), last);
+    _mm256_zeroupper();
+}
+#endif
+
 Void copy(Void *dest, Void *src, PtrSize size) {
     Byte *dest8 = cast(Byte *)dest;
-    Byte *src8 = cast(Byte *)src;
+    Byte const *src8 = cast(Byte const *)src;
+
+    // AVX2 only pays off once there's a few blocks, the short copies into the output chunks are faster with SSE2.
+    SimdLevel level = SimdLevel_none;
+    if((size >= 128) && (global_simd_level >= SimdLevel_avx2))     { level = SimdLevel_avx2; }
+    else if((size >= 16) && (global_simd_level >= SimdLevel_sse2)) { level = SimdLevel_sse2; }
+
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: { copy_avx2(dest8, src8, size);   } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: { copy_sse2(dest8, src8, size);   } break;
+#endif
+        default:             { copy_scalar(dest8, src8, size); } break;
+    }
+}
 
-    for(Int i = 0; (i < size); ++i, ++dest8, ++src8) {
-        *dest8 = *src8;
+// Same as copy. set's mostly used for zeroing whole arena blocks, so the big loop's what counts.
+internal Void set_scalar(Byte *dest, Byte v, PtrSize n) {
+    for(PtrSize i = 0; (i < n); ++i) {
+        dest[i] = v;
     }
 }
 
+#if SIMD_SSE2
+internal Void set_sse2(Byte *dest, Byte v, PtrSize n) {
+    __m128i c = _mm_set1_epi8(cast(Char)v);
+    _mm_storeu_si128(cast(__m128i *)dest, c);
+
+    PtrSize i = 16 - (cast(PtrSize)dest & 15);
+    for(; (i + 64 <= n); i += 64) {
+        _mm_store_si128(cast(__m128i *)(dest + i), c);
+        _mm_store_si128(cast(__m128i *)(dest + i + 16), c);
+        _mm_store_si128(cast(__m128i *)(dest + i + 32), c);
+        _mm_store_si128(cast(__m128i *)(dest + i + 48), c);
+    }
+    for(; (i + 16 <= n); i += 16) {
+        _mm_store_si128(cast(__m128i *)(dest + i), c);
+    }
+
+    _mm_storeu_si128(cast(__m128i *)(dest + n - 16), c);
+}
+#endif
+
+#if SIMD_AVX2
+AVX2_FUNCTION internal Void set_avx2(Byte *dest, Byte v, PtrSize n) {
+    __m256i c = _mm256_set1_epi8(cast(Char)v);
+    _mm256_storeu_si256(cast(__m256i *)dest, c);
+
+    PtrSize i = 32 - (cast(PtrSize)dest & 31);
+    for(; (i + 128 <= n); i += 128) {
+        _mm256_store_si256(cast(__m256i *)(dest + i), c);
+        _mm256_store_si256(cast(__m256i *)(dest + i + 32), c);
+        _mm256_store_si256(cast(__m256i *)(dest + i + 64), c);
+        _mm256_store_si256(cast(__m256i *)(dest + i + 96), c);
+    }
+    for(; (i + 32 <= n); i += 32) {
+        _mm256_store_si256(cast(__m256i *)(dest + i), c);
+    }
+
+    _mm256_storeu_si256(cast(__m256i *)(dest + n - 32), c);
+    _mm256_zeroupper();
+}
+#endif
+
 Void set(Void *dest, Byte v, PtrSize n) {
     Byte *dest8 = cast(Byte *)dest;
-    for(Int i = 0; (i < n); ++i, ++dest8) {
-        *dest8 = cast(Byte)v;
+
+    SimdLevel level = SimdLevel_none;
+    if((n >= 128) && (global_simd_level >= SimdLevel_avx2))     { level = SimdLevel_avx2; }
+    else if((n >= 16) && (global_simd_level >= SimdLevel_sse2)) { level = SimdLevel_sse2; }
+
+    switch(level) {
+#if SIMD_AVX2
+        case SimdLevel_avx2: { set_avx2(dest8, v, n);   } break;
+#endif
+#if SIMD_SSE2
+        case SimdLevel_sse2: { set_sse2(dest8, v, n);   } break;
+#endif
+        default:             { set_scalar(dest8, v, n); } break;
     }
 }
@@ -13,20 +13,9 @@
 
 #include "shared.h"
 
-// TODO(Jonny): This should probably be a flag, rather than compiled into the preprocessor.
-#if COMPILER_MSVC
-    #define GUID__(file, seperator, line) file seperator line ")"
-    #define GUID_(file, line) GUID__(file, "(", #line)
-    #define GUID(file, line) GUID_(file, line)
-    #define MAKE_GUID GUID(__FILE__, __LINE__)
-#else
-    #define GUID__(file, seperator, line) file seperator line ":1: error:"
-    #define GUID_(file, line) GUID__(file, ":", #line)
-    #define GUID(file, line) GUID_(file, line)
-    #define MAKE_GUID GUID(__FILE__, __LINE__)
-#endif
-
 #define dir_name "pp_generated" // The directory the generated code goes in.
+#define cache_dir_name dir_name "/cache" // One stamp file per source file, so we can skip ones which haven't changed.
+#define preprocessor_version "1.0"
 
 //
 // Error stuff.
@@ -53,6 +42,8 @@ enum ErrorType {
     ErrorType_incorrect_number_of_members_for_struct,
     ErrorType_incorrect_struct_name,
     ErrorType_incorrect_number_of_base_structs,
+    ErrorType_could_not_start_server,
+    ErrorType_could_not_watch_files,
 
     ErrorType_count,
 };
@@ -67,6 +58,13 @@ struct Error {
 Void push_error_(ErrorType type, Char const *guid);
 Char const *ErrorTypeToString(ErrorType e);
 Bool print_errors(void);
+Int get_error_count(void); // Errors pushed to the current error counter, or by the calling thread if there isn't one.
+// Errors are also added to the current error counter, which is per-thread and carried into any jobs added while it's
+// set. Returns the previous one, so it can be put back.
+Int volatile *set_error_counter(Int volatile *counter);
+Int volatile *get_error_counter(void);
+Void clear_errors(void); // Same rules as print_errors.
+Void release_error_list(void); // Call before a thread exits, so its errors outlive it.
 
 // Google Test compains...
 #if defined(assert)
@@ -91,7 +89,108 @@ struct File {
 static Int const scratch_memory_size = 256 * 256;
 Void *push_scratch_memory(Int size = scratch_memory_size);
 Void clear_scratch_memory(void);
-Void free_scratch_memory();
+Void free_scratch_memory(); // Frees the thread's arenas too, so call it before a thread exits.
+
+//
+// Memory arena.
+//
+// A linear allocator, for everything which lives as long as one file does (the parse results, the generated output,
+// etc). Memory comes from the OS in big blocks, anything pushed is zeroed, and clear_arena throws it all away at once.
+static PtrSize const arena_block_size = 1024 * 1024;
+struct MemoryArena {
+    Byte *base; // Current block. Older blocks are chained from its header.
+    PtrSize used;
+    PtrSize size;
+    PtrSize dirty; // Everything in the current block past this is still zero.
+    Byte *absorbed; // Blocks taken over from other arenas by absorb_arena.
+
+    PtrSize total_size; // Of every block, including absorbed ones.
+    PtrSize peak_size; // The biggest total_size has been. Can be reset to total_size, to measure part of a run.
+};
+
+// resize_arena_memory grows (or shrinks) ptr in place if it was the last thing pushed, otherwise it pushes a new copy.
+#if MEM_CHECK
+    // Like system_alloc, everything pushed is recorded against the line which pushed it.
+    Void *push_arena_size_(Char const *guid, MemoryArena *arena, PtrSize size, PtrSize cnt = 1);
+    Void *resize_arena_memory_(Char const *guid, MemoryArena *arena, Void *ptr, PtrSize old_size, PtrSize new_size);
+
+    #define push_arena_size(...) push_arena_size_(MAKE_GUID, __VA_ARGS__)
+    #define resize_arena_memory(...) resize_arena_memory_(MAKE_GUID, __VA_ARGS__)
+#else
+    Void *push_arena_size(MemoryArena *arena, PtrSize size, PtrSize cnt = 1);
+    Void *resize_arena_memory(MemoryArena *arena, Void *ptr, PtrSize old_size, PtrSize new_size);
+#endif
+#define push_arena(arena, Type, ...) (Type *)push_arena_size(arena, sizeof(Type), ##__VA_ARGS__)
+
+Void clear_arena(MemoryArena *arena);
+Void free_arena(MemoryArena *arena);
+
+// Hands all of src's blocks over to arena, so they're freed along with it. src is left empty.
+Void absorb_arena(MemoryArena *arena, MemoryArena *src);
+
+// Everything pushed (or absorbed) after begin_temp_memory is thrown away by end_temp_memory. Nests, so a job which
+// runs while another one is waiting on the same thread only clears up after itself.
+struct TempMemory {
+    MemoryArena *arena;
+    Byte *base;
+    PtrSize used;
+    Byte *absorbed;
+};
+TempMemory begin_temp_memory(MemoryArena *arena);
+Void end_temp_memory(TempMemory temp);
+
+// Each thread has its own, so jobs don't have to create one per file.
+MemoryArena *get_thread_arena(void);
+
+// For things which only live for part of a job. Always use it with begin/end_temp_memory.
+MemoryArena *get_thread_scratch_arena(void);
+
+//
+// Tracing.
+//
+// With --trace, trace_begin and trace_end record events into a buffer per thread, and write_trace writes them all
+// out as Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev. When tracing is off they're a branch.
+// name and arg aren't copied, so they have to last until write_trace.
+Void start_tracing(void);
+Void trace_begin(Char const *name, Char const *arg = 0); // arg shows up as the event's "file".
+Void trace_end(void);
+Bool write_trace(Char const *fname); // Also stops tracing. Should only be called when no other threads are tracing.
+
+//
+// SIMD.
+//
+// The lexer's scanners, the string functions, copy and set use SSE2 where it's compiled in, and AVX2 as well if the CPU
+// has it. Lowering the level is only really useful for comparing them. set_simd_level clamps it to what the CPU
+// supports, and returns what it ended up as.
+enum SimdLevel {
+    SimdLevel_none,
+    SimdLevel_sse2,
+    SimdLevel_avx2,
+
+    SimdLevel_count,
+};
+
+SimdLevel get_simd_level(void);
+SimdLevel set_simd_level(SimdLevel level);
+Char const *simd_level_to_string(SimdLevel level);
+
+// The index of the lowest set bit, for turning a compare's movemask into a position. v can't be 0.
+#if COMPILER_MSVC
+    #include <intrin.h>
+    inline Int find_first_set_bit(Uint32 v) {
+        unsigned long index = 0;
+        _BitScanForward(&index, v);
+        Int res = cast(Int)index;
+
+        return(res);
+    }
+#else
+    inline Int find_first_set_bit(Uint32 v) {
+        Int res = __builtin_ctz(v);
+
+        return(res);
+    }
+#endif
 
 //
 // String
@@ -130,6 +229,32 @@ ResultInt string_to_int(Char *str);
 
 Uint32 safe_truncate_size_64(Uint64 v);
 
+Uint64 hash_bytes(Void const *data, PtrSize size, Uint64 seed = 0);
+
+//
+// Symbol table.
+//
+// Interns strings, so each unique one gets a small integer ID which can be compared (or used to index an array)
+// instead of the string. IDs start at 1, so 0 means "no symbol". Everything comes from arena.
+struct Symbol {
+    String str;
+    Uint64 hash;
+};
+
+struct SymbolTable {
+    Symbol *symbols; // Indexed by ID.
+    Int cnt; // Includes the unused 0.
+    Int max;
+
+    Int *slots; // Open addressing with linear probing. Empty slots are 0, and slot_cnt is always a power of two.
+    Int slot_cnt;
+
+    MemoryArena *arena;
+};
+
+Int intern_string(SymbolTable *table, String str); // Returns 0 for an empty string, or if it ran out of memory.
+Int find_symbol(SymbolTable *table, String str);
+
 //
 // Variable.
 //
@@ -147,7 +272,11 @@ struct Variable {
     Access access;
     Int ptr;
     Int array_count; // This is 1 if it's not an array. TODO(Jonny): Is this true anymore?
-    Bool is_inside_anonymous_struct;
+    Int anonymous_depth; // How many anonymous structs and unions it's inside, like i in "union { struct { int i; }; };".
+    Int anonymous_opened; // How many of those start at it.
+    Uint8 anonymous_unions; // Bit n is set if the one n deep is a union.
+
+    Int type_id; // From the file's SymbolTable.
 };
 
 Variable create_variable(Char const *type, Char const *name, Int ptr = 0, Int array_count = 1);
@@ -165,7 +294,7 @@ const Int max_ptr_size = 4;
 // memset and memcpy
 //
 
-Void copy(Void *dst, Void *src, PtrSize size);
+Void copy(Void *dst, Void *src, PtrSize size); // dst and src can't overlap.
 #define zero(dst, size) set(dst, 0, size)
 Void set(Void *dst, Byte v, PtrSize size);
 
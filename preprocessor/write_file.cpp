@@ -12,14 +12,9 @@
 #include "write_file.h"
 #include "lexer.h"
 #include "platform.h"
+#include "thread_pool.h"
 #include "stb_sprintf.h"
 
-struct OutputBuffer {
-    Char *buffer;
-    Int index;
-    Int size;
-};
-
 enum StdTypes {
     StdTypes_not,
     StdTypes_vector,
@@ -79,13 +74,129 @@ internal StdResult get_std_information(String str) {
     return(res);
 }
 
+//
+// Output buffer.
+//
+#define output_chunk_size (256 * 1024)
+
+internal Bool push_output_chunk(OutputBuffer *ob) {
+    Bool res = false;
+
+    OutputChunk *chunk = push_arena(ob->arena, OutputChunk);
+    Char *data = push_arena(ob->arena, Char, output_chunk_size);
+    if((chunk) && (data)) {
+        chunk->data = data;
+        chunk->size = output_chunk_size;
+
+        if(ob->last) { ob->last->next = chunk; }
+        else         { ob->first = chunk;      }
+        ob->last = chunk;
+        ++ob->chunk_count;
+
+        res = true;
+    }
+
+    return(res);
+}
+
+// Returns somewhere with at least STB_SPRINTF_MIN bytes free, starting a new chunk if it has to.
+internal Char *get_output_space(OutputBuffer *ob) {
+    Char *res = 0;
+
+    if((!ob->last) || (ob->last->size - ob->last->used < STB_SPRINTF_MIN)) {
+        push_output_chunk(ob);
+    }
+
+    if((ob->last) && (ob->last->size - ob->last->used >= STB_SPRINTF_MIN)) {
+        res = ob->last->data + ob->last->used;
+    }
+
+    return(res);
+}
+
+// stb_sprintf formats straight into the chunk, and calls this every STB_SPRINTF_MIN bytes (and at the end).
+internal Char *output_buffer_callback(Char *buf, Void *user, Int len) {
+    OutputBuffer *ob = cast(OutputBuffer *)user;
+    assert(buf == ob->last->data + ob->last->used);
+
+    // Going from buf (rather than adding len to used) means it's still read when assert compiles out.
+    ob->last->used = cast(Int)(buf - ob->last->data) + len;
+    ob->total_size += len;
+
+    Char *res = get_output_space(ob);
+
+    return(res);
+}
+
 #define empty_line(ob) write_to_output_buffer(ob, "\n")
 internal Void write_to_output_buffer(OutputBuffer *ob, Char const *format, ...) {
-    va_list args;
-    va_start(args, format);
-    ob->index += stbsp_vsnprintf(ob->buffer + ob->index, ob->size - ob->index, format, args);
-    assert(ob->index < ob->size);
-    va_end(args);
+    Char *buf = get_output_space(ob);
+    if(buf) {
+        va_list args;
+        va_start(args, format);
+        stbsp_vsprintfcb(output_buffer_callback, ob, buf, format, args);
+        va_end(args);
+    }
+}
+
+//
+// Appending without printf.
+//
+// Most of the generated code is fixed text, with names and numbers dropped in. So rather than have stb_sprintf parse
+// a format string for every line, the hot bits are split up into literals (whose lengths are known at compile time),
+// strings and ints, which just get copied in.
+internal Void write_bytes(OutputBuffer *ob, Char const *data, Int len) {
+    while(len > 0) {
+        if((!ob->last) || (ob->last->used == ob->last->size)) {
+            if(!push_output_chunk(ob)) {
+                break; // while
+            }
+        }
+
+        OutputChunk *chunk = ob->last;
+        Int to_copy = (len < chunk->size - chunk->used) ? len : chunk->size - chunk->used;
+        copy(chunk->data + chunk->used, cast(Void *)data, to_copy);
+
+        chunk->used += to_copy;
+        ob->total_size += to_copy;
+        data += to_copy;
+        len -= to_copy;
+    }
+}
+
+#define write_literal(ob, str) write_bytes(ob, str, sizeof(str) - 1)
+
+internal Void write_string(OutputBuffer *ob, String str) {
+    write_bytes(ob, str.e, str.len);
+}
+
+internal Void write_cstring(OutputBuffer *ob, Char const *str) {
+    write_bytes(ob, str, string_length(str));
+}
+
+internal Void write_int(OutputBuffer *ob, Int v) {
+    Char buf[16] = {};
+    Int index = array_count(buf);
+
+    Uint32 u = (v < 0) ? -cast(Uint32)v : cast(Uint32)v;
+    do {
+        buf[--index] = '0' + (u % 10);
+        u /= 10;
+    } while(u);
+
+    if(v < 0) {
+        buf[--index] = '-';
+    }
+
+    write_bytes(ob, buf + index, array_count(buf) - index);
+}
+
+Void get_output_chunks(OutputBuffer *ob, FileChunk *chunks) {
+    Int i = 0;
+    for(OutputChunk *chunk = ob->first; (chunk); chunk = chunk->next, ++i) {
+        chunks[i].data = chunk->data;
+        chunks[i].size = chunk->used;
+    }
 }
 
 internal Char const *primitive_types[] = {"char", "short", "int", "long", "float", "double", "bool"};
@@ -104,52 +215,69 @@ internal Int set_primitive_type(String *array) {
     return(res);
 }
 
-internal StructData *find_struct(String str, StructData *structs, Int struct_count) {
-    StructData *res = 0;
+// struct_index maps a symbol ID to the first struct with that name, so this doesn't have to search.
+internal StructData *find_struct(Int id, StructData **struct_index) {
+    StructData *res = ((id) && (struct_index)) ? struct_index[id] : 0;
 
-    if(str.len) {
-        for(Int i = 0; (i < struct_count); ++i) {
-            StructData *sd = structs + i;
+    return(res);
+}
 
-            if(string_compare(str, sd->name)) {
-                res = sd;
-                break; // for
-            }
-        }
+internal StructData *find_base_class(StructData *sd, Int index, StructData **struct_index) {
+    StructData *res = 0;
+    if(sd->inherited_ids) {
+        res = find_struct(sd->inherited_ids[index], struct_index);
     }
 
     return(res);
 }
 
-internal Bool is_meta_type_already_in_array(String *array, Int len, String test) {
-    Bool res = false;
-
-    for(Int i = 0; (i < len); ++i) {
-        if(string_compare(array[i], test)) {
-            res = true;
-            break; // for
-        }
-    }
+// Unpacks one row of the member table, for the passes which need all of a member.
+internal Variable get_member(MemberTable *members, SymbolTable *symbols, Int index) {
+    Variable res = {};
+    res.type_id = members->type_id[index];
+    res.type = symbols->symbols[res.type_id].str;
+    res.name = symbols->symbols[members->name_id[index]].str;
+    res.access = cast(Access)(members->flags[index] & MemberFlag_access_mask);
+    res.ptr = members->ptr[index];
+    res.array_count = members->array_count[index];
+    res.anonymous_depth = (members->flags[index] & MemberFlag_anonymous_depth_mask) >> MemberFlag_anonymous_depth_shift;
+    res.anonymous_opened = (members->flags[index] & MemberFlag_anonymous_opened_mask) >> MemberFlag_anonymous_opened_shift;
+    res.anonymous_unions = members->anonymous_unions[index];
 
     return(res);
 }
 
-internal Int get_actual_type_count(String *types, StructData *struct_data, Int struct_count) {
+// Symbols the table doesn't have (an empty string) all share ID 0, so they dedupe like any other.
+internal Int get_actual_type_count(String *types, StructData *struct_data, Int struct_count, MemberTable *members,
+                                   SymbolTable *symbols, MemoryArena *arena) {
     Int res = set_primitive_type(types);
 
-    // Fill out the enum meta type enum.
-    for(Int i = 0; (i < struct_count); ++i) {
-        StructData *sd = struct_data + i;
+    Int primitive_ids[get_num_of_primitive_types()] = {};
+    for(Int i = 0; (i < res); ++i) {
+        primitive_ids[i] = intern_string(symbols, types[i]);
+    }
 
-        if(!is_meta_type_already_in_array(types, res, sd->name)) {
-            types[res++] = sd->name;
+    Bool *seen = push_arena(arena, Bool, symbols->cnt + 1);
+    if(seen) {
+        for(Int i = 0; (i < res); ++i) {
+            seen[primitive_ids[i]] = true;
         }
 
-        for(Int j = 0; (j < sd->member_count); ++j) {
-            Variable *md = sd->members + j;
+        // Fill out the enum meta type enum.
+        for(Int i = 0; (i < struct_count); ++i) {
+            StructData *sd = struct_data + i;
 
-            if(!is_meta_type_already_in_array(types, res, md->type)) {
-                types[res++] = md->type;
+            if(!seen[sd->name_id]) {
+                seen[sd->name_id] = true;
+                types[res++] = sd->name;
+            }
+
+            Int *type_ids = members->type_id + sd->first_member;
+            for(Int j = 0; (j < sd->member_count); ++j) {
+                if(!seen[type_ids[j]]) {
+                    seen[type_ids[j]] = true;
+                    types[res++] = symbols->symbols[type_ids[j]].str;
+                }
             }
         }
     }
@@ -190,49 +318,63 @@ internal Void write_type_struct(OutputBuffer *ob, String name, Int member_count,
         ++at;
     }
 
-    write_to_output_buffer(ob,
-                           "template<> class TypeInfo<%.*s%s%s> {\n"
-                           "public:\n"
-                           "    using type      = %.*s%s%s;\n"
-                           "    using weak_type = %.*s;\n"
-                           "    using base      = %.*s;\n"
-                           "\n"
-                           "    static constexpr char const * const name      = \"%.*s%s%s\";\n"
-                           "    static constexpr char const * const weak_name = \"%.*s\";\n"
-                           "\n"
-                           "    static constexpr size_t const member_count = %d;\n"
-                           "    static constexpr size_t const base_count   = %d;\n"
-                           "\n"
-                           "    static constexpr size_t const ptr    = %d;\n"
-                           "    static constexpr bool   const is_ref = %s;\n"
-                           "\n"
-                           "    static constexpr bool const is_primitive = %s;\n"
-                           "    static constexpr bool const is_class     = %s;\n"
-                           "    static constexpr bool const is_enum      = %s;\n"
-                           "};\n"
-                           "\n",
-                           name.len, name.e, pointer_stuff, ref,
-                           name.len, name.e, pointer_stuff, ref,
-                           name.len, name.e,
-                           (base.len) ? base.len : 4, (base.len) ? base.e : "void",
-                           name.len, name.e, pointer_stuff, ref,
-                           name.len, name.e,
-                           member_count,
-                           inherited_count,
-                           ptr_count,
-                           (is_ref) ? "true" : "false",
-                           (type == primitive) ? "true" : "false",
-                           (type == struct_class) ? "true" : "false",
-                           (type == an_enum) ? "true" : "false");
+    // This gets written a lot (eight times for every type), so it's all appended directly.
+    write_literal(ob, "template<> class TypeInfo<");
+    write_string(ob, name); write_cstring(ob, pointer_stuff); write_cstring(ob, ref);
+    write_literal(ob, "> {\n"
+                      "public:\n"
+                      "    using type      = ");
+    write_string(ob, name); write_cstring(ob, pointer_stuff); write_cstring(ob, ref);
+    write_literal(ob, ";\n"
+                      "    using weak_type = ");
+    write_string(ob, name);
+    write_literal(ob, ";\n"
+                      "    using base      = ");
+    write_string(ob, (base.len) ? base : create_string("void"));
+    write_literal(ob, ";\n"
+                      "\n"
+                      "    static constexpr char const * const name      = \"");
+    write_string(ob, name); write_cstring(ob, pointer_stuff); write_cstring(ob, ref);
+    write_literal(ob, "\";\n"
+                      "    static constexpr char const * const weak_name = \"");
+    write_string(ob, name);
+    write_literal(ob, "\";\n"
+                      "\n"
+                      "    static constexpr size_t const member_count = ");
+    write_int(ob, member_count);
+    write_literal(ob, ";\n"
+                      "    static constexpr size_t const base_count   = ");
+    write_int(ob, inherited_count);
+    write_literal(ob, ";\n"
+                      "\n"
+                      "    static constexpr size_t const ptr    = ");
+    write_int(ob, ptr_count);
+    write_literal(ob, ";\n"
+                      "    static constexpr bool   const is_ref = ");
+    write_cstring(ob, (is_ref) ? "true" : "false");
+    write_literal(ob, ";\n"
+                      "\n"
+                      "    static constexpr bool const is_primitive = ");
+    write_cstring(ob, (type == primitive) ? "true" : "false");
+    write_literal(ob, ";\n"
+                      "    static constexpr bool const is_class     = ");
+    write_cstring(ob, (type == struct_class) ? "true" : "false");
+    write_literal(ob, ";\n"
+                      "    static constexpr bool const is_enum      = ");
+    write_cstring(ob, (type == an_enum) ? "true" : "false");
+    write_literal(ob, ";\n"
+                      "};\n"
+                      "\n");
 
     clear_scratch_memory();
 }
 
-internal Void write_type_struct_all(OutputBuffer *ob, String name, Int member_count, StructData *structs, Int struct_count) {
+internal Void write_type_struct_all(OutputBuffer *ob, String name, Int name_id, Int member_count,
+                                    StructData **struct_index) {
     write_to_output_buffer(ob, "\n// struct %.*s\n", name.len, name.e);
 
     String base = {};
-    StructData *struct_data = find_struct(name, structs, struct_count);
+    StructData *struct_data = find_struct(name_id, struct_index);
     if(struct_data) {
         if(struct_data->inherited_count) {
             base = struct_data->inherited[0];
@@ -501,44 +643,56 @@ internal Void forward_declare_functions(OutputBuffer *ob, FunctionData *func_dat
                                    v->name.len, v->name.e);
 
             if(j < fd->param_cnt - 1) {
-                write_to_output_buffer(ob, ", ");
+                write_literal(ob, ", ");
             }
         }
 
-        write_to_output_buffer(ob, ");\n");
+        write_literal(ob, ");\n");
     }
 }
 
 internal Void write_meta_type_enum(OutputBuffer *ob, String *types, Int type_count) {
-    write_to_output_buffer(ob, "\n// Enum with field for every type detected.\n");
-    write_to_output_buffer(ob, "namespace pp { enum Type {\n");
+    write_literal(ob, "\n// Enum with field for every type detected.\n");
+    write_literal(ob, "namespace pp { enum Type {\n");
     for(Int i = 0; (i < type_count); ++i) {
         String *type = types + i;
 
         StdResult std_res = get_std_information(*type);
         switch(std_res.type) {
             case StdTypes_not: {
-                write_to_output_buffer(ob, "    Type_%.*s,\n", type->len, type->e);
+                write_literal(ob, "    Type_");
+                write_string(ob, *type);
+                write_literal(ob, ",\n");
             } break;
 
             case StdTypes_vector: {
-                write_to_output_buffer(ob, "    Type_std_vector_%.*s,\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "    Type_std_vector_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ",\n");
             } break;
 
             case StdTypes_deque: {
-                write_to_output_buffer(ob, "    Type_std_deque_%.*s,\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "    Type_std_deque_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ",\n");
             } break;
 
             case StdTypes_forward_list: {
-                write_to_output_buffer(ob, "    Type_std_forward_list_%.*s,\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "    Type_std_forward_list_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ",\n");
             } break;
 
             case StdTypes_list: {
-                write_to_output_buffer(ob, "    Type_std_list_%.*s,\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "    Type_std_list_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ",\n");
             } break;
 
             case StdTypes_string: {
-                write_to_output_buffer(ob, "    Type_std_string_%.*s,\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "    Type_std_string_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ",\n");
             } break;
 
             default: {
@@ -547,12 +701,12 @@ internal Void write_meta_type_enum(OutputBuffer *ob, String *types, Int type_cou
         }
     }
 
-    write_to_output_buffer(ob, "}; }\n");
+    write_literal(ob, "}; }\n");
 }
 
 internal Void write_meta_type_to_name(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob,
-                           "static char const * meta_type_to_name(Type mt, bool is_ptr) {\n");
+    write_literal(ob,
+                  "static char const * meta_type_to_name(Type mt, bool is_ptr) {\n");
     for(Int i = 0; (i < struct_count); ++i) {
         StructData *sd = struct_data + i;
 
@@ -577,177 +731,197 @@ internal Void write_meta_type_to_name(OutputBuffer *ob, StructData *struct_data,
         }
     }
 
-    write_to_output_buffer(ob,
-                           "\n"
-                           "\n"
-                           "    assert(0); \n"
-                           "    return(0); // Not found\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n"
+                  "\n"
+                  "    assert(0); \n"
+                  "    return(0); // Not found\n"
+                  "}\n");
 }
 
 internal void write_is_container(OutputBuffer *ob, String *types, Int type_count) {
-    write_to_output_buffer(ob, "static bool is_meta_type_container(int type) {\n");
+    write_literal(ob, "static bool is_meta_type_container(int type) {\n");
 
     for(Int i = 0; (i < type_count); ++i) {
         String *type = types + i;
 
-        if(!i) write_to_output_buffer(ob, "    ");
-        else   write_to_output_buffer(ob, "    else ");
+        if(!i) write_literal(ob, "    ");
+        else   write_literal(ob, "    else ");
 
         StdResult std_res = get_std_information(*type);
         switch(std_res.type) {
             case StdTypes_not: {
-                write_to_output_buffer(ob, "if(type == Type_%.*s) {return(false);} // false\n", type->len, type->e);
+                write_literal(ob, "if(type == Type_");
+                write_string(ob, *type);
+                write_literal(ob, ") {return(false);} // false\n");
             } break;
 
             case StdTypes_vector: {
-                write_to_output_buffer(ob, "if(type == Type_std_vector_%.*s) {return(true);} // true\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "if(type == Type_std_vector_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ") {return(true);} // true\n");
             } break;
 
             case StdTypes_deque: {
-                write_to_output_buffer(ob, "if(type == Type_std_deque_%.*s) {return(true);} // true\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "if(type == Type_std_deque_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ") {return(true);} // true\n");
             } break;
 
             case StdTypes_forward_list: {
-                write_to_output_buffer(ob, "if(type == Type_std_forward_list_%.*s) {return(true);} // true\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "if(type == Type_std_forward_list_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ") {return(true);} // true\n");
             } break;
 
             case StdTypes_list: {
-                write_to_output_buffer(ob, "if(type == Type_std_list_%.*s) {return(true);} // true\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "if(type == Type_std_list_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ") {return(true);} // true\n");
             } break;
 
             case StdTypes_string: {
-                write_to_output_buffer(ob, "if(type == Type_std_string_%.*s) {return(true);} // true\n", std_res.stored_type.len, std_res.stored_type.e);
+                write_literal(ob, "if(type == Type_std_string_");
+                write_string(ob, std_res.stored_type);
+                write_literal(ob, ") {return(true);} // true\n");
             } break;
 
             default: assert(0); break;
         }
     }
 
-    write_to_output_buffer(ob,
-                           "\n"
-                           "    // Should not be reached.\n"
-                           "    assert(0);\n"
-                           "    return(0);\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n"
+                  "    // Should not be reached.\n"
+                  "    assert(0);\n"
+                  "    return(0);\n"
+                  "}\n");
 }
 
-internal Void write_out_recreated_struct(OutputBuffer *ob, StructData struct_data) {
+internal Void write_out_recreated_struct(OutputBuffer *ob, StructData struct_data, MemberTable *members, SymbolTable *symbols) {
     write_to_output_buffer(ob, "%s _%.*s", (struct_data.struct_type != StructType_union) ? "struct" : "union",
                            struct_data.name.len, struct_data.name.e);
     if(struct_data.inherited) {
-        write_to_output_buffer(ob, " :");
+        write_literal(ob, " :");
 
         for(Int j = 0; (j < struct_data.inherited_count); ++j) {
             String *inherited = struct_data.inherited + j;
 
-            if(j > 0) write_to_output_buffer(ob, ",");
+            if(j > 0) write_literal(ob, ",");
 
-            write_to_output_buffer(ob, " public _%.*s", inherited->len, inherited->e);
+            write_literal(ob, " public _");
+            write_string(ob, *inherited);
         }
     }
-    write_to_output_buffer(ob, " { ");
+    write_literal(ob, " { ");
 
-    Bool is_inside_anonymous_struct = false;
+    // An anonymous union has to come out as a union, or the members after the first get their own space. So close
+    // the ones the last member was in that this one isn't, then open the ones which start at it.
+    Int depth = 0;
     for(Int j = 0; (j < struct_data.member_count); ++j) {
-        Variable *md = struct_data.members + j;
-
-        if(md->is_inside_anonymous_struct != is_inside_anonymous_struct) {
-            is_inside_anonymous_struct = !is_inside_anonymous_struct;
+        Variable md = get_member(members, symbols, struct_data.first_member + j);
 
-            if(is_inside_anonymous_struct) {
-                write_to_output_buffer(ob, " struct {");
-            } else {
-                write_to_output_buffer(ob, "};");
-            }
+        Int shared_depth = md.anonymous_depth - md.anonymous_opened;
+        for(; (depth > shared_depth); --depth) {
+            write_literal(ob, "};");
         }
-
-        Char const *arr = "";
-        Char arr_buffer[256] = {};
-        if(md->array_count > 1) {
-            stbsp_snprintf(arr_buffer, 256, "[%u]", md->array_count);
-            arr = arr_buffer;
+        for(; (depth < md.anonymous_depth); ++depth) {
+            if(md.anonymous_unions & (1 << depth)) { write_literal(ob, " union {");  }
+            else                                   { write_literal(ob, " struct {"); }
         }
 
         char ptr_buf[max_ptr_size] = {};
-        for(Int k = 0; (k < md->ptr); ++k) ptr_buf[k] = '*';
-
-        write_to_output_buffer(ob, " _%.*s %s%.*s%s; ",
-                               md->type.len, md->type.e,
-                               ptr_buf,
-                               md->name.len, md->name.e,
-                               (md->array_count > 1) ? arr_buffer : arr);
-
+        Int ptr_len = (md.ptr < max_ptr_size) ? md.ptr : max_ptr_size;
+        for(Int k = 0; (k < ptr_len); ++k) ptr_buf[k] = '*';
+
+        write_literal(ob, " _");
+        write_string(ob, md.type);
+        write_literal(ob, " ");
+        write_bytes(ob, ptr_buf, ptr_len);
+        write_string(ob, md.name);
+        if(md.array_count > 1) {
+            write_literal(ob, "[");
+            write_int(ob, md.array_count);
+            write_literal(ob, "]");
+        }
+        write_literal(ob, "; ");
     }
 
-    if(is_inside_anonymous_struct) write_to_output_buffer(ob, " };");
+    for(; (depth > 0); --depth) {
+        write_literal(ob, " };");
+    }
 
-    write_to_output_buffer(ob, " };\n");
+    write_literal(ob, " };\n");
 }
 
 internal Void write_out_recreated_enums(OutputBuffer *ob, EnumData *enum_data, Int enum_count) {
-    write_to_output_buffer(ob, "// Recreated Enums.\n");
+    write_literal(ob, "// Recreated Enums.\n");
     for(Int i = 0; (i < enum_count); ++i) {
         EnumData *ed = enum_data + i;
 
-        write_to_output_buffer(ob, "enum %s _%.*s",
-                               (ed->is_struct) ? "class" : "",
-                               ed->name.len, ed->name.e);
+        write_literal(ob, "enum ");
+        write_cstring(ob, (ed->is_struct) ? "class" : "");
+        write_literal(ob, " _");
+        write_string(ob, ed->name);
         if(ed->type.len) {
-            write_to_output_buffer(ob, " : %.*s",
-                                   ed->type.len, ed->type.e);
+            write_literal(ob, " : ");
+            write_string(ob, ed->type);
         }
-        write_to_output_buffer(ob, " { ");
+        write_literal(ob, " { ");
 
         for(Int j = 0; (j < ed->no_of_values); ++j) {
             EnumValue *v = ed->values + j;
 
-            write_to_output_buffer(ob, "%.*s = %d, ",
-                                   v->name.len, v->name.e,
-                                   v->value);
+            write_string(ob, v->name);
+            write_literal(ob, " = ");
+            write_int(ob, v->value);
+            write_literal(ob, ", ");
         }
 
-        write_to_output_buffer(ob, " };\n");
+        write_literal(ob, " };\n");
     }
 }
 
 
-internal Void write_out_recreated_structs(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob, "// Recreated structs.\n");
+internal Void write_out_recreated_structs(OutputBuffer *ob, StructData *struct_data, Int struct_count,
+                                          MemberTable *members, SymbolTable *symbols) {
+    write_literal(ob, "// Recreated structs.\n");
     for(Int i = 0; (i < struct_count); ++i) {
-        write_out_recreated_struct(ob, struct_data[i]);
+        write_out_recreated_struct(ob, struct_data[i], members, symbols);
     }
 }
 
 internal Void write_func(OutputBuffer *ob, StructData *sd, Int j, char const *access, Char const *modifier) {
-    write_to_output_buffer(ob,
-                           "template<> constexpr Access get_access_at_index<%.*s%s, %d>() { return(Access_%s); }\n",
-                           sd->name.len, sd->name.e, modifier,
-                           j,
-                           access);
+    write_literal(ob, "template<> constexpr Access get_access_at_index<");
+    write_string(ob, sd->name); write_cstring(ob, modifier);
+    write_literal(ob, ", ");
+    write_int(ob, j);
+    write_literal(ob, ">() { return(Access_");
+    write_cstring(ob, access);
+    write_literal(ob, "); }\n");
 }
 
-internal Void write_out_get_access(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob,
-                           "//\n"
-                           "// Get access at index.\n"
-                           "//\n"
-                           "template<typename T, int index> constexpr Access get_access_at_index() { return(Access_unknown); }\n"
-                           "\n");
+internal Void write_out_get_access(OutputBuffer *ob, StructData *struct_data, Int struct_count, MemberTable *members, SymbolTable *symbols) {
+    write_literal(ob,
+                  "//\n"
+                  "// Get access at index.\n"
+                  "//\n"
+                  "template<typename T, int index> constexpr Access get_access_at_index() { return(Access_unknown); }\n"
+                  "\n");
 
 
     for(Int i = 0; (i < struct_count); ++i) {
         StructData *sd = struct_data + i;
 
-        write_to_output_buffer(ob, "\n");
+        write_literal(ob, "\n");
 
         for(Int j = 0; (j < sd->member_count); ++j) {
-            Variable *md = sd->members + j;
+            Variable md = get_member(members, symbols, sd->first_member + j);
 
             Char const *access = 0;
-            if(md->access == Access_public)         { access = "public"; }
-            else if(md->access == Access_private)   { access = "private"; }
-            else if(md->access == Access_protected) { access = "protected"; }
+            if(md.access == Access_public)         { access = "public"; }
+            else if(md.access == Access_private)   { access = "private"; }
+            else if(md.access == Access_protected) { access = "protected"; }
             else                                    { assert(0); /* Error, could not determine access. */ }
 
             write_func(ob, sd, j, access, "");
@@ -762,52 +936,61 @@ internal Void write_out_get_access(OutputBuffer *ob, StructData *struct_data, In
 
 internal Void write_get_member(OutputBuffer *ob, StructData *sd, Variable *md, Int j, Char const *ref_info) {
     Char ptr_buf[max_ptr_size] = {};
-    for(Int k = 0; (k < md->ptr); ++k) ptr_buf[k] = '*';
-
-
-    write_to_output_buffer(ob,
-                           "template<> struct GetMember<%.*s%s, %d> {\n"
-                           "    static %.*s%s *get(%.*s *ptr) {\n"
-                           "        _%.*s *cpy = (_%.*s *)ptr;\n"
-                           "        %.*s%s * res = (%.*s%s *)&cpy->%.*s;\n"
-                           "        return(res);\n"
-                           "    };\n"
-                           "};\n",
-                           sd->name.len, sd->name.e, ref_info,
-                           j,
-                           md->type.len, md->type.e, ptr_buf,
-                           sd->name.len, sd->name.e,
-                           sd->name.len, sd->name.e,
-                           sd->name.len, sd->name.e,
-                           md->type.len, md->type.e, ptr_buf,
-                           md->type.len, md->type.e, ptr_buf,
-                           md->name.len, md->name.e);
+    Int ptr_len = (md->ptr < max_ptr_size) ? md->ptr : max_ptr_size;
+    for(Int k = 0; (k < ptr_len); ++k) ptr_buf[k] = '*';
+
+    write_literal(ob, "template<> struct GetMember<");
+    write_string(ob, sd->name); write_cstring(ob, ref_info);
+    write_literal(ob, ", ");
+    write_int(ob, j);
+    write_literal(ob, "> {\n"
+                      "    static ");
+    write_string(ob, md->type); write_bytes(ob, ptr_buf, ptr_len);
+    write_literal(ob, " *get(");
+    write_string(ob, sd->name);
+    write_literal(ob, " *ptr) {\n"
+                      "        _");
+    write_string(ob, sd->name);
+    write_literal(ob, " *cpy = (_");
+    write_string(ob, sd->name);
+    write_literal(ob, " *)ptr;\n"
+                      "        ");
+    write_string(ob, md->type); write_bytes(ob, ptr_buf, ptr_len);
+    write_literal(ob, " * res = (");
+    write_string(ob, md->type); write_bytes(ob, ptr_buf, ptr_len);
+    write_literal(ob, " *)&cpy->");
+    write_string(ob, md->name);
+    write_literal(ob, ";\n"
+                      "        return(res);\n"
+                      "    };\n"
+                      "};\n");
 }
 
-internal Void write_out_get_at_index(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
+internal Void write_out_get_at_index(OutputBuffer *ob, StructData *struct_data, Int struct_count, MemberTable *members, SymbolTable *symbols) {
 
-    write_to_output_buffer(ob,
-                           "// Get at index.\n"
-                           "#define get_member(variable, index) GetMember<decltype(variable), index>::get(variable)\n"
-                           "template<typename T, int index> struct GetMember { };\n");
+    write_literal(ob,
+                  "// Get at index.\n"
+                  "#define get_member(variable, index) GetMember<decltype(variable), index>::get(variable)\n"
+                  "template<typename T, int index> struct GetMember { };\n");
 
     for(Int i = 0; (i < struct_count); ++i) {
         StructData *sd = struct_data + i;
-        write_to_output_buffer(ob, "\n");
+        write_literal(ob, "\n");
 
         for(Int j = 0; (j < sd->member_count); ++j) {
-            Variable *md = sd->members + j;
+            Variable md = get_member(members, symbols, sd->first_member + j);
 
             // Because get_member _requires_ a pointer, only generate code for the pointer version.
-            write_get_member(ob, sd, md, j, " *");
-            write_get_member(ob, sd, md, j, " *&");
+            write_get_member(ob, sd, &md, j, " *");
+            write_get_member(ob, sd, &md, j, " *&");
         }
     }
 }
 
-internal Void write_out_get_name_at_index(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob,
-                           "template<typename T>static char const * get_member_name(int index){return(0);}\n");
+internal Void write_out_get_name_at_index(OutputBuffer *ob, StructData *struct_data, Int struct_count,
+                                          MemberTable *members, SymbolTable *symbols) {
+    write_literal(ob,
+                  "template<typename T>static char const * get_member_name(int index){return(0);}\n");
     for(Int i = 0; (i < struct_count); ++i) {
         StructData *sd = struct_data + i;
 
@@ -818,33 +1001,34 @@ internal Void write_out_get_name_at_index(OutputBuffer *ob, StructData *struct_d
                                    sd->name.len, sd->name.e);
 
             for(Int j = 0; (j < sd->member_count); ++j) {
-                Variable *md = sd->members + j;
+                Variable md = get_member(members, symbols, sd->first_member + j);
 
-                write_to_output_buffer(ob,
-                                       "        case %d: { return(\"%.*s\"); } break;\n",
-                                       j,
-                                       md->name.len, md->name.e);
+                write_literal(ob, "        case ");
+                write_int(ob, j);
+                write_literal(ob, ": { return(\"");
+                write_string(ob, md.name);
+                write_literal(ob, "\"); } break;\n");
             }
 
-            write_to_output_buffer(ob,
-                                   "    }\n"
-                                   "    return(0); // Not found.\n"
-                                   "}\n");
+            write_literal(ob,
+                          "    }\n"
+                          "    return(0); // Not found.\n"
+                          "}\n");
         }
     }
 
 }
 
 internal Void write_sizeof_from_str(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob,
-                           "static size_t get_size_from_str(char const *str) {\n");
-    write_to_output_buffer(ob, "\n");
+    write_literal(ob,
+                  "static size_t get_size_from_str(char const *str) {\n");
+    write_literal(ob, "\n");
 
     for(Int i = 0; (i < struct_count); ++i) {
         StructData *sd = struct_data + i;
 
-        if(!i) { write_to_output_buffer(ob, "    ");      }
-        else   { write_to_output_buffer(ob, "    else "); }
+        if(!i) { write_literal(ob, "    ");      }
+        else   { write_literal(ob, "    else "); }
 
         write_to_output_buffer(ob,
                                "if((strcmp(str, \"%.*s\") == 0) || (strcmp(str, \"%.*s *\") == 0) || (strcmp(str, \"%.*s **\") == 0)) {return(sizeof(_%.*s));}\n",
@@ -854,101 +1038,71 @@ internal Void write_sizeof_from_str(OutputBuffer *ob, StructData *struct_data, I
                                sd->name.len, sd->name.e);
     }
 
-    write_to_output_buffer(ob,
-                           "\n"
-                           "    return(0); // Not found.\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n"
+                  "    return(0); // Not found.\n"
+                  "}\n");
 }
 
 internal Void write_out_type_specification_struct(OutputBuffer *ob, StructData *struct_data, Int struct_count,
-                                                  EnumData *enum_data, Int enum_count) {
-    PtrSize size = 128;
-    String *written_members = system_alloc(String, size);
-    Int member_cnt = 0;
-
-    for(Int i = 0; (i < enum_count); ++i) {
-        EnumData *ed = enum_data + i;
+                                                  EnumData *enum_data, Int enum_count, MemberTable *members,
+                                                  SymbolTable *symbols, StructData **struct_index, MemoryArena *arena) {
+    // Indexed by symbol ID.
+    Bool *written = push_arena(arena, Bool, symbols->cnt + 1);
+    if(written) {
+        for(Int i = 0; (i < enum_count); ++i) {
+            EnumData *ed = enum_data + i;
 
-        if(member_cnt >= size) {
-            size *= 2;
-            void *ptr = system_realloc(written_members, sizeof(String) * size);
-            if(ptr) {
-                written_members = cast(String *)ptr;
-            }
+            written[ed->name_id] = true;
         }
 
-        written_members[member_cnt++] = ed->name;
-    }
+        write_literal(ob,
+                      "//\n"
+                      "// Meta type specialization\n"
+                      "//\n");
 
-    write_to_output_buffer(ob,
-                           "//\n"
-                           "// Meta type specialization\n"
-                           "//\n");
-
-    write_type_struct_all(ob, create_string("void"), 0, struct_data, struct_count);
-
-    String primatives[array_count(primitive_types)] = {};
-    set_primitive_type(primatives);
-
-    for(Int i = 0; (i < array_count(primatives)); ++i) {
-        if(!is_in_string_array(primatives[i], written_members, member_cnt)) {
-            if(member_cnt >= size) {
-                size *= 2;
-                void *ptr = system_realloc(written_members, sizeof(String) * size);
-                if(ptr) {
-                    written_members = cast(String *)ptr;
-                }
-            }
+        write_type_struct_all(ob, create_string("void"), 0, 0, struct_index);
+
+        String primatives[array_count(primitive_types)] = {};
+        set_primitive_type(primatives);
 
-            written_members[member_cnt++] = primatives[i];
+        for(Int i = 0; (i < array_count(primatives)); ++i) {
+            Int id = find_symbol(symbols, primatives[i]);
+            if(!written[id]) {
+                written[id] = true;
 
-            write_type_struct_all(ob, primatives[i], 0, struct_data, struct_count);
+                write_type_struct_all(ob, primatives[i], id, 0, struct_index);
+            }
         }
-    }
 
-    for(Int i = 0; (i < struct_count); ++i) {
-        StructData *sd = struct_data + i;
+        for(Int i = 0; (i < struct_count); ++i) {
+            StructData *sd = struct_data + i;
 
-        if(!is_in_string_array(sd->name, written_members, member_cnt)) {
-            if(member_cnt >= size) {
-                size *= 2;
-                void *ptr = system_realloc(written_members, sizeof(String) * size);
-                if(ptr) {
-                    written_members = cast(String *)ptr;
-                }
-            }
+            if(!written[sd->name_id]) {
+                written[sd->name_id] = true;
+
+                write_type_struct_all(ob, sd->name, sd->name_id, sd->member_count, struct_index);
 
-            written_members[member_cnt++] = sd->name;
+                Int *type_ids = members->type_id + sd->first_member;
+                for(Int j = 0; (j < sd->member_count); ++j) {
+                    Int type_id = type_ids[j];
 
-            write_type_struct_all(ob, sd->name, sd->member_count, struct_data, struct_count);
+                    if(!written[type_id]) {
+                        written[type_id] = true;
 
-            for(Int j = 0; (j < sd->member_count); ++j) {
-                Variable *md = sd->members + j;
-
-                if(!is_in_string_array(md->type, written_members, member_cnt)) {
-                    if(member_cnt >= size) {
-                        size *= 2;
-                        void *ptr = system_realloc(written_members, sizeof(String) * size);
-                        if(ptr) {
-                            written_members = cast(String *)ptr;
+                        Int number_of_members = 0;
+                        StructData *members_struct_data = find_struct(type_id, struct_index);
+                        if(members_struct_data) {
+                            number_of_members = members_struct_data->member_count;
                         }
-                    }
 
-                    written_members[member_cnt++] = md->type;
-
-                    Int number_of_members = 0;
-                    StructData *members_struct_data = find_struct(md->type, struct_data, struct_count);
-                    if(members_struct_data) {
-                        number_of_members = members_struct_data->member_count;
+                        write_type_struct_all(ob, symbols->symbols[type_id].str, type_id, number_of_members,
+                                              struct_index);
                     }
-
-                    write_type_struct_all(ob, md->type, number_of_members, struct_data, struct_count);
                 }
             }
         }
     }
-
-    system_free(written_members);
 }
 
 internal Void write_out_type_specification_enum(OutputBuffer *ob, EnumData *enum_data, Int enum_count) {
@@ -973,12 +1127,13 @@ internal Void write_out_type_specification_enum(OutputBuffer *ob, EnumData *enum
     }
 }
 
-internal Void write_get_members_of(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
+internal Void write_get_members_of(OutputBuffer *ob, StructData *struct_data, Int struct_count,
+                                   StructData **struct_index, MemberTable *members, SymbolTable *symbols) {
     // Get Members of.
-    write_to_output_buffer(ob,
-                           "\n"
-                           "// Convert a type into a members of pointer.\n"
-                           "template<typename T> static MemberDefinition *get_members_of_(void) {\n");
+    write_literal(ob,
+                  "\n"
+                  "// Convert a type into a members of pointer.\n"
+                  "template<typename T> static MemberDefinition *get_members_of_(void) {\n");
 
     if(struct_count) {
         Bool actually_written_anything = false;
@@ -1004,34 +1159,42 @@ internal Void write_get_members_of(OutputBuffer *ob, StructData *struct_data, In
                 }
                 ++written_cnt;
 
-                write_to_output_buffer(ob, "        static MemberDefinition members_of_%.*s[] = {\n", sd->name.len, sd->name.e);
+                write_literal(ob, "        static MemberDefinition members_of_");
+                write_string(ob, sd->name);
+                write_literal(ob, "[] = {\n");
                 for(Int j = 0; (j < sd->member_count); ++j) {
-                    Variable *md = sd->members + j;
+                    Variable md = get_member(members, symbols, sd->first_member + j);
 
-                    StdResult std_res = get_std_information(md->type);
+                    StdResult std_res = get_std_information(md.type);
                     switch(std_res.type) {
                         case StdTypes_not: {
-                            write_to_output_buffer(ob, "            {Type_%.*s", md->type.len, md->type.e);
+                            write_literal(ob, "            {Type_");
+                            write_string(ob, md.type);
                         } break;
 
                         case StdTypes_vector: {
-                            write_to_output_buffer(ob, "            {Type_std_vector_%.*s", std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_vector_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_deque: {
-                            write_to_output_buffer(ob, "            {Type_std_deque_%.*s", std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_deque_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_forward_list: {
-                            write_to_output_buffer(ob, "            {Type_std_forward_list_%.*s", std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_forward_list_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_list: {
-                            write_to_output_buffer(ob, "            {Type_std_list_%.*s", std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_list_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_string: {
-                            write_to_output_buffer(ob, "            {Type_std_string_%.*s", std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_string_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         default: {
@@ -1039,59 +1202,59 @@ internal Void write_get_members_of(OutputBuffer *ob, StructData *struct_data, In
                         } break;
                     }
 
-                    write_to_output_buffer(ob, ", \"%.*s\", offset_of(&_%.*s::%.*s), %d, %d},\n",
-                                           md->name.len, md->name.e,
-                                           sd->name.len, sd->name.e,
-                                           md->name.len, md->name.e,
-                                           md->ptr,
-                                           md->array_count);
+                    write_literal(ob, ", \"");
+                    write_string(ob, md.name);
+                    write_literal(ob, "\", offset_of(&_");
+                    write_string(ob, sd->name);
+                    write_literal(ob, "::");
+                    write_string(ob, md.name);
+                    write_literal(ob, "), ");
+                    write_int(ob, md.ptr);
+                    write_literal(ob, ", ");
+                    write_int(ob, md.array_count);
+                    write_literal(ob, "},\n");
                 }
 
                 if(sd->inherited) {
                     for(Int j = 0; (j < sd->inherited_count); ++j) {
-                        StructData *base_class = find_struct(sd->inherited[j], struct_data, struct_count);
+                        StructData *base_class = find_base_class(sd, j, struct_index);
                         if(base_class) {
-                            write_to_output_buffer(ob, "            // Members inherited from %.*s.\n",
-                                                   base_class->name.len, base_class->name.e);
+                            write_literal(ob, "            // Members inherited from ");
+                            write_string(ob, base_class->name);
+                            write_literal(ob, ".\n");
                             for(Int k = 0; (k < base_class->member_count); ++k) {
-                                Variable *base_class_var = base_class->members + k;
+                                Variable base_class_var = get_member(members, symbols, base_class->first_member + k);
 
-                                StdResult std_res = get_std_information(base_class_var->type);
+                                StdResult std_res = get_std_information(base_class_var.type);
                                 switch(std_res.type) {
                                     case StdTypes_not: {
-                                        write_to_output_buffer(ob,
-                                                               "            {Type_%.*s",
-                                                               base_class_var->type.len, base_class_var->type.e);
+                                        write_literal(ob, "            {Type_");
+                                        write_string(ob, base_class_var.type);
                                     } break;
 
                                     case StdTypes_vector: {
-                                        write_to_output_buffer(ob,
-                                                               "            {Type_std_vector_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_vector_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_deque: {
-                                        write_to_output_buffer(ob,
-                                                               "            {Type_std_deque_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_deque_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_forward_list: {
-                                        write_to_output_buffer(ob,
-                                                               "            {Type_std_forward_list_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_forward_list_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_list: {
-                                        write_to_output_buffer(ob,
-                                                               "            {Type_std_list_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_list_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_string: {
-                                        write_to_output_buffer(ob,
-                                                               "            {Type_std_string_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_string_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     default: {
@@ -1099,12 +1262,17 @@ internal Void write_get_members_of(OutputBuffer *ob, StructData *struct_data, In
                                     } break;
                                 }
 
-                                write_to_output_buffer(ob, ", \"%.*s\", (size_t)&((_%.*s *)0)->%.*s, %d, %d},\n",
-                                                       base_class_var->name.len, base_class_var->name.e,
-                                                       sd->name.len, sd->name.e,
-                                                       base_class_var->name.len, base_class_var->name.e,
-                                                       base_class_var->ptr,
-                                                       base_class_var->array_count);
+                                write_literal(ob, ", \"");
+                                write_string(ob, base_class_var.name);
+                                write_literal(ob, "\", (size_t)&((_");
+                                write_string(ob, sd->name);
+                                write_literal(ob, " *)0)->");
+                                write_string(ob, base_class_var.name);
+                                write_literal(ob, ", ");
+                                write_int(ob, base_class_var.ptr);
+                                write_literal(ob, ", ");
+                                write_int(ob, base_class_var.array_count);
+                                write_literal(ob, "},\n");
                             }
                         }
                     }
@@ -1118,22 +1286,23 @@ internal Void write_get_members_of(OutputBuffer *ob, StructData *struct_data, In
         }
 
         if(actually_written_anything) {
-            write_to_output_buffer(ob, "    }\n");
+            write_literal(ob, "    }\n");
         }
     }
 
-    write_to_output_buffer(ob,
-                           "\n"
-                           "    return(0); // Error.\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n"
+                  "    return(0); // Error.\n"
+                  "}\n");
 
 }
 
-internal Void write_get_members_of_str(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob,
-                           "\n"
-                           "// Convert a type into a members of pointer.\n"
-                           "static MemberDefinition *get_members_of_str(char const *str) {\n");
+internal Void write_get_members_of_str(OutputBuffer *ob, StructData *struct_data, Int struct_count,
+                                       StructData **struct_index, MemberTable *members, SymbolTable *symbols) {
+    write_literal(ob,
+                  "\n"
+                  "// Convert a type into a members of pointer.\n"
+                  "static MemberDefinition *get_members_of_str(char const *str) {\n");
 
     String prim[array_count(primitive_types)] = {};
     set_primitive_type(prim);
@@ -1219,7 +1388,7 @@ internal Void write_get_members_of_str(OutputBuffer *ob, StructData *struct_data
             Bool any_members = (sd->member_count > 0);
             if(!any_members) {
                 for(Int j = 0; (j < sd->inherited_count); ++j) {
-                    StructData *base_class = find_struct(sd->inherited[j], struct_data, struct_count);
+                    StructData *base_class = find_base_class(sd, j, struct_index);
                     if((base_class) && (base_class->member_count)) {
                         any_members = true;
                         break;
@@ -1237,40 +1406,42 @@ internal Void write_get_members_of_str(OutputBuffer *ob, StructData *struct_data
                                        sd->name.len, sd->name.e,
                                        sd->name.len, sd->name.e);
 
-                write_to_output_buffer(ob, "        static MemberDefinition members_of_%.*s[] = {\n", sd->name.len, sd->name.e);
+                write_literal(ob, "        static MemberDefinition members_of_");
+                write_string(ob, sd->name);
+                write_literal(ob, "[] = {\n");
                 for(Int j = 0; (j < sd->member_count); ++j) {
-                    Variable *md = sd->members + j;
+                    Variable md = get_member(members, symbols, sd->first_member + j);
 
-                    StdResult std_res = get_std_information(md->type);
+                    StdResult std_res = get_std_information(md.type);
                     switch(std_res.type) {
                         case StdTypes_not: {
-                            write_to_output_buffer(ob, "            {Type_%.*s",
-                                                   md->type.len, md->type.e);
+                            write_literal(ob, "            {Type_");
+                            write_string(ob, md.type);
                         } break;
 
                         case StdTypes_vector: {
-                            write_to_output_buffer(ob, "            {Type_std_vector_%.*s",
-                                                   std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_vector_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_deque: {
-                            write_to_output_buffer(ob, "            {Type_std_deque_%.*s",
-                                                   std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_deque_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_forward_list: {
-                            write_to_output_buffer(ob, "            {Type_std_forward_list_%.*s",
-                                                   std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_forward_list_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_list: {
-                            write_to_output_buffer(ob, "            {Type_std_list_%.*s",
-                                                   std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_list_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         case StdTypes_string: {
-                            write_to_output_buffer(ob, "            {Type_std_string_%.*s",
-                                                   std_res.stored_type.len, std_res.stored_type.e);
+                            write_literal(ob, "            {Type_std_string_");
+                            write_string(ob, std_res.stored_type);
                         } break;
 
                         default: {
@@ -1278,63 +1449,74 @@ internal Void write_get_members_of_str(OutputBuffer *ob, StructData *struct_data
                         } break;
                     }
 
-                    write_to_output_buffer(ob, ", \"%.*s\", offset_of(&_%.*s::%.*s), %d, %d},\n",
-                                           md->name.len, md->name.e,
-                                           sd->name.len, sd->name.e,
-                                           md->name.len, md->name.e,
-                                           md->ptr,
-                                           md->array_count);
+                    write_literal(ob, ", \"");
+                    write_string(ob, md.name);
+                    write_literal(ob, "\", offset_of(&_");
+                    write_string(ob, sd->name);
+                    write_literal(ob, "::");
+                    write_string(ob, md.name);
+                    write_literal(ob, "), ");
+                    write_int(ob, md.ptr);
+                    write_literal(ob, ", ");
+                    write_int(ob, md.array_count);
+                    write_literal(ob, "},\n");
                 }
 
                 if(sd->inherited) {
                     for(Int j = 0; (j < sd->inherited_count); ++j) {
-                        StructData *base_class = find_struct(sd->inherited[j], struct_data, struct_count);
+                        StructData *base_class = find_base_class(sd, j, struct_index);
                         if(base_class) {
-                            write_to_output_buffer(ob, "            // Members inherited from %.*s.\n",
-                                                   base_class->name.len, base_class->name.e);
+                            write_literal(ob, "            // Members inherited from ");
+                            write_string(ob, base_class->name);
+                            write_literal(ob, ".\n");
                             for(Int k = 0; (k < base_class->member_count); ++k) {
-                                Variable *base_class_var = base_class->members + k;
+                                Variable base_class_var = get_member(members, symbols, base_class->first_member + k);
 
-                                StdResult std_res = get_std_information(base_class_var->type);
+                                StdResult std_res = get_std_information(base_class_var.type);
                                 switch(std_res.type) {
                                     case StdTypes_not: {
-                                        write_to_output_buffer(ob, "            {Type_%.*s",
-                                                               base_class_var->type.len, base_class_var->type.e);
+                                        write_literal(ob, "            {Type_");
+                                        write_string(ob, base_class_var.type);
                                     } break;
 
                                     case StdTypes_vector: {
-                                        write_to_output_buffer(ob, "            {Type_std_vector_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_vector_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_deque: {
-                                        write_to_output_buffer(ob, "            {Type_std_deque_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_deque_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_forward_list: {
-                                        write_to_output_buffer(ob, "            {Type_std_forward_list_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_forward_list_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_list: {
-                                        write_to_output_buffer(ob, "            {Type_std_list_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_list_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
 
                                     case StdTypes_string: {
-                                        write_to_output_buffer(ob, "            {Type_std_string_%.*s",
-                                                               std_res.stored_type.len, std_res.stored_type.e);
+                                        write_literal(ob, "            {Type_std_string_");
+                                        write_string(ob, std_res.stored_type);
                                     } break;
                                 }
 
 
-                                write_to_output_buffer(ob, ", \"%.*s\", (size_t)&((_%.*s *)0)->%.*s, %d, %d},\n",
-                                                       base_class_var->name.len, base_class_var->name.e,
-                                                       sd->name.len, sd->name.e,
-                                                       base_class_var->name.len, base_class_var->name.e,
-                                                       base_class_var->ptr,
-                                                       base_class_var->array_count);
+                                write_literal(ob, ", \"");
+                                write_string(ob, base_class_var.name);
+                                write_literal(ob, "\", (size_t)&((_");
+                                write_string(ob, sd->name);
+                                write_literal(ob, " *)0)->");
+                                write_string(ob, base_class_var.name);
+                                write_literal(ob, ", ");
+                                write_int(ob, base_class_var.ptr);
+                                write_literal(ob, ", ");
+                                write_int(ob, base_class_var.array_count);
+                                write_literal(ob, "},\n");
                             }
                         }
                     }
@@ -1347,19 +1529,20 @@ internal Void write_get_members_of_str(OutputBuffer *ob, StructData *struct_data
             }
         }
     }
-    write_to_output_buffer(ob, "    }\n");
+    write_literal(ob, "    }\n");
 
-    write_to_output_buffer(ob,
-                           "\n"
-                           "    return(0); // Error.\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n"
+                  "    return(0); // Error.\n"
+                  "}\n");
 }
 
-internal Void write_get_number_of_members_str(OutputBuffer *ob, StructData *struct_data, Int struct_count) {
-    write_to_output_buffer(ob,
-                           "\n"
-                           "// Get the number of members for a type.\n"
-                           "static int get_number_of_members_str(char const *str) {\n");
+internal Void write_get_number_of_members_str(OutputBuffer *ob, StructData *struct_data, Int struct_count,
+                                              StructData **struct_index) {
+    write_literal(ob,
+                  "\n"
+                  "// Get the number of members for a type.\n"
+                  "static int get_number_of_members_str(char const *str) {\n");
 
     String prim[array_count(primitive_types)] = {};
     set_primitive_type(prim);
@@ -1368,9 +1551,9 @@ internal Void write_get_number_of_members_str(OutputBuffer *ob, StructData *stru
         String *p = prim + i;
 
         if(!i) {
-            write_to_output_buffer(ob, "    ");
+            write_literal(ob, "    ");
         } else {
-            write_to_output_buffer(ob, "    else ");
+            write_literal(ob, "    else ");
         }
 
         write_to_output_buffer(ob,
@@ -1387,7 +1570,7 @@ internal Void write_get_number_of_members_str(OutputBuffer *ob, StructData *stru
 
         // Add inherited struct members onto the member count.
         for(Int j = 0; (j < sd->inherited_count); ++j) {
-            StructData *base_class = find_struct(sd->inherited[j], struct_data, struct_count);
+            StructData *base_class = find_base_class(sd, j, struct_index);
 
             if(base_class) member_count += base_class->member_count;
         }
@@ -1400,9 +1583,9 @@ internal Void write_get_number_of_members_str(OutputBuffer *ob, StructData *stru
                                member_count);
     }
 
-    write_to_output_buffer(ob,
-                           "\n    return(-1); // Error.\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n    return(-1); // Error.\n"
+                  "}\n");
 }
 
 internal Void write_enum_to_string(OutputBuffer *ob, EnumData enum_data) {
@@ -1423,11 +1606,11 @@ internal Void write_enum_to_string(OutputBuffer *ob, EnumData enum_data) {
                                v->name.len, v->name.e);
     }
 
-    write_to_output_buffer(ob,
-                           "\n"
-                           "        default: { return(0); } break;\n"
-                           "    }\n"
-                           "}\n");
+    write_literal(ob,
+                  "\n"
+                  "        default: { return(0); } break;\n"
+                  "    }\n"
+                  "}\n");
 }
 
 internal void write_string_to_enum(OutputBuffer *ob, EnumData enum_data) {
@@ -1472,126 +1655,296 @@ internal void write_string_to_enum(OutputBuffer *ob, EnumData enum_data) {
                            enum_data.name.len, enum_data.name.e);
 }
 
-File write_data(Char const *fname, StructData *struct_data, Int struct_count, EnumData *enum_data, Int enum_count,
-                FunctionData *func_data, Int func_count) {
-    File res = {};
+//
+// Sections.
+//
+// Everything after the forward declarations only reads the parse results, so for a big file each section is written
+// into its own buffer on the thread pool, and the buffers are joined back together in order.
+enum Section {
+    Section_header,
+    Section_meta_type_enum,
+    Section_recreated_enums,
+    Section_recreated_structs,
+    Section_type_specification_struct,
+    Section_type_specification_enum,
+    Section_get_at_index,
+    Section_get_name_at_index,
+    Section_is_container,
+    Section_meta_type_to_name,
+    Section_sizeof_from_str,
+    Section_serialize_struct_implementation,
+    Section_get_access,
+    Section_get_members_of,
+    Section_get_members_of_str,
+    Section_get_number_of_members_str,
+    Section_enum_introspection,
+    Section_footer,
+
+    Section_count,
+};
+
+// For --trace.
+internal Char const *section_names[Section_count] = {
+    "write_header",
+    "write_meta_type_enum",
+    "write_out_recreated_enums",
+    "write_out_recreated_structs",
+    "write_out_type_specification_struct",
+    "write_out_type_specification_enum",
+    "write_out_get_at_index",
+    "write_out_get_name_at_index",
+    "write_is_container",
+    "write_meta_type_to_name",
+    "write_sizeof_from_str",
+    "write_serialize_struct_implementation",
+    "write_out_get_access",
+    "write_get_members_of",
+    "write_get_members_of_str",
+    "write_get_number_of_members_str",
+    "write_enum_introspection",
+    "write_footer",
+};
 
-    OutputBuffer ob = {};
-    ob.size = 1024 * 1024;
-    ob.buffer = system_alloc(Char, ob.size);
-    if(ob.buffer) {
-        Char *name_buf = cast(Char *)push_scratch_memory();
-        Char const *extension = system_get_file_extension(fname);
-        Int extension_len = string_length(extension);
-        Int len_wo_extension = string_length(fname) - extension_len;
-
-        for(Int i = 0; (i < len_wo_extension); ++i) {
-            name_buf[i] = to_caps(fname[i]);
+struct WriteDataInput {
+    Char const *fname;
+    StructData *struct_data;
+    Int struct_count;
+    EnumData *enum_data;
+    Int enum_count;
+    FunctionData *func_data;
+    Int func_count;
+
+    MemberTable *members;
+    SymbolTable *symbols;
+    StructData **struct_index; // Indexed by symbol ID.
+
+    String *types;
+    Int type_count;
+};
+
+internal Void write_header(OutputBuffer *ob, Char const *fname) {
+    Char *name_buf = cast(Char *)push_scratch_memory();
+    Char const *extension = system_get_file_extension(fname);
+    Int extension_len = string_length(extension);
+    Int len_wo_extension = string_length(fname) - extension_len;
+
+    for(Int i = 0; (i < len_wo_extension); ++i) {
+        name_buf[i] = to_caps(fname[i]);
+    }
+
+    write_to_output_buffer(ob,
+                           "#if !defined(%s_GENERATED_H)\n"
+                           "#define %s_GENERATED_H\n"
+                           "\n",
+                           name_buf, name_buf);
+
+    clear_scratch_memory();
+}
+
+internal Void write_enum_introspection(OutputBuffer *ob, EnumData *enum_data, Int enum_count) {
+    write_literal(ob,
+                  "\n"
+                  "//\n"
+                  "// Enum Introspection data.\n"
+                  "//\n"
+                  "\n"
+                  "// Stub functions.\n"
+                  "template<typename T>static constexpr char const *enum_to_string(T element) { return(0); }\n"
+                  "template<typename T>static constexpr T string_to_enum(char const *str) { return(0); }\n"
+                  "\n");
+    for(Int i = 0; (i < enum_count); ++i) {
+        if(enum_data[i].type.len) {
+            write_to_output_buffer(ob,
+                                   "// %.*s.\n",
+                                   enum_data[i].name.len, enum_data[i].name.e);
+            write_enum_to_string(ob, enum_data[i]);
+            write_string_to_enum(ob, enum_data[i]);
         }
+    }
 
-        write_to_output_buffer(&ob,
-                               "#if !defined(%s_GENERATED_H)\n"
-                               "#define %s_GENERATED_H\n"
-                               "\n",
-                               name_buf, name_buf);
+    write_literal(ob, "\n");
+}
 
-        clear_scratch_memory();
+internal Void write_section(OutputBuffer *ob, WriteDataInput *in, Section section) {
+    StructData *struct_data = in->struct_data;
+    Int struct_count = in->struct_count;
+    EnumData *enum_data = in->enum_data;
+    Int enum_count = in->enum_count;
+    MemberTable *members = in->members;
+    SymbolTable *symbols = in->symbols;
+
+    // Most of the sections need the list of types, so they're skipped if there wasn't room for it.
+    Bool has_types = (in->types != 0);
+
+    trace_begin(section_names[section]);
+
+    switch(section) {
+        case Section_header: {
+            write_header(ob, in->fname);
+
+            // Forward declare structs.
+            write_literal(ob, "// Forward declared structs, enums, and function (these must be declared outside the namespace...)\n");
+            forward_declare_structs(ob, struct_data, struct_count);
+            forward_declare_enums(ob, enum_data, enum_count);
+            forward_declare_functions(ob, in->func_data, in->func_count);
+
+            write_literal(ob,
+                          "\n"
+                          "// This is nessessary due to the way the generated code is outputted. Is #undef'd at the bottom of this file.\n"
+                          "#define _std std\n"
+                          "\n");
+        } break;
+
+        case Section_meta_type_enum: {
+            if(has_types) {
+                write_meta_type_enum(ob, in->types, in->type_count);
+
+                write_literal(ob, "\n");
+                write_literal(ob,
+                              "#include \"static_generated.h\"\n"
+                              "namespace pp { // PreProcessor\n");
+                write_literal(ob, "\n");
+            }
+        } break;
+
+        case Section_recreated_enums:   { if(has_types) write_out_recreated_enums(ob, enum_data, enum_count);       } break;
+        case Section_recreated_structs: { if(has_types) write_out_recreated_structs(ob, struct_data, struct_count, members, symbols); } break;
+
+        case Section_type_specification_struct: {
+            if(has_types) write_out_type_specification_struct(ob, struct_data, struct_count, enum_data, enum_count, members, symbols,
+                                                              in->struct_index, ob->arena);
+        } break;
+
+        case Section_type_specification_enum:  { if(has_types) write_out_type_specification_enum(ob, enum_data, enum_count);     } break;
+        case Section_get_at_index:             { if(has_types) write_out_get_at_index(ob, struct_data, struct_count, members, symbols);            } break;
+        case Section_get_name_at_index:        { if(has_types) write_out_get_name_at_index(ob, struct_data, struct_count, members, symbols);       } break;
+        case Section_is_container:             { if(has_types) write_is_container(ob, in->types, in->type_count);                 } break;
+        case Section_meta_type_to_name:        { if(has_types) write_meta_type_to_name(ob, struct_data, struct_count);           } break;
+        case Section_sizeof_from_str:          { if(has_types) write_sizeof_from_str(ob, struct_data, struct_count);             } break;
+        case Section_get_access:               { if(has_types) write_out_get_access(ob, struct_data, struct_count, members, symbols);              } break;
+
+        case Section_serialize_struct_implementation: {
+            if(has_types) write_serialize_struct_implementation(ob, in->types, in->type_count);
+        } break;
+
+        case Section_get_members_of:            { write_get_members_of(ob, struct_data, struct_count, in->struct_index, members, symbols);            } break;
+        case Section_get_members_of_str:        { write_get_members_of_str(ob, struct_data, struct_count, in->struct_index, members, symbols);        } break;
+        case Section_get_number_of_members_str: { write_get_number_of_members_str(ob, struct_data, struct_count, in->struct_index); } break;
+        case Section_enum_introspection:        { write_enum_introspection(ob, enum_data, enum_count);            } break;
+
+        case Section_footer: {
+            write_literal(ob,
+                          "#define weak_type_compare(A, B) TypeCompare_<pp::Type<A>::weak_type, pp::Type<B>::weak_type>::e;");
+
+            //
+            // # Guard macro.
+            //
+            write_literal(ob,
+                          "\n"
+                          "#undef _std // :(\n"
+                          "} // namespace pp\n"
+                          "\n"
+                          "#endif // Header guard.\n"
+                          "\n");
+        } break;
+
+        default: { assert(0); } break;
+    }
 
-        // Forward declare structs.
-        write_to_output_buffer(&ob, "// Forward declared structs, enums, and function (these must be declared outside the namespace...)\n");
-        forward_declare_structs(&ob, struct_data, struct_count);
-        forward_declare_enums(&ob, enum_data, enum_count);
-        forward_declare_functions(&ob, func_data, func_count);
+    trace_end();
+}
 
-        write_to_output_buffer(&ob,
-                               "\n"
-                               "// This is nessessary due to the way the generated code is outputted. Is #undef'd at the bottom of this file.\n"
-                               "#define _std std\n"
-                               "\n");
+// Each section gets its own arena, because the arena it'll be joined into belongs to another thread.
+struct SectionJob {
+    WriteDataInput *in;
+    Section section;
 
-        //
-        // Types enum.
-        //
+    MemoryArena arena;
+    OutputBuffer ob;
+};
 
-        // Get the absolute max number of meta types. This will be significantly bigger than the
-        // actual number of unique types...
-        Int max_type_count = get_num_of_primitive_types();
-        for(Int i = 0; (i < struct_count); ++i) max_type_count += struct_data[i].member_count + 1;
+internal Void write_section_job(Void *data) {
+    SectionJob *job = cast(SectionJob *)data;
 
-        String *types = system_alloc(String, max_type_count);
-        if(types) {
-            Int type_count = get_actual_type_count(types, struct_data, struct_count);
-            assert(type_count <= max_type_count);
+    job->ob.arena = &job->arena;
+    write_section(&job->ob, job->in, job->section);
+}
 
-            write_meta_type_enum(&ob, types, type_count);
+// Moves src's chunks onto the end of dst. The chunks themselves don't move, so src's arena has to outlive dst.
+internal Void append_output_buffer(OutputBuffer *dst, OutputBuffer *src) {
+    if(src->first) {
+        if(dst->last) { dst->last->next = src->first; }
+        else          { dst->first = src->first;      }
+        dst->last = src->last;
+        dst->chunk_count += src->chunk_count;
+        dst->total_size += src->total_size;
+    }
 
-            write_to_output_buffer(&ob, "\n");
-            write_to_output_buffer(&ob,
-                                   "#include \"static_generated.h\"\n"
-                                   "namespace pp { // PreProcessor\n");
-            write_to_output_buffer(&ob, "\n");
+    zero(src, sizeof(*src));
+}
 
-            write_out_recreated_enums(&ob, enum_data, enum_count);
-            write_out_recreated_structs(&ob, struct_data, struct_count);
+// Below this the sections are so small that spinning up jobs (and an arena block each) costs more than it saves.
+#define parallel_section_member_threshold 4096
 
-            write_out_type_specification_struct(&ob, struct_data, struct_count, enum_data, enum_count);
-            write_out_type_specification_enum(&ob, enum_data, enum_count);
-            write_out_get_at_index(&ob, struct_data, struct_count);
-            write_out_get_name_at_index(&ob, struct_data, struct_count);
+OutputBuffer write_data(Char const *fname, StructData *struct_data, Int struct_count, EnumData *enum_data,
+                        Int enum_count, FunctionData *func_data, Int func_count, MemberTable *members,
+                        SymbolTable *symbols, MemoryArena *arena, Int lookup_struct_count/*= 0*/) {
+    OutputBuffer ob = {};
+    ob.arena = arena;
 
-            write_is_container(&ob, types, type_count);
-            write_meta_type_to_name(&ob, struct_data, struct_count);
-            write_sizeof_from_str(&ob, struct_data, struct_count);
-            write_serialize_struct_implementation(&ob, types, type_count);
-            write_out_get_access(&ob, struct_data, struct_count);
+    WriteDataInput in = {fname, struct_data, struct_count, enum_data, enum_count, func_data, func_count, members, symbols};
 
+    // Get the absolute max number of meta types. This will be significantly bigger than the
+    // actual number of unique types...
+    Int member_count = 0;
+    for(Int i = 0; (i < struct_count); ++i) member_count += struct_data[i].member_count;
+    Int max_type_count = get_num_of_primitive_types() + member_count + struct_count;
 
-            system_free(types);
-        }
+    in.types = push_arena(arena, String, max_type_count);
+    if(in.types) {
+        in.type_count = get_actual_type_count(in.types, struct_data, struct_count, members, symbols, arena);
+        assert(in.type_count <= max_type_count);
+    }
 
-        write_get_members_of(&ob, struct_data, struct_count);
-        write_get_members_of_str(&ob, struct_data, struct_count);
-        write_get_number_of_members_str(&ob, struct_data, struct_count);
-
-        write_to_output_buffer(&ob,
-                               "\n"
-                               "//\n"
-                               "// Enum Introspection data.\n"
-                               "//\n"
-                               "\n"
-                               "// Stub functions.\n"
-                               "template<typename T>static constexpr char const *enum_to_string(T element) { return(0); }\n"
-                               "template<typename T>static constexpr T string_to_enum(char const *str) { return(0); }\n"
-                               "\n");
-        for(Int i = 0; (i < enum_count); ++i) {
-            if(enum_data[i].type.len) {
-                write_to_output_buffer(&ob,
-                                       "// %.*s.\n",
-                                       enum_data[i].name.len, enum_data[i].name.e);
-                write_enum_to_string(&ob, enum_data[i]);
-                write_string_to_enum(&ob, enum_data[i]);
+    // Built after get_actual_type_count, because that interns the primitives. If there's more than one struct with
+    // the same name, the first one wins.
+    in.struct_index = push_arena(arena, StructData *, symbols->cnt + 1);
+    if(in.struct_index) {
+        for(Int i = 0; (i < struct_count + lookup_struct_count); ++i) {
+            StructData *sd = struct_data + i;
+            if((sd->name_id) && (!in.struct_index[sd->name_id])) {
+                in.struct_index[sd->name_id] = sd;
             }
         }
+    } else {
+        in.types = 0;
+    }
 
-        write_to_output_buffer(&ob, "\n");
+    SectionJob *jobs = 0;
+    if((get_thread_count() > 1) && (member_count + struct_count + enum_count >= parallel_section_member_threshold)) {
+        jobs = push_arena(arena, SectionJob, Section_count);
+    }
 
-        write_to_output_buffer(&ob,
-                               "#define weak_type_compare(A, B) TypeCompare_<pp::Type<A>::weak_type, pp::Type<B>::weak_type>::e;");
+    if(jobs) {
+        Int volatile sections_remaining = 0;
+        for(Int i = 0; (i < Section_count); ++i) {
+            jobs[i].in = &in;
+            jobs[i].section = cast(Section)i;
 
-        //
-        // # Guard macro.
-        //
-        write_to_output_buffer(&ob,
-                               "\n"
-                               "#undef _std // :(\n"
-                               "} // namespace pp\n"
-                               "\n"
-                               "#endif // Header guard.\n"
-                               "\n");
+            add_job(write_section_job, jobs + i, &sections_remaining);
+        }
 
-        res.size = ob.index;
-        res.data = ob.buffer;
+        wait_for_jobs(&sections_remaining);
+
+        for(Int i = 0; (i < Section_count); ++i) {
+            append_output_buffer(&ob, &jobs[i].ob);
+            absorb_arena(arena, &jobs[i].arena);
+        }
+    } else {
+        for(Int i = 0; (i < Section_count); ++i) {
+            write_section(&ob, &in, cast(Section)i);
+        }
     }
 
-    return(res);
+    return(ob);
 }
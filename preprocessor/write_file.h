@@ -16,10 +16,37 @@
 struct StructData;
 struct EnumData;
 struct FunctionData;
-struct File;
+struct FileChunk;
+struct MemoryArena;
+struct MemberTable;
+struct SymbolTable;
 
-File write_data(Char const *fname, StructData *struct_data, Int struct_count, EnumData *enum_data, Int enum_count,
-                FunctionData *func_data, Int func_cnt);
+// A generated file, as a list of chunks allocated from an arena. Growing it never moves anything which has already
+// been written, and the chunks can go straight to system_write_chunks_to_file.
+struct OutputChunk {
+    OutputChunk *next;
+    Char *data;
+    Int used;
+    Int size;
+};
+
+struct OutputBuffer {
+    OutputChunk *first;
+    OutputChunk *last;
+    Int chunk_count;
+    PtrSize total_size;
+
+    MemoryArena *arena;
+};
+
+// chunks must have room for ob->chunk_count.
+Void get_output_chunks(OutputBuffer *ob, FileChunk *chunks);
+
+// struct_data can be followed by lookup_struct_count more structs (like the ones from #included headers), which are
+// only used to find base classes and member types. Code's only written for the first struct_count.
+OutputBuffer write_data(Char const *fname, StructData *struct_data, Int struct_count, EnumData *enum_data,
+                        Int enum_count, FunctionData *func_data, Int func_cnt, MemberTable *members,
+                        SymbolTable *symbols, MemoryArena *arena, Int lookup_struct_count = 0);
 
 #define _WRTIE_FILE_H
 #endif
@@ -3,6 +3,7 @@
 rem Variables to set.
 set RELEASE=true
 set GTEST=false
+set BENCHMARK=true
 
 rem Setup Visual Studio 2015.
 call "C:\Program Files (x86)\Microsoft Visual Studio 14.0\VC\vcvarsall.bat" x64
@@ -15,7 +16,7 @@ set DEBUG_COMMON_COMPILER_FLAGS=-nologo -MTd -Gm- -GR- -EHsc- -Od -Oi %COMMON_WA
 set RELEASE_COMMON_COMPILER_FLAGS=-nologo -MT -fp:fast -Gm- -GR- -EHa- -O2 -Oi %COMMON_WARNINGS% -DINTERNAL=0 -FC -Zi -GS- -Gs9999999
 
 rem Build prepreprocessor.
-set FILES="../preprocessor/main.cpp" "../preprocessor/utils.cpp" "../preprocessor/lexer.cpp" "../preprocessor/platform.cpp" "../preprocessor/write_file.cpp"
+set FILES="../preprocessor/main.cpp" "../preprocessor/utils.cpp" "../preprocessor/lexer.cpp" "../preprocessor/platform.cpp" "../preprocessor/write_file.cpp" "../preprocessor/thread_pool.cpp"
 
 IF NOT EXIST "build" mkdir "build"
 pushd "build"
@@ -28,6 +29,11 @@ if "%RELEASE%"=="true" (
         cl -FePreprocessor %DEBUG_COMMON_COMPILER_FLAGS% -DRUN_TESTS=0 -Wall %FILES% -link -subsystem:console,5.2 kernel32.lib Shlwapi.lib
     )
 )
+rem Benchmark. Everything but main.cpp, always optimized.
+set BENCHMARK_FILES="../preprocessor/utils.cpp" "../preprocessor/lexer.cpp" "../preprocessor/platform.cpp" "../preprocessor/write_file.cpp" "../preprocessor/thread_pool.cpp" "../preprocessor/benchmark.cpp"
+if "%BENCHMARK%"=="true" (
+    cl -FeBenchmark %RELEASE_COMMON_COMPILER_FLAGS% -DRUN_TESTS=0 -Wall %BENCHMARK_FILES% -link -subsystem:console,5.2 kernel32.lib Shlwapi.lib
+)
 popd
 
 rem Run after building.